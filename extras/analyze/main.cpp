@@ -0,0 +1,158 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "psg_ctrl/psg_ctrl.h"
+
+namespace {
+
+    const uint32_t DEFAULT_MAX_TICKS = 100UL*60*60;
+
+    void usage(const char *prog) {
+
+        std::fprintf(stderr,
+            "usage: %s [-c fs_clock] [-f proc_freq] [-t max_ticks] [-m mode] [-C max_cmds] [-W max_writes] file.mml ...\n"
+            "Prints the length, the loop points and the peak per-tick cost of each MML file.\n"
+            "Exits with 1 when a file is invalid or exceeds -C/-W.\n",
+            prog);
+    }
+
+    bool read_file(const char *path, std::string &out) {
+
+        std::ifstream ifs(path, std::ios::binary);
+        if ( !ifs ) {
+
+            return false;
+        }
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        out = ss.str();
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    float fs_clock = 2000000.0F;
+    uint16_t proc_freq = PsgCtrl::DEFAULT_PROC_FREQ;
+    uint32_t max_ticks = DEFAULT_MAX_TICKS;
+    uint16_t mode = 0;
+    unsigned max_cmds = 0;
+    unsigned max_writes = 0;
+    std::vector<std::string> paths;
+
+    for ( int i = 1; i < argc; i++ ) {
+
+        if ( ( std::strcmp(argv[i], "-c") == 0 ) && ( i+1 < argc ) ) {
+
+            fs_clock = std::strtof(argv[++i], nullptr);
+
+        } else if ( ( std::strcmp(argv[i], "-f") == 0 ) && ( i+1 < argc ) ) {
+
+            proc_freq = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-t") == 0 ) && ( i+1 < argc ) ) {
+
+            max_ticks = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-m") == 0 ) && ( i+1 < argc ) ) {
+
+            mode = std::strtoul(argv[++i], nullptr, 0);
+
+        } else if ( ( std::strcmp(argv[i], "-C") == 0 ) && ( i+1 < argc ) ) {
+
+            max_cmds = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-W") == 0 ) && ( i+1 < argc ) ) {
+
+            max_writes = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( argv[i][0] == '-' ) {
+
+            usage(argv[0]);
+            return 1;
+
+        } else {
+
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if ( paths.empty() ) {
+
+        usage(argv[0]);
+        return 1;
+    }
+
+    int ret = 0;
+    for ( size_t i = 0; i < paths.size(); i++ ) {
+
+        std::string text;
+        PsgCtrl::SONG_INFO info;
+
+        if ( !read_file(paths[i].c_str(), text) ) {
+
+            std::fprintf(stderr, "%s: cannot read\n", paths[i].c_str());
+            ret = 1;
+            continue;
+        }
+
+        int status = PsgCtrl::analyze_mml(
+                text.c_str(),
+                mode,
+                static_cast<uint32_t>(fs_clock*100+0.5F),
+                proc_freq,
+                info,
+                max_ticks
+        );
+        if ( status < 0 ) {
+
+            std::fprintf(stderr, "%s: invalid MML (%d)\n", paths[i].c_str(), status);
+            ret = 1;
+            continue;
+        }
+
+        std::printf("%s: %lu ticks, %lu ms%s%s\n",
+                paths[i].c_str(),
+                static_cast<unsigned long>(info.total_ticks),
+                static_cast<unsigned long>(info.total_ms),
+                info.loops_forever ? ", loops forever" : "",
+                info.complete ? "" : " (stopped at -t)");
+
+        for ( uint8_t ch = 0; ch < info.num_channels; ch++ ) {
+
+            if ( info.loop_start_tick[ch] != PsgCtrl::NO_LOOP ) {
+
+                std::printf("  ch%u: loop at offset %lu, from tick %lu, %lu ticks per pass\n",
+                        ch,
+                        static_cast<unsigned long>(info.loop_ofs[ch]),
+                        static_cast<unsigned long>(info.loop_start_tick[ch]),
+                        static_cast<unsigned long>(info.loop_ticks[ch]));
+            }
+        }
+
+        std::printf("  peak: %u commands (tick %lu), %u register writes (tick %lu)\n",
+                info.max_cmds_per_tick,
+                static_cast<unsigned long>(info.peak_cmds_tick),
+                info.max_writes_per_tick,
+                static_cast<unsigned long>(info.peak_writes_tick));
+
+        if ( ( ( max_cmds != 0 ) && ( info.max_cmds_per_tick > max_cmds ) ) ||
+             ( ( max_writes != 0 ) && ( info.max_writes_per_tick > max_writes ) )
+        ) {
+
+            std::fprintf(stderr, "%s: exceeds the per-tick limit\n", paths[i].c_str());
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,147 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "psgino_batch.h"
+
+namespace {
+
+    void usage(const char *prog) {
+
+        std::fprintf(stderr,
+            "usage: %s [-j threads] [-c fs_clock] [-f proc_freq] [-t max_ticks] [-m mode] file.mml ...\n"
+            "Renders each MML file and writes its register log to file.mml.reglog.\n",
+            prog);
+    }
+
+    bool read_file(const char *path, std::string &out) {
+
+        std::ifstream ifs(path, std::ios::binary);
+        if ( !ifs ) {
+
+            return false;
+        }
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    bool write_reg_log(const std::string &path, const PsginoBatch::Result &result) {
+
+        FILE *fp = std::fopen(path.c_str(), "w");
+        if ( fp == nullptr ) {
+
+            return false;
+        }
+        for ( const auto &w : result.reg_log ) {
+
+            std::fprintf(fp, "%lu %X %02X\n", static_cast<unsigned long>(w.tick), w.addr, w.data);
+        }
+        std::fclose(fp);
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    unsigned num_threads = 0;
+    float fs_clock = 2000000.0F;
+    uint16_t proc_freq = PsgCtrl::DEFAULT_PROC_FREQ;
+    uint32_t max_ticks = PsginoBatch::DEFAULT_MAX_TICKS;
+    uint16_t mode = 0;
+    std::vector<std::string> paths;
+    std::vector<std::string> texts;
+
+    for ( int i = 1; i < argc; i++ ) {
+
+        if ( ( std::strcmp(argv[i], "-j") == 0 ) && ( i+1 < argc ) ) {
+
+            num_threads = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-c") == 0 ) && ( i+1 < argc ) ) {
+
+            fs_clock = std::strtof(argv[++i], nullptr);
+
+        } else if ( ( std::strcmp(argv[i], "-f") == 0 ) && ( i+1 < argc ) ) {
+
+            proc_freq = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-t") == 0 ) && ( i+1 < argc ) ) {
+
+            max_ticks = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-m") == 0 ) && ( i+1 < argc ) ) {
+
+            mode = std::strtoul(argv[++i], nullptr, 0);
+
+        } else if ( argv[i][0] == '-' ) {
+
+            usage(argv[0]);
+            return 1;
+
+        } else {
+
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if ( paths.empty() ) {
+
+        usage(argv[0]);
+        return 1;
+    }
+
+    texts.resize(paths.size());
+    std::vector<PsginoBatch::Job> jobs(paths.size());
+    std::vector<PsginoBatch::Result> results(paths.size());
+
+    for ( size_t i = 0; i < paths.size(); i++ ) {
+
+        if ( !read_file(paths[i].c_str(), texts[i]) ) {
+
+            std::fprintf(stderr, "%s: cannot read\n", paths[i].c_str());
+            return 1;
+        }
+        jobs[i] = PsginoBatch::Job{ texts[i].c_str(), mode, fs_clock, proc_freq, max_ticks };
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    PsginoBatch::Render(jobs.data(), results.data(), jobs.size(), num_threads);
+    auto t1 = std::chrono::steady_clock::now();
+
+    uint64_t total_ticks = 0;
+    int ret = 0;
+    for ( size_t i = 0; i < paths.size(); i++ ) {
+
+        if ( results[i].status < 0 ) {
+
+            std::fprintf(stderr, "%s: invalid MML (%d)\n", paths[i].c_str(), results[i].status);
+            ret = 1;
+            continue;
+        }
+        if ( !write_reg_log(paths[i] + ".reglog", results[i]) ) {
+
+            std::fprintf(stderr, "%s.reglog: cannot write\n", paths[i].c_str());
+            ret = 1;
+        }
+        total_ticks += results[i].ticks;
+    }
+
+    double sec = std::chrono::duration<double>(t1 - t0).count();
+    std::fprintf(stderr, "%zu jobs, %llu ticks, %.3f s, %.0f ticks/s\n",
+            jobs.size(),
+            static_cast<unsigned long long>(total_ticks),
+            sec,
+            (sec > 0) ? (total_ticks/sec) : 0.0);
+
+    return ret;
+}
@@ -0,0 +1,122 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <atomic>
+#include <thread>
+#include "psgino_batch.h"
+
+namespace PsginoBatch {
+
+    void RenderOne(const Job &job, Result &result) {
+
+        PsgCtrl::SLOT slot;
+        PsgCtrl::CHANNEL_INFO ch[PsgCtrl::NUM_CHANNEL];
+        uint32_t tick;
+        int ret;
+
+        result.reg_log.clear();
+        result.ticks = 0;
+
+        PsgCtrl::init_slot(
+                slot,
+                static_cast<uint32_t>(job.fs_clock*100+0.5F),
+                job.proc_freq,
+                false,
+                &ch[0],
+                &ch[1],
+                &ch[2]
+        );
+
+        ret = PsgCtrl::set_mml(slot, job.mml, job.mode);
+        if ( ret < 0 ) {
+
+            result.status = ret;
+            return;
+        }
+
+        slot.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
+        slot.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+
+        result.status = 1;
+        for ( tick = 0; tick < job.max_ticks; tick++ ) {
+
+            uint32_t idle;
+
+            PsgCtrl::control_psg(slot);
+
+            for ( uint8_t addr = 0; addr <= 0xF; addr++ ) {
+
+                if ( ( (slot.psg_reg.flags_addr >> addr) & 0x1 ) != 0 ) {
+
+                    result.reg_log.push_back(RegWrite{tick, addr, slot.psg_reg.data[addr]});
+                }
+            }
+            slot.psg_reg.flags_addr = 0;
+            slot.psg_reg.flags_mixer = 0;
+
+            if ( slot.gl_info.sys_status.CTRL_STAT == PsgCtrl::CTRL_STAT_END ) {
+
+                tick++;
+                result.status = 0;
+                break;
+            }
+
+            /* Jump over the ticks in which only the timers count down. */
+            idle = PsgCtrl::get_idle_ticks(slot);
+            if ( idle > job.max_ticks - (tick+1) ) {
+
+                idle = job.max_ticks - (tick+1);
+            }
+            PsgCtrl::skip_ticks(slot, static_cast<uint16_t>(idle));
+            tick += idle;
+        }
+
+        result.ticks = tick;
+    }
+
+    void Render(const Job *jobs, Result *results, size_t num_jobs, unsigned num_threads) {
+
+        std::atomic<size_t> cursor(0);
+        std::vector<std::thread> workers;
+
+        if ( num_threads == 0 ) {
+
+            num_threads = std::thread::hardware_concurrency();
+        }
+        if ( num_threads == 0 ) {
+
+            num_threads = 1;
+        }
+        if ( num_threads > num_jobs ) {
+
+            num_threads = static_cast<unsigned>(num_jobs);
+        }
+
+        auto worker = [&]() {
+
+            for (;;) {
+
+                size_t i = cursor.fetch_add(1, std::memory_order_relaxed);
+                if ( i >= num_jobs ) {
+
+                    break;
+                }
+                RenderOne(jobs[i], results[i]);
+            }
+        };
+
+        /* The calling thread takes part in the work as well. */
+        for ( unsigned i = 1; i < num_threads; i++ ) {
+
+            workers.emplace_back(worker);
+        }
+        worker();
+
+        for ( auto &t : workers ) {
+
+            t.join();
+        }
+    }
+}
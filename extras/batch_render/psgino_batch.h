@@ -0,0 +1,70 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef PSGINO_BATCH_H
+#define PSGINO_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "psg_ctrl/psg_ctrl.h"
+
+namespace PsginoBatch {
+
+    constexpr uint32_t DEFAULT_MAX_TICKS = (100UL*60*10);  /* 10 minutes at 100 Hz */
+
+    /**
+     * @brief One independent rendering job.
+     */
+    struct Job {
+        const char *mml;        ///< MML string (must stay valid until `Render()` returns).
+        uint16_t    mode;       ///< Mode flags passed to `PsgCtrl::set_mml`.
+        float       fs_clock;   ///< System clock frequency of the PSG in Hz.
+        uint16_t    proc_freq;  ///< Processing frequency in Hz.
+        uint32_t    max_ticks;  ///< Upper bound of ticks to render (songs with `[0 ...]` never end).
+    };
+
+    /**
+     * @brief A single PSG register write, stamped with the tick it was issued in.
+     */
+    struct RegWrite {
+        uint32_t    tick;
+        uint8_t     addr;
+        uint8_t     data;
+    };
+
+    /**
+     * @brief Output of one job.
+     */
+    struct Result {
+        std::vector<RegWrite> reg_log;  ///< Register writes in issue order.
+        uint32_t    ticks;              ///< Number of ticks rendered.
+        int         status;             ///< 0: reached the end, 1: hit `max_ticks`, negative: `set_mml` error.
+    };
+
+    /**
+     * @brief Renders a single job on the calling thread.
+     *
+     * @param job The job to be rendered.
+     * @param result Receives the register log of the job.
+     */
+    void RenderOne(const Job &job, Result &result);
+
+    /**
+     * @brief Renders many independent jobs in parallel.
+     *
+     * Every job owns its own `PsgCtrl::SLOT` and channels, so jobs never share state.
+     * Workers pull jobs from a shared atomic cursor, so a long song on one worker
+     * never holds back the others.
+     *
+     * @param jobs Array of jobs.
+     * @param results Array of `num_jobs` results, filled in job order.
+     * @param num_jobs Number of jobs.
+     * @param num_threads Number of worker threads. 0 selects `std::thread::hardware_concurrency()`.
+     */
+    void Render(const Job *jobs, Result *results, size_t num_jobs, unsigned num_threads = 0);
+}
+
+#endif/*PSGINO_BATCH_H*/
@@ -0,0 +1,164 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef PSGINO_SLOT_BANK_H
+#define PSGINO_SLOT_BANK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "psg_ctrl/psg_ctrl.h"
+
+namespace PsginoBatch {
+
+    /**
+     * @class SlotBank
+     * @brief Advances many independent slots in lockstep, one tick per `Tick()` call.
+     *
+     * The slots and their channels live in contiguous arrays. The per-tick countdown of
+     * every lane is kept in a separate `idle` array, so a tick is one linear pass over
+     * that array; `PsgCtrl::control_psg` is only entered for the lanes whose countdown
+     * expired, i.e. lanes that reach a note boundary or run an effect in this tick.
+     */
+    class SlotBank {
+    public:
+        /**
+         * @brief Constructs a bank of `num_slots` slots.
+         *
+         * @param num_slots Number of slots. The bank never reallocates, so slots may be referenced freely.
+         */
+        explicit SlotBank(size_t num_slots)
+            : slots(num_slots)
+            , channels(num_slots*PsgCtrl::NUM_CHANNEL)
+            , idle(num_slots, 0)
+            , skipped(num_slots, 0)
+            , wake(num_slots, 0) {
+        }
+
+        /**
+         * @brief Initializes slot `i`.
+         *
+         * @param i Slot index.
+         * @param fs_clock The system clock frequency of the PSG in Hz.
+         * @param proc_freq The processing frequency in Hz.
+         */
+        void Init(size_t i, float fs_clock, uint16_t proc_freq = PsgCtrl::DEFAULT_PROC_FREQ) {
+
+            PsgCtrl::CHANNEL_INFO *p_ch = &this->channels[i*PsgCtrl::NUM_CHANNEL];
+
+            PsgCtrl::init_slot(
+                    this->slots[i],
+                    static_cast<uint32_t>(fs_clock*100+0.5F),
+                    proc_freq,
+                    false,
+                    &p_ch[0],
+                    &p_ch[1],
+                    &p_ch[2]
+            );
+            this->Wake(i);
+        }
+
+        /**
+         * @brief Sets the MML of slot `i` and starts its playback.
+         *
+         * @return Return value of `PsgCtrl::set_mml`.
+         */
+        int Play(size_t i, const char *mml, uint16_t mode = 0) {
+
+            int ret = PsgCtrl::set_mml(this->slots[i], mml, mode);
+            if ( ret == 0 ) {
+
+                this->slots[i].gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
+                this->slots[i].gl_info.sys_request.CTRL_REQ_FLAG = 1;
+            }
+            this->Wake(i);
+            return ret;
+        }
+
+        /**
+         * @brief Makes slot `i` run `control_psg` in the next tick.
+         *
+         * Call this after changing the state of a slot directly (speed factor, requests, etc.).
+         */
+        void Wake(size_t i) {
+
+            PsgCtrl::skip_ticks(this->slots[i], this->skipped[i]);
+            this->skipped[i] = 0;
+            this->idle[i] = 0;
+        }
+
+        /**
+         * @brief Advances every slot by one tick.
+         *
+         * @param write Called as `write(slot_index, addr, data)` for each register write.
+         */
+        template <class Write>
+        void Tick(Write &&write) {
+
+            const size_t n = this->slots.size();
+
+            /* Countdown pass over plain arrays; free of calls and data-dependent branches. */
+            for ( size_t i = 0; i < n; i++ ) {
+
+                uint16_t is_idle = ( this->idle[i] != 0 ) ? 1 : 0;
+                this->wake[i]     = static_cast<uint8_t>(is_idle ^ 1);
+                this->idle[i]    -= is_idle;
+                this->skipped[i] += is_idle;
+            }
+
+            for ( size_t i = 0; i < n; i++ ) {
+
+                if ( this->wake[i] == 0 ) {
+
+                    continue;
+                }
+
+                PsgCtrl::SLOT &slot = this->slots[i];
+
+                PsgCtrl::skip_ticks(slot, this->skipped[i]);
+                this->skipped[i] = 0;
+
+                PsgCtrl::control_psg(slot);
+
+                for ( uint8_t addr = 0; addr <= 0xF; addr++ ) {
+
+                    if ( ( (slot.psg_reg.flags_addr >> addr) & 0x1 ) != 0 ) {
+
+                        write(i, addr, slot.psg_reg.data[addr]);
+                    }
+                }
+                slot.psg_reg.flags_addr = 0;
+                slot.psg_reg.flags_mixer = 0;
+
+                this->idle[i] = PsgCtrl::get_idle_ticks(slot);
+            }
+        }
+
+        /**
+         * @brief Gets slot `i`. Call `Wake(i)` after modifying it.
+         */
+        PsgCtrl::SLOT &Slot(size_t i) {
+
+            return this->slots[i];
+        }
+
+        /**
+         * @brief Gets the number of slots.
+         */
+        size_t Size() const {
+
+            return this->slots.size();
+        }
+
+    private:
+        std::vector<PsgCtrl::SLOT>          slots;
+        std::vector<PsgCtrl::CHANNEL_INFO>  channels;
+        std::vector<uint16_t>               idle;
+        std::vector<uint16_t>               skipped;
+        std::vector<uint8_t>                wake;
+    };
+}
+
+#endif/*PSGINO_SLOT_BANK_H*/
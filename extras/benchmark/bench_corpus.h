@@ -0,0 +1,48 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+/*
+ * Representative MML shared by the benchmarks.
+ */
+namespace BenchCorpus {
+
+    struct SONG {
+        const char *name;
+        const char *mml;
+    };
+
+    const SONG songs[] = {
+        { "music_box",
+          /* Funiculì funiculà (examples/music_box) */
+          "$B-60T130[0$E1$A0$H100$D100$S80$F2300$M0$J6$L80$T0V15L4O5[2ED8R8ED8R8F8.E16D8.F16|E2]C8.<"
+          "$M0$E1$F600[4A16A8R16A16|A8.]>$E0$M1$T4F2$E1$F2300G8.F16D8.F16C8.<A16A8.A#16>C8.<A#16A8.G16F2],"
+          "$B-60T130[0$E1$A0$H100$D100$S80$F1000V13L4O4[7G8.G16G8.G16]F8.C16C8.C16"
+          "[2C#8.C#16C#8.C#16|D8.D16D8.D16]A2B-8.B-16G8.B-16F8.C16C8.D16E8.D16C8.<B-16A2],"
+          "$B-60T130[0$E1$A0$H100$D100$S80$F2300$M0$J4$L65$T0V15L4O5[2C<B8>R8C<B8R8>D8.C16<B8.>D16|C2]<A8."
+          "$M0$E1$F600[2F16F8R16F16E8.E16E8R16E16|F8.]>$E0$M1$T4D2$E1$F2300D8.D16<B-8.>D16<A8.F16F8.G16G8.F16E8.E16C2]" },
+        { "dense_128th",
+          /* Dense 128th-note passages with LFO on every channel */
+          "T200[0$M1$J40$L120L128O5cdefgab>cdefgab<],"
+          "T200[0$M1$J30$L-90L128O4c+d+fg+a+>c+d+<],"
+          "T200[0$M1$J20$L60L128O3ceg>ceg<]" },
+        { "effects",
+          /* Pitchbend, noise sweep and software envelopes */
+          "T140[0$E1$A30$D60$S40$F200$R80$P-120L16O4c&e4$P0gr8>c<b-a],"
+          "T140[0L8I10J1~31J31~1H16H16R4],"
+          "T140[0$E1$U16$A1$H1$D2$S60$F8$R2L8O3cc>c<c]" },
+        { "deep_loops",
+          /* Loops nested to the maximum depth, with breaks */
+          "T240[0[2[2[2[2[2[2L64O4c|d]e]f]g]a]b]>c<],"
+          "T240[0[3[3[3L64O3c|e]g]>c<]<b>],"
+          "T240[0[2$E1$A2$D4$S50$F20[2L32O5c|r]e]g]" },
+    };
+
+    const unsigned NUM_SONGS = sizeof(songs)/sizeof(songs[0]);
+}
+
+#endif/*BENCH_CORPUS_H*/
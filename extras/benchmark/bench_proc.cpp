@@ -0,0 +1,52 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <chrono>
+#include <cstdio>
+#include "psg_ctrl/psg_ctrl.h"
+#include "bench_corpus.h"
+
+/*
+ * Measures the average cost of one control_psg() call (the core of Proc()).
+ * Build it once per layout (PSGINO_LAYOUT_SPEED=0/1) and compare the results.
+ */
+
+namespace {
+
+    const uint32_t NUM_TICKS = 2000000;
+}
+
+int main() {
+
+    PsgCtrl::SLOT slot;
+    PsgCtrl::CHANNEL_INFO ch[PsgCtrl::NUM_CHANNEL];
+
+    std::printf("layout: %s, sizeof(CHANNEL_INFO)=%zu, sizeof(SLOT)=%zu\n",
+            PSGINO_LAYOUT_SPEED ? "speed" : "packed",
+            sizeof(PsgCtrl::CHANNEL_INFO),
+            sizeof(PsgCtrl::SLOT));
+
+    for ( unsigned i = 0; i < BenchCorpus::NUM_SONGS; i++ ) {
+
+        PsgCtrl::init_slot(slot, 200000000, 100, false, &ch[0], &ch[1], &ch[2]);
+        PsgCtrl::set_mml(slot, BenchCorpus::songs[i].mml, 0);
+        slot.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
+        slot.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+
+        auto t0 = std::chrono::steady_clock::now();
+        for ( uint32_t t = 0; t < NUM_TICKS; t++ ) {
+
+            PsgCtrl::control_psg(slot);
+            slot.psg_reg.flags_addr = 0;
+            slot.psg_reg.flags_mixer = 0;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / NUM_TICKS;
+        std::printf("%-12s %.1f ns/tick\n", BenchCorpus::songs[i].name, ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,476 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "Psgino.h"
+/* The engine is included directly so that the functions in its unnamed namespace can be timed. */
+#include "psg_ctrl/psg_ctrl.cpp"
+#include "bench_corpus.h"
+
+/*
+ * Benchmark suite for the sequencing hot paths.
+ *
+ * Every row reports the mean, the 99th percentile and the maximum time of one
+ * call in nanoseconds. Micro benchmarks time batches of calls and divide by the
+ * batch size; the per-tick rows (control_psg, PsginoZ::Proc) time each call
+ * individually and subtract the cost of reading the clock.
+ *
+ * Usage: bench_suite [--csv]
+ */
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    const float FS_CLOCK = 2000000.0F;     /* PSG clock in Hz, as given to Psgino */
+    const uint32_t S_CLOCK = 200000000;    /* the same in units of 0.01 Hz, as kept in a SLOT */
+    const uint16_t PROC_FREQ = 100;
+    const size_t NUM_SAMPLES = 20000;
+    const size_t MICRO_BATCH = 64;
+    const size_t NUM_TICKS = 200000;
+
+    volatile uint32_t sink;
+    double clock_overhead;
+    bool csv_output;
+
+    struct STATS {
+        double mean;
+        double p99;
+        double max;
+    };
+
+    STATS summarize(std::vector<double> &samples) {
+
+        STATS st;
+        double sum = 0;
+
+        std::sort(samples.begin(), samples.end());
+        for ( size_t i = 0; i < samples.size(); i++ ) {
+
+            sum += samples[i];
+        }
+        st.mean = sum / samples.size();
+        st.p99 = samples[(samples.size()*99)/100];
+        st.max = samples.back();
+
+        return st;
+    }
+
+    /* Calls prepare() (not timed) and then f() `batch` times (timed) for each sample. */
+    template <class P, class F>
+    STATS measure(P prepare, F f, size_t num_samples, size_t batch, double overhead) {
+
+        std::vector<double> samples(num_samples);
+
+        for ( size_t i = 0; i < num_samples; i++ ) {
+
+            prepare();
+
+            Clock::time_point t0 = Clock::now();
+            for ( size_t b = 0; b < batch; b++ ) {
+
+                f();
+            }
+            Clock::time_point t1 = Clock::now();
+
+            double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() - overhead;
+            samples[i] = ( ns > 0 ) ? (ns / batch) : 0;
+        }
+
+        return summarize(samples);
+    }
+
+    template <class F>
+    STATS measure_micro(F f) {
+
+        return measure([]{}, f, NUM_SAMPLES, MICRO_BATCH, clock_overhead);
+    }
+
+    void report(const char *group, const char *name, const STATS &st) {
+
+        if ( csv_output ) {
+
+            std::printf("%s,%s,%.1f,%.1f,%.1f\n", group, name, st.mean, st.p99, st.max);
+
+        } else {
+
+            std::printf("%-16s %-28s %9.1f %9.1f %9.1f\n", group, name, st.mean, st.p99, st.max);
+        }
+    }
+
+    /*
+     * A slot playing `mml`, stopped at the first tick where `ready` holds.
+     * restore() puts the channels and the registers back to that point, so a
+     * phase of an effect can be timed repeatedly.
+     */
+    struct FIXTURE {
+        PsgCtrl::SLOT slot;
+        PsgCtrl::CHANNEL_INFO ch[PsgCtrl::NUM_CHANNEL];
+        PsgCtrl::CHANNEL_INFO ch_saved[PsgCtrl::NUM_CHANNEL];
+        PsgCtrl::PSG_REG reg_saved;
+        PsgCtrl::NOISE_INFO noise_saved;
+
+        template <class R>
+        void setup(const char *mml, R ready) {
+
+            PsgCtrl::init_slot(slot, S_CLOCK, PROC_FREQ, false, &ch[0], &ch[1], &ch[2]);
+            PsgCtrl::set_mml(slot, mml, 0);
+            slot.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
+            slot.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+
+            for ( uint32_t t = 0; t < 100000; t++ ) {
+
+                PsgCtrl::control_psg(slot);
+                if ( ready(ch[0]) ) {
+
+                    break;
+                }
+            }
+            std::memcpy(ch_saved, ch, sizeof(ch));
+            reg_saved = slot.psg_reg;
+            noise_saved = slot.gl_info.noise_info;
+        }
+
+        void restore() {
+
+            std::memcpy(ch, ch_saved, sizeof(ch));
+            slot.psg_reg = reg_saved;
+            slot.gl_info.noise_info = noise_saved;
+        }
+    };
+
+    bool always(const PsgCtrl::CHANNEL_INFO &) {
+
+        return true;
+    }
+
+    void bench_tone_calc() {
+
+        int16_t n = 0;
+        report("calc_tp", "note 0..95", measure_micro([&]{
+
+            sink += PsgCtrl::calc_tp(n, S_CLOCK);
+            n = ( n < 95 ) ? (n+1) : 0;
+        }));
+
+        const int16_t biases[] = { 0, 90, 180, 359, -359, 1439 };
+        for ( size_t i = 0; i < sizeof(biases)/sizeof(biases[0]); i++ ) {
+
+            char name[32];
+            int16_t bias = biases[i];
+            std::snprintf(name, sizeof(name), "bias %d", bias);
+            report("shift_tp", name, measure_micro([&]{
+
+                sink += PsgCtrl::shift_tp(1000, bias);
+            }));
+        }
+
+        uint8_t len = 1;
+        uint8_t dots = 0;
+        report("get_note_on_time", "length 1..128, 0..2 dots", measure_micro([&]{
+
+            sink += PsgCtrl::get_note_on_time(len, 120, dots, PROC_FREQ);
+            len = ( len < 128 ) ? (len+1) : 1;
+            dots = ( dots < 2 ) ? (dots+1) : 0;
+        }));
+    }
+
+    void bench_decode() {
+
+        /* Each entry is decoded from the start up to and including the note that ends it. */
+        const BenchCorpus::SONG commands[] = {
+            { "note",               "C" },
+            { "note+length+dots",   "C+16.." },
+            { "N",                  "N40" },
+            { "rest",               "R8" },
+            { "noise sweep",        "J1~31" },
+            { "legato",             "C&E" },
+            { "V/L/O/Q/T",          "V12L16O4Q6T150C" },
+            { "< >",                "<<>>C" },
+            { "S/M (hw env)",       "S8M1000C" },
+            { "I",                  "I10C" },
+            { "[ ] loop",           "[2C]" },
+            { "$ sw env",           "$E1$A10$H10$D20$S60$F100$R30C" },
+            { "$ lfo",              "$M1$J20$V0$L60$T8C" },
+            { "$ pitchbend/bias",   "$P-60$B-20$O3C" },
+            { "@C",                 "@C1C" },
+        };
+
+        for ( size_t i = 0; i < sizeof(commands)/sizeof(commands[0]); i++ ) {
+
+            FIXTURE fx;
+            fx.setup(commands[i].mml, always);
+
+            report("decode_mml", commands[i].name, measure(
+                [&]{
+                    fx.restore();
+                },
+                [&]{
+                    fx.ch[0].mml.ofs_mml_pos = 0;
+                    fx.ch[0].ch_status.DECODE_END = 0;
+                    fx.ch[0].ch_status.LOOP_DEPTH = 0;
+                    sink += PsgCtrl::decode_mml(fx.slot, 0);
+                },
+                NUM_SAMPLES, MICRO_BATCH, clock_overhead
+            ));
+        }
+    }
+
+    void bench_lfo() {
+
+        const struct {
+            const char *name;
+            const char *mml;
+        } cases[] = {
+            { "depth 0",            "$M1$J0$L60L1C" },
+            { "depth 10 speed 20",  "$M1$J10$L20L1C" },
+            { "depth 60 speed 80",  "$M1$J60$L80L1C" },
+            { "depth 255 speed 200","$M1$J255$L200L1C" },
+            { "depth 255 speed -200","$M1$J255$L-200L1C" },
+        };
+
+        for ( size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++ ) {
+
+            FIXTURE fx;
+            fx.setup(cases[i].mml, always);
+
+            report("proc_lfo", cases[i].name, measure(
+                [&]{
+                    fx.restore();
+                },
+                [&]{
+                    PsgCtrl::proc_lfo(fx.slot, 0);
+                },
+                NUM_SAMPLES, MICRO_BATCH, clock_overhead
+            ));
+        }
+    }
+
+    void bench_sw_env() {
+
+        const struct {
+            const char *name;
+            const char *mml;
+            uint8_t stat;
+        } cases[] = {
+            { "attack",  "$E1$A10000$S50V15L1C",            PsgCtrl::SW_ENV_STAT_ATTACK  },
+            { "decay",   "$E1$A0$H0$D10000$S50V15L1C",      PsgCtrl::SW_ENV_STAT_DECAY   },
+            { "fade",    "$E1$A0$H0$D0$S100$F10000V15L1C",  PsgCtrl::SW_ENV_STAT_FADE    },
+            { "release", "$E1$A0$H0$D0$S100$R10000V15L64CR1", PsgCtrl::SW_ENV_STAT_RELEASE },
+        };
+
+        for ( size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++ ) {
+
+            FIXTURE fx;
+            uint8_t stat = cases[i].stat;
+            fx.setup(cases[i].mml, [&](const PsgCtrl::CHANNEL_INFO &c) {
+
+                return c.ch_status.SW_ENV_STAT == stat;
+            });
+
+            report("proc_sw_env_gen", cases[i].name, measure(
+                [&]{
+                    fx.restore();
+                },
+                [&]{
+                    PsgCtrl::proc_sw_env_gen(fx.slot, 0);
+                },
+                NUM_SAMPLES, MICRO_BATCH, clock_overhead
+            ));
+        }
+    }
+
+    void bench_speed_factor() {
+
+        FIXTURE fx;
+        fx.setup(BenchCorpus::songs[0].mml, always);
+
+        uint16_t speed = PsgCtrl::DEFAULT_SPEED_FACTOR;
+        report("set_speed_factor", "ramp 100..199%", measure_micro([&]{
+
+            PsgCtrl::set_speed_factor(fx.slot, speed);
+            speed = ( speed < 199 ) ? (speed+1) : PsgCtrl::DEFAULT_SPEED_FACTOR;
+        }));
+    }
+
+    void bench_control_psg() {
+
+        for ( unsigned i = 0; i < BenchCorpus::NUM_SONGS; i++ ) {
+
+            FIXTURE fx;
+            fx.setup(BenchCorpus::songs[i].mml, always);
+
+            report("control_psg", BenchCorpus::songs[i].name, measure(
+                [&]{
+                    fx.slot.psg_reg.flags_addr = 0;
+                    fx.slot.psg_reg.flags_mixer = 0;
+                },
+                [&]{
+                    PsgCtrl::control_psg(fx.slot);
+                },
+                NUM_TICKS, 1, clock_overhead
+            ));
+        }
+    }
+
+    /*
+     * A generated single-channel MML of 60 KiB, and with PSGINO_USE_MML_OFS32=1 one of 120 KiB,
+     * timed over 20000 ticks from offset 10000 and 70000 respectively, so that the second row
+     * decodes past 64 KiB. The two builds then compare the same work at 16 and 32 bits.
+     */
+    void bench_long_mml() {
+
+        const struct {
+            const char *name;
+            size_t len;
+            PsgCtrl::MML_OFS ofs_start;
+        } cases[] = {
+            { "long MML 60 KiB",  60000, 10000 },
+#if PSGINO_USE_MML_OFS32
+            { "long MML 120 KiB", 120000, 70000 },
+#endif
+        };
+
+        for ( size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++ ) {
+
+            static const char head[] = "T255L64";
+            static const char phrase[] = "O4CDEFGAB>C<";
+            std::vector<char> mml;
+            FIXTURE fx;
+            PsgCtrl::MML_OFS ofs_start = cases[i].ofs_start;
+
+            mml.assign(head, head + sizeof(head) - 1);
+            while ( mml.size() + sizeof(phrase) < cases[i].len ) {
+
+                mml.insert(mml.end(), phrase, phrase + sizeof(phrase) - 1);
+            }
+            mml.push_back('\0');
+
+            fx.setup(mml.data(), [&](const PsgCtrl::CHANNEL_INFO &c) {
+
+                return c.mml.ofs_mml_pos >= ofs_start;
+            });
+
+            report("control_psg", cases[i].name, measure(
+                [&]{
+                    fx.slot.psg_reg.flags_addr = 0;
+                    fx.slot.psg_reg.flags_mixer = 0;
+                },
+                [&]{
+                    PsgCtrl::control_psg(fx.slot);
+                },
+                20000, 1, clock_overhead
+            ));
+        }
+    }
+
+    void write_null(uint8_t addr, uint8_t data) {
+
+        sink += addr + data;
+    }
+
+#if PSGINO_USE_SEEK
+    void bench_seek() {
+
+        static PsgCtrl::SEEK_POINT points[64];
+
+        for ( unsigned i = 0; i < BenchCorpus::NUM_SONGS; i++ ) {
+
+            Psgino p;
+            uint32_t ms = 0;
+            char name[40];
+
+            p.Initialize(write_null, FS_CLOCK, PROC_FREQ);
+            p.SetMML(BenchCorpus::songs[i].mml);
+
+            std::snprintf(name, sizeof(name), "%s, no index", BenchCorpus::songs[i].name);
+            report("Psgino::Seek", name, measure([]{}, [&]{
+
+                p.Seek(ms);
+                ms = ( ms < 20000 ) ? (ms+1237) : 0;
+            }, NUM_SAMPLES/20, 1, clock_overhead));
+
+            p.BuildSeekIndex(points, sizeof(points)/sizeof(points[0]), 500);
+
+            std::snprintf(name, sizeof(name), "%s, 500 ms index", BenchCorpus::songs[i].name);
+            report("Psgino::Seek", name, measure([]{}, [&]{
+
+                p.Seek(ms);
+                ms = ( ms < 20000 ) ? (ms+1237) : 0;
+            }, NUM_SAMPLES/20, 1, clock_overhead));
+        }
+    }
+#endif
+
+    void bench_psgino_z() {
+
+        const char *se = "T150$E1$A0$D20$S0$F0L16O6CEG>C";
+
+        for ( unsigned i = 0; i < BenchCorpus::NUM_SONGS; i++ ) {
+
+            PsginoZ z;
+            uint32_t tick = 0;
+
+            z.Initialize(write_null, FS_CLOCK, PROC_FREQ);
+            z.SetMML(BenchCorpus::songs[i].mml);
+            z.Play();
+
+            report("PsginoZ::Proc", BenchCorpus::songs[i].name, measure(
+                [&]{
+                    /* Restart the sound effect every half second, so that BGM masking is exercised. */
+                    if ( (tick++ % 50) == 0 ) {
+
+                        z.SetSeMML(se);
+                        z.PlaySe();
+                    }
+                },
+                [&]{
+                    z.Proc();
+                },
+                NUM_TICKS, 1, clock_overhead
+            ));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+
+    csv_output = ( argc > 1 ) && ( std::strcmp(argv[1], "--csv") == 0 );
+
+    /* Cost of reading the clock twice, subtracted from every sample. */
+    clock_overhead = measure([]{}, []{}, NUM_SAMPLES, 1, 0).mean;
+
+    if ( csv_output ) {
+
+        std::printf("group,name,mean_ns,p99_ns,max_ns\n");
+
+    } else {
+
+        std::printf("layout: %s, song clock: %d, MML positions: %u-bit, clock overhead: %.1f ns\n",
+                PSGINO_LAYOUT_SPEED ? "speed" : "packed",
+                PSGINO_USE_SONG_CLOCK,
+                static_cast<unsigned>(sizeof(PsgCtrl::MML_OFS)*8),
+                clock_overhead);
+        std::printf("%-16s %-28s %9s %9s %9s\n", "group", "name", "mean[ns]", "p99[ns]", "max[ns]");
+    }
+
+    bench_tone_calc();
+    bench_decode();
+    bench_lfo();
+    bench_sw_env();
+    bench_speed_factor();
+    bench_control_psg();
+    bench_long_mml();
+    bench_psgino_z();
+#if PSGINO_USE_SEEK
+    bench_seek();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,517 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "psgino_batch.h"
+
+namespace {
+
+    constexpr uint32_t MAX_TICKS = (100UL*60*2);
+
+    /* Songs whose end or gate once went wrong when idle ticks were skipped. */
+    const char *const SKIP_CASES[] = {
+        "Q4C1",
+        "C4Q2C1,R1",
+        "$E1$A0$D50$S40$R100Q4C1",
+        "T375[4C4]",
+        "T120L8[3CDE]Q6G2,O3L4[6C]",
+        "$E1$A20$D100$S0$R50C2R4,V12O5Q1E2",
+        "$M1$J20$L80$T0Q3A1,O2Q8C2.",
+        "$B-30$P100$Q50Q5C4D4E4,R1C1",
+        "S0M2000Q2C4C4,O3C4R4[2E8]",
+        "[2C4Q3D4]Q8E16",
+    };
+
+    /* Songs whose channels owe more decode budget ticks than their short notes can pay back. */
+    const char *const ALIGN_CASES[] = {
+        "[30V15T120O4$E0$M0L8V14@C1C64],[30@C2C16]",
+        "[20V15V14V13V12V11V10V9V8V7@C1C32R64],[20V15V14V13@C2E64],[20@C3G16]",
+        "T200[16$E1$A0$D20$S60$R30@C1C64R64],O3[8@C2C16],[4V12@C3R8G8]",
+    };
+
+    /* Decode budgets checked against the unlimited decode. */
+    const uint8_t ALIGN_BUDGETS[] = { 1, 2 };
+
+    struct Mark {
+        uint32_t    tick;
+        uint8_t     ch;
+        int32_t     param;
+    };
+
+    std::vector<Mark> marks;
+    uint32_t mark_tick;
+
+    void record_mark(uint8_t ch, int32_t param) {
+
+        marks.push_back(Mark{mark_tick, ch, param});
+    }
+
+    void usage(const char *prog) {
+
+        std::fprintf(stderr,
+            "usage: %s [-c fs_clock] [-f proc_freq] [-n songs] [-s seed] [file.mml ...]\n"
+            "Checks that skipping idle ticks (PsgCtrl::get_idle_ticks/skip_ticks) renders the\n"
+            "same register writes and the same end tick as running every tick, for built-in\n"
+            "cases, -n random songs and the files given, and that under a small decode budget\n"
+            "the @C marks of every channel are at most PsgCtrl::MAX_DECODE_DEBT ticks late,\n"
+            "and that the command queue cases behave as the sketches expect.\n"
+            "Exits with 1 on a difference.\n",
+            prog);
+    }
+
+    bool read_file(const char *path, std::string &out) {
+
+        std::ifstream ifs(path, std::ios::binary);
+        if ( !ifs ) {
+
+            return false;
+        }
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    /* Renders the job with one control_psg call per tick, and records the @C marks. */
+    void render_step(const PsginoBatch::Job &job, PsginoBatch::Result &result, uint8_t budget = 0) {
+
+        PsgCtrl::SLOT slot;
+        PsgCtrl::CHANNEL_INFO ch[PsgCtrl::NUM_CHANNEL];
+        uint32_t tick;
+        int ret;
+
+        result.reg_log.clear();
+        result.ticks = 0;
+
+        PsgCtrl::init_slot(
+                slot,
+                static_cast<uint32_t>(job.fs_clock*100+0.5F),
+                job.proc_freq,
+                false,
+                &ch[0],
+                &ch[1],
+                &ch[2]
+        );
+
+        PsgCtrl::set_decode_budget(slot, budget);
+        PsgCtrl::set_user_callback(slot, record_mark);
+        marks.clear();
+
+        ret = PsgCtrl::set_mml(slot, job.mml, job.mode);
+        if ( ret < 0 ) {
+
+            result.status = ret;
+            return;
+        }
+
+        slot.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
+        slot.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+
+        result.status = 1;
+        for ( tick = 0; tick < job.max_ticks; tick++ ) {
+
+            mark_tick = tick;
+            PsgCtrl::control_psg(slot);
+
+            for ( uint8_t addr = 0; addr <= 0xF; addr++ ) {
+
+                if ( ( (slot.psg_reg.flags_addr >> addr) & 0x1 ) != 0 ) {
+
+                    result.reg_log.push_back(PsginoBatch::RegWrite{tick, addr, slot.psg_reg.data[addr]});
+                }
+            }
+            slot.psg_reg.flags_addr = 0;
+            slot.psg_reg.flags_mixer = 0;
+
+            if ( slot.gl_info.sys_status.CTRL_STAT == PsgCtrl::CTRL_STAT_END ) {
+
+                tick++;
+                result.status = 0;
+                break;
+            }
+        }
+
+        result.ticks = tick;
+    }
+
+    bool is_same(const PsginoBatch::Result &a, const PsginoBatch::Result &b) {
+
+        if ( ( a.status != b.status ) || ( a.ticks != b.ticks ) || ( a.reg_log.size() != b.reg_log.size() ) ) {
+
+            return false;
+        }
+        for ( size_t i = 0; i < a.reg_log.size(); i++ ) {
+
+            if ( ( a.reg_log[i].tick != b.reg_log[i].tick )
+              || ( a.reg_log[i].addr != b.reg_log[i].addr )
+              || ( a.reg_log[i].data != b.reg_log[i].data ) ) {
+
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Checks that a budgeted render keeps every mark within MAX_DECODE_DEBT ticks of the unlimited one. */
+    bool is_aligned(const std::vector<Mark> &ref, const PsginoBatch::Result &ref_result,
+                    const std::vector<Mark> &cut, const PsginoBatch::Result &cut_result) {
+
+        if ( ( ref.size() != cut.size() ) || ( ref_result.status != cut_result.status ) ) {
+
+            return false;
+        }
+        if ( ( cut_result.ticks < ref_result.ticks ) || ( cut_result.ticks > ref_result.ticks + PsgCtrl::MAX_DECODE_DEBT ) ) {
+
+            return false;
+        }
+
+        /* The marks of one channel keep their order, so match them channel by channel. */
+        for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+            size_t i = 0;
+            size_t j = 0;
+
+            while ( true ) {
+
+                while ( ( i < ref.size() ) && ( ref[i].ch != ch ) ) {
+
+                    i++;
+                }
+                while ( ( j < cut.size() ) && ( cut[j].ch != ch ) ) {
+
+                    j++;
+                }
+                if ( ( i >= ref.size() ) || ( j >= cut.size() ) ) {
+
+                    if ( ( i < ref.size() ) || ( j < cut.size() ) ) {
+
+                        return false;
+                    }
+                    break;
+                }
+                if ( ( ref[i].param != cut[j].param )
+                  || ( cut[j].tick < ref[i].tick )
+                  || ( cut[j].tick > ref[i].tick + PsgCtrl::MAX_DECODE_DEBT ) ) {
+
+                    return false;
+                }
+                i++;
+                j++;
+            }
+        }
+        return true;
+    }
+
+    /* A slot driven through the command queue, as Psgino drives it. */
+    struct QueuedSlot {
+        PsgCtrl::SLOT           slot;
+        PsgCtrl::CHANNEL_INFO   ch[PsgCtrl::NUM_CHANNEL];
+
+        QueuedSlot() {
+
+            PsgCtrl::init_slot(slot, 200000000UL, PsgCtrl::DEFAULT_PROC_FREQ, false, &ch[0], &ch[1], &ch[2]);
+        }
+
+        /* Runs one tick and returns the number of registers written. */
+        unsigned step() {
+
+            unsigned num_writes = 0;
+
+            PsgCtrl::control_psg(slot);
+            for ( uint8_t addr = 0; addr <= 0xF; addr++ ) {
+
+                num_writes += (slot.psg_reg.flags_addr >> addr) & 0x1;
+            }
+            slot.psg_reg.flags_addr = 0;
+            slot.psg_reg.flags_mixer = 0;
+            return num_writes;
+        }
+    };
+
+    /* reset drops the MML and the commands posted before it. */
+    bool check_reset_drops_pending() {
+
+        QueuedSlot q;
+
+        PsgCtrl::post_mml(q.slot, "O4C1", 0);
+        PsgCtrl::post_command(q.slot, PsgCtrl::CMD_PLAY);
+        PsgCtrl::reset(q.slot);
+        q.slot.psg_reg.flags_addr = 0;
+        q.slot.psg_reg.flags_mixer = 0;
+
+        if ( ( q.step() != 0 ) || ( q.step() != 0 ) ) {
+
+            return false;
+        }
+        return ( q.slot.gl_info.sys_status.CTRL_STAT == PsgCtrl::CTRL_STAT_STOP )
+            && ( q.slot.gl_info.sys_status.SET_MML == 0 );
+    }
+
+    /* The last of two posts before control_psg is set, as the last set_mml once was. */
+    bool check_last_post_wins() {
+
+        QueuedSlot q;
+        QueuedSlot ref;
+
+        PsgCtrl::post_mml(q.slot, "O4C1", 0);
+        PsgCtrl::post_mml(q.slot, "O6E1", 0);
+        PsgCtrl::post_command(q.slot, PsgCtrl::CMD_PLAY);
+        PsgCtrl::post_mml(ref.slot, "O6E1", 0);
+        PsgCtrl::post_command(ref.slot, PsgCtrl::CMD_PLAY);
+
+        q.step();
+        ref.step();
+
+        return ( q.slot.gl_info.sys_status.CTRL_STAT == PsgCtrl::CTRL_STAT_PLAY )
+            && ( std::memcmp(q.slot.psg_reg.data, ref.slot.psg_reg.data, sizeof(q.slot.psg_reg.data)) == 0 );
+    }
+
+    /* An MML posted on a full queue is still set. */
+    bool check_post_on_full_queue() {
+
+        QueuedSlot q;
+
+        while ( PsgCtrl::post_command(q.slot, PsgCtrl::CMD_STOP) ) {
+        }
+        if ( PsgCtrl::post_mml(q.slot, "O4C1", 0) != 0 ) {
+
+            return false;
+        }
+        q.step();
+
+        return ( q.slot.gl_info.sys_status.SET_MML == 1 );
+    }
+
+    /* A slot with pending commands or a pending MML is not idle. */
+    bool check_pending_not_idle() {
+
+        QueuedSlot q;
+
+        if ( PsgCtrl::get_idle_ticks(q.slot) != 0xFFFF ) {
+
+            return false;
+        }
+        PsgCtrl::post_mml(q.slot, "O4C1", 0);
+        if ( PsgCtrl::get_idle_ticks(q.slot) != 0 ) {
+
+            return false;
+        }
+        q.step();
+        PsgCtrl::post_command(q.slot, PsgCtrl::CMD_PLAY);
+        if ( PsgCtrl::get_idle_ticks(q.slot) != 0 ) {
+
+            return false;
+        }
+        q.step();
+
+        /* The note of C1 is sounding now. */
+        return ( PsgCtrl::get_idle_ticks(q.slot) > 0 );
+    }
+
+    struct CommandCase {
+        const char  *name;
+        bool        (*check)();
+    };
+
+    const CommandCase COMMAND_CASES[] = {
+        { "reset drops pending commands", check_reset_drops_pending },
+        { "the last posted MML wins", check_last_post_wins },
+        { "an MML is set on a full queue", check_post_on_full_queue },
+        { "pending commands are not idle", check_pending_not_idle },
+    };
+
+    /* A random song of short notes, gates, envelopes, loops and rests on 1 to 3 channels. */
+    std::string random_song(uint32_t &seed) {
+
+        static const char *const CMDS[] = {
+            "Q1", "Q4", "Q8", "$E1$A0$D30$S50$R80", "$E0", "$M1$J12$L60", "$M0",
+            "V15", "V9", "O3", "O5", "L8", "L16", "T150", "R4", "R16", "S0M500",
+        };
+        auto next = [&seed](uint32_t n) {
+
+            seed = seed * 1103515245UL + 12345UL;
+            return static_cast<uint32_t>((seed >> 16) % n);
+        };
+        std::string mml;
+        uint32_t num_ch = 1 + next(3);
+
+        for ( uint32_t c = 0; c < num_ch; c++ ) {
+
+            uint32_t num_items = 1 + next(10);
+            bool is_loop = false;
+
+            if ( c > 0 ) {
+
+                mml += ",";
+            }
+            for ( uint32_t i = 0; i < num_items; i++ ) {
+
+                switch ( next(6) ) {
+
+                case 0:
+                    mml += CMDS[next(sizeof(CMDS)/sizeof(CMDS[0]))];
+                    break;
+
+                case 1:
+                    if ( !is_loop ) {
+
+                        mml += "[" + std::to_string(2 + next(3));
+                        is_loop = true;
+                    }
+                    break;
+
+                case 2:
+                    if ( is_loop ) {
+
+                        mml += "]";
+                        is_loop = false;
+                    }
+                    break;
+
+                default:
+                    mml += "CDEFGAB"[next(7)];
+                    mml += std::to_string(1 << next(5));
+                    break;
+                }
+            }
+            if ( is_loop ) {
+
+                mml += "]";
+            }
+        }
+
+        return mml;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    float fs_clock = 2000000.0F;
+    uint16_t proc_freq = PsgCtrl::DEFAULT_PROC_FREQ;
+    unsigned num_random = 1000;
+    uint32_t seed = 1;
+    std::vector<std::string> songs;
+    std::vector<std::string> names;
+
+    for ( int i = 1; i < argc; i++ ) {
+
+        if ( ( std::strcmp(argv[i], "-c") == 0 ) && ( i+1 < argc ) ) {
+
+            fs_clock = std::strtof(argv[++i], nullptr);
+
+        } else if ( ( std::strcmp(argv[i], "-f") == 0 ) && ( i+1 < argc ) ) {
+
+            proc_freq = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-n") == 0 ) && ( i+1 < argc ) ) {
+
+            num_random = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-s") == 0 ) && ( i+1 < argc ) ) {
+
+            seed = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( argv[i][0] == '-' ) {
+
+            usage(argv[0]);
+            return 1;
+
+        } else {
+
+            std::string text;
+            if ( !read_file(argv[i], text) ) {
+
+                std::fprintf(stderr, "%s: cannot read\n", argv[i]);
+                return 1;
+            }
+            songs.push_back(text);
+            names.push_back(argv[i]);
+        }
+    }
+
+    if ( proc_freq == 0 ) {
+
+        usage(argv[0]);
+        return 1;
+    }
+
+    for ( const char *mml : SKIP_CASES ) {
+
+        songs.push_back(mml);
+        names.push_back(std::string("\"") + mml + "\"");
+    }
+    for ( unsigned i = 0; i < num_random; i++ ) {
+
+        songs.push_back(random_song(seed));
+        names.push_back("\"" + songs.back() + "\"");
+    }
+
+    unsigned num_diff = 0;
+    for ( size_t i = 0; i < songs.size(); i++ ) {
+
+        PsginoBatch::Job job = { songs[i].c_str(), 0, fs_clock, proc_freq, MAX_TICKS };
+        PsginoBatch::Result step;
+        PsginoBatch::Result skip;
+
+        render_step(job, step);
+        PsginoBatch::RenderOne(job, skip);
+
+        if ( !is_same(step, skip) ) {
+
+            std::printf("%s: skipping ends at tick %lu (%d), stepping at %lu (%d)\n",
+                    names[i].c_str(),
+                    static_cast<unsigned long>(skip.ticks), skip.status,
+                    static_cast<unsigned long>(step.ticks), step.status);
+            num_diff++;
+        }
+    }
+
+    std::printf("skip/step: %zu songs, %u differ\n", songs.size(), num_diff);
+
+    unsigned num_drift = 0;
+    for ( const char *mml : ALIGN_CASES ) {
+
+        PsginoBatch::Job job = { mml, 0, fs_clock, proc_freq, MAX_TICKS };
+        PsginoBatch::Result ref;
+        std::vector<Mark> ref_marks;
+
+        render_step(job, ref);
+        ref_marks = marks;
+
+        for ( uint8_t budget : ALIGN_BUDGETS ) {
+
+            PsginoBatch::Result cut;
+
+            render_step(job, cut, budget);
+            if ( !is_aligned(ref_marks, ref, marks, cut) ) {
+
+                std::printf("\"%s\": channels drift apart with a decode budget of %u\n", mml, budget);
+                num_drift++;
+            }
+        }
+    }
+
+    std::printf("budget: %zu songs, %u drift\n", sizeof(ALIGN_CASES)/sizeof(ALIGN_CASES[0]), num_drift);
+
+    unsigned num_fail = 0;
+    for ( const CommandCase &c : COMMAND_CASES ) {
+
+        if ( !c.check() ) {
+
+            std::printf("%s: failed\n", c.name);
+            num_fail++;
+        }
+    }
+
+    std::printf("commands: %zu cases, %u fail\n", sizeof(COMMAND_CASES)/sizeof(COMMAND_CASES[0]), num_fail);
+
+    return ( ( num_diff == 0 ) && ( num_drift == 0 ) && ( num_fail == 0 ) ) ? 0 : 1;
+}
@@ -0,0 +1,570 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Psgino.h"
+#include "psg_ctrl/reg_stream.h"
+
+/*
+ * Renders an MML (or reads a .reglog of psgino_batch_render) and writes it as a compressed
+ * register stream for PsgCtrl::open_reg_stream / proc_reg_stream.
+ */
+
+namespace {
+
+    const uint32_t DEFAULT_MAX_TICKS = 100UL*60*60;
+    const unsigned MAX_CANDIDATES = 64;
+
+    /* Registers written in one tick, with their last value; -1 if not written. */
+    struct FRAME {
+        int16_t     reg[PsgCtrl::REG_STREAM_NUM_REGS];
+    };
+
+    typedef std::vector<uint8_t> TOKEN;
+
+    void usage(const char *prog) {
+
+        std::fprintf(stderr,
+            "usage: %s [-c fs_clock] [-f proc_freq] [-m mode] [-t max_ticks] [-l loop_frame] [-v] in.mml|in.reglog out.psgr\n"
+            "Writes the register writes of an MML, or of a .reglog, as a compressed register stream.\n"
+            "The stream of an MML loops if every channel loops at the same tick; -l sets the loop\n"
+            "frame of a .reglog. -v plays the stream back and compares it with the input.\n",
+            prog);
+    }
+
+    bool read_file(const char *path, std::string &out) {
+
+        std::ifstream ifs(path, std::ios::binary);
+        if ( !ifs ) {
+
+            return false;
+        }
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    void put_le16(std::vector<uint8_t> &out, uint32_t v) {
+
+        out.push_back(static_cast<uint8_t>(v));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+    }
+
+    void put_le32(std::vector<uint8_t> &out, uint32_t v) {
+
+        put_le16(out, v & 0xFFFF);
+        put_le16(out, v >> 16);
+    }
+
+    FRAME empty_frame() {
+
+        FRAME f;
+        for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+            f.reg[r] = -1;
+        }
+        return f;
+    }
+
+    std::vector<FRAME> *p_capture;
+    uint32_t capture_tick;
+
+    void write_capture(uint8_t addr, uint8_t data) {
+
+        if ( addr < PsgCtrl::REG_STREAM_NUM_REGS ) {
+
+            (*p_capture)[capture_tick].reg[addr] = data;
+        }
+    }
+
+    bool render_mml(const std::string &text, uint16_t mode, float fs_clock, uint16_t proc_freq, uint32_t max_ticks,
+                    std::vector<FRAME> &frames, uint32_t &loop_frame) {
+
+        PsgCtrl::SONG_INFO info;
+        uint32_t s_clock = static_cast<uint32_t>(fs_clock*100+0.5F);
+        uint32_t num_frames;
+
+        if ( PsgCtrl::analyze_mml(text.c_str(), mode, s_clock, proc_freq, info, max_ticks) < 0 ) {
+
+            return false;
+        }
+
+        /* Loop only if the song repeats as a whole. */
+        loop_frame = PsgCtrl::REG_STREAM_NO_LOOP;
+        if ( info.loops_forever ) {
+
+            bool same = true;
+            for ( uint8_t i = 1; i < info.num_channels; i++ ) {
+
+                same = same
+                    && ( info.loop_start_tick[i] == info.loop_start_tick[0] )
+                    && ( info.loop_ticks[i] == info.loop_ticks[0] );
+            }
+            if ( same && ( info.loop_start_tick[0] != PsgCtrl::NO_LOOP ) ) {
+
+                loop_frame = info.loop_start_tick[0];
+            }
+        }
+        num_frames = ( loop_frame != PsgCtrl::REG_STREAM_NO_LOOP )
+                   ? (info.loop_start_tick[0] + info.loop_ticks[0])
+                   : (info.total_ticks + 1);   /* with the tick that mutes the channels */
+        if ( num_frames > max_ticks ) {
+
+            num_frames = max_ticks;
+            loop_frame = PsgCtrl::REG_STREAM_NO_LOOP;
+        }
+
+        Psgino psgino(write_capture, fs_clock, proc_freq);
+        frames.assign(num_frames, empty_frame());
+        p_capture = &frames;
+        psgino.SetMML(text.c_str(), mode);
+        psgino.Play();
+        for ( capture_tick = 0; capture_tick < num_frames; capture_tick++ ) {
+
+            psgino.Proc();
+        }
+
+        return true;
+    }
+
+    bool read_reglog(const std::string &text, std::vector<FRAME> &frames) {
+
+        std::istringstream ss(text);
+        unsigned long tick;
+        unsigned addr;
+        unsigned data;
+
+        frames.clear();
+        /* "tick addr data", addr and data in hex as psgino_batch_render writes them. */
+        while ( ss >> std::dec >> tick >> std::hex >> addr >> data ) {
+
+            if ( tick >= frames.size() ) {
+
+                frames.resize(tick + 1, empty_frame());
+            }
+            if ( addr < PsgCtrl::REG_STREAM_NUM_REGS ) {
+
+                frames[tick].reg[addr] = static_cast<int16_t>(data & 0xFF);
+            }
+        }
+
+        return ss.eof();
+    }
+
+    /*
+     * Keeps the writes that change a register (R13 restarts the envelope, so every write of it
+     * is kept). The loop frame writes every known register, so that the stream can jump to it.
+     */
+    std::vector<FRAME> make_deltas(const std::vector<FRAME> &frames, uint32_t loop_frame) {
+
+        std::vector<FRAME> deltas(frames.size(), empty_frame());
+        int16_t shadow[PsgCtrl::REG_STREAM_NUM_REGS];
+
+        for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+            shadow[r] = -1;
+        }
+
+        for ( size_t i = 0; i < frames.size(); i++ ) {
+
+            for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+                int16_t v = frames[i].reg[r];
+                if ( ( v >= 0 ) && ( ( v != shadow[r] ) || ( r == 13 ) ) ) {
+
+                    deltas[i].reg[r] = v;
+                    shadow[r] = v;
+                }
+                if ( ( i == loop_frame ) && ( r != 13 ) ) {
+
+                    deltas[i].reg[r] = shadow[r];
+                }
+            }
+        }
+
+        return deltas;
+    }
+
+    TOKEN make_frame_token(const FRAME &f) {
+
+        TOKEN t;
+        uint16_t mask = 0;
+        unsigned count = 0;
+
+        for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+            if ( f.reg[r] >= 0 ) {
+
+                mask |= (1U << r);
+                count++;
+            }
+        }
+
+        if ( count == 1 ) {
+
+            for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+                if ( f.reg[r] >= 0 ) {
+
+                    t.push_back(PsgCtrl::REG_STREAM_ONE | r);
+                    t.push_back(static_cast<uint8_t>(f.reg[r]));
+                }
+            }
+
+        } else {
+
+            t.push_back(static_cast<uint8_t>(PsgCtrl::REG_STREAM_MASK | (mask >> 8)));
+            t.push_back(static_cast<uint8_t>(mask));
+            for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+                if ( f.reg[r] >= 0 ) {
+
+                    t.push_back(static_cast<uint8_t>(f.reg[r]));
+                }
+            }
+        }
+
+        return t;
+    }
+
+    bool is_empty(const FRAME &f) {
+
+        for ( uint8_t r = 0; r < PsgCtrl::REG_STREAM_NUM_REGS; r++ ) {
+
+            if ( f.reg[r] >= 0 ) {
+
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Frame tokens; a run of empty frames becomes WAIT tokens. loop_token receives the token of loop_frame. */
+    std::vector<TOKEN> make_tokens(const std::vector<FRAME> &deltas, uint32_t loop_frame, size_t &loop_token) {
+
+        std::vector<TOKEN> tokens;
+        size_t i = 0;
+
+        loop_token = SIZE_MAX;
+        while ( i < deltas.size() ) {
+
+            if ( i == loop_frame ) {
+
+                loop_token = tokens.size();
+            }
+
+            if ( is_empty(deltas[i]) ) {
+
+                unsigned run = 1;
+                while ( ( i + run < deltas.size() ) &&
+                        ( run < PsgCtrl::REG_STREAM_MAX_RUN ) &&
+                        ( i + run != loop_frame ) &&
+                        is_empty(deltas[i + run]) ) {
+
+                    run++;
+                }
+                tokens.push_back(TOKEN(1, static_cast<uint8_t>(PsgCtrl::REG_STREAM_WAIT + run - 1)));
+                i += run;
+
+            } else {
+
+                tokens.push_back(make_frame_token(deltas[i]));
+                i++;
+            }
+        }
+
+        return tokens;
+    }
+
+    struct TOKEN_HASH {
+        size_t operator()(const TOKEN &t) const {
+
+            size_t h = 2166136261U;
+            for ( size_t i = 0; i < t.size(); i++ ) {
+
+                h = (h ^ t[i]) * 16777619U;
+            }
+            return h;
+        }
+    };
+
+    /*
+     * Greedy LZ over tokens: a run of tokens already written as literals is replaced by a COPY
+     * when that saves bytes. A COPY does not cross the loop token, so the loop starts at a token.
+     */
+    std::vector<uint8_t> compress(const std::vector<TOKEN> &tokens, size_t loop_token, uint32_t &loop_ofs) {
+
+        std::vector<uint8_t> out;
+        std::vector<uint32_t> literal_ofs(tokens.size(), UINT32_MAX);
+        std::unordered_map<TOKEN, std::vector<size_t>, TOKEN_HASH> seen;
+        size_t i = 0;
+
+        loop_ofs = PsgCtrl::REG_STREAM_NO_LOOP;
+        while ( i < tokens.size() ) {
+
+            size_t best_len = 0;
+            size_t best_src = 0;
+            long best_gain = 0;
+            size_t max_len = tokens.size() - i;
+
+            if ( i == loop_token ) {
+
+                loop_ofs = static_cast<uint32_t>(out.size());
+            }
+            if ( ( i < loop_token ) && ( loop_token - i < max_len ) ) {
+
+                max_len = loop_token - i;
+            }
+            if ( max_len > PsgCtrl::REG_STREAM_MAX_COPY ) {
+
+                max_len = PsgCtrl::REG_STREAM_MAX_COPY;
+            }
+
+            auto it = seen.find(tokens[i]);
+            if ( it != seen.end() ) {
+
+                const std::vector<size_t> &cand = it->second;
+                unsigned tried = 0;
+
+                for ( size_t c = cand.size(); ( c-- > 0 ) && ( tried < MAX_CANDIDATES ); tried++ ) {
+
+                    size_t j = cand[c];
+                    size_t len = 0;
+                    long gain = -3;
+
+                    if ( out.size() - literal_ofs[j] > PsgCtrl::REG_STREAM_MAX_DIST ) {
+
+                        break;
+                    }
+                    while ( ( len < max_len ) &&
+                            ( j + len < i ) &&
+                            ( literal_ofs[j + len] != UINT32_MAX ) &&
+                            ( tokens[j + len] == tokens[i + len] ) ) {
+
+                        gain += static_cast<long>(tokens[i + len].size());
+                        len++;
+                    }
+                    if ( gain > best_gain ) {
+
+                        best_gain = gain;
+                        best_len = len;
+                        best_src = j;
+                    }
+                }
+            }
+
+            if ( best_len != 0 ) {
+
+                out.push_back(static_cast<uint8_t>(PsgCtrl::REG_STREAM_COPY + best_len - 1));
+                put_le16(out, static_cast<uint32_t>(out.size() - 1 - literal_ofs[best_src]));
+                i += best_len;
+
+            } else {
+
+                literal_ofs[i] = static_cast<uint32_t>(out.size());
+                out.insert(out.end(), tokens[i].begin(), tokens[i].end());
+                seen[tokens[i]].push_back(i);
+                i++;
+            }
+        }
+        out.push_back(PsgCtrl::REG_STREAM_END);
+
+        return out;
+    }
+
+    std::vector<FRAME> *p_played;
+    uint32_t played_tick;
+
+    void write_played(uint8_t addr, uint8_t data) {
+
+        (*p_played)[played_tick].reg[addr] = data;
+    }
+
+    /* Plays the stream to the end, and through the loop frame once more, and compares the writes. */
+    bool verify(const std::vector<uint8_t> &image, const std::vector<FRAME> &deltas, uint32_t loop_frame) {
+
+        PsgCtrl::REG_STREAM rs;
+        size_t num = deltas.size() + ( ( loop_frame != PsgCtrl::REG_STREAM_NO_LOOP ) ? 1 : 0 );
+        std::vector<FRAME> played(num, empty_frame());
+
+        if ( PsgCtrl::open_reg_stream(rs, image.data(), static_cast<uint32_t>(image.size())) != 0 ) {
+
+            return false;
+        }
+        p_played = &played;
+        for ( played_tick = 0; played_tick < num; played_tick++ ) {
+
+            if ( !PsgCtrl::proc_reg_stream(rs, write_played) ) {
+
+                return false;
+            }
+        }
+        if ( ( loop_frame == PsgCtrl::REG_STREAM_NO_LOOP ) && PsgCtrl::proc_reg_stream(rs, write_played) ) {
+
+            return false;
+        }
+
+        for ( size_t i = 0; i < num; i++ ) {
+
+            const FRAME &want = ( i < deltas.size() ) ? deltas[i] : deltas[loop_frame];
+            if ( std::memcmp(&want, &played[i], sizeof(FRAME)) != 0 ) {
+
+                std::fprintf(stderr, "frame %lu differs\n", static_cast<unsigned long>(i));
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    float fs_clock = 2000000.0F;
+    uint16_t proc_freq = PsgCtrl::DEFAULT_PROC_FREQ;
+    uint16_t mode = 0;
+    uint32_t max_ticks = DEFAULT_MAX_TICKS;
+    uint32_t loop_frame = PsgCtrl::REG_STREAM_NO_LOOP;
+    bool do_verify = false;
+    std::vector<const char *> paths;
+
+    for ( int i = 1; i < argc; i++ ) {
+
+        if ( ( std::strcmp(argv[i], "-c") == 0 ) && ( i+1 < argc ) ) {
+
+            fs_clock = std::strtof(argv[++i], nullptr);
+
+        } else if ( ( std::strcmp(argv[i], "-f") == 0 ) && ( i+1 < argc ) ) {
+
+            proc_freq = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-m") == 0 ) && ( i+1 < argc ) ) {
+
+            mode = std::strtoul(argv[++i], nullptr, 0);
+
+        } else if ( ( std::strcmp(argv[i], "-t") == 0 ) && ( i+1 < argc ) ) {
+
+            max_ticks = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-l") == 0 ) && ( i+1 < argc ) ) {
+
+            loop_frame = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( std::strcmp(argv[i], "-v") == 0 ) {
+
+            do_verify = true;
+
+        } else if ( argv[i][0] == '-' ) {
+
+            usage(argv[0]);
+            return 1;
+
+        } else {
+
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if ( paths.size() != 2 ) {
+
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string text;
+    if ( !read_file(paths[0], text) ) {
+
+        std::fprintf(stderr, "%s: cannot read\n", paths[0]);
+        return 1;
+    }
+
+    std::vector<FRAME> frames;
+    size_t path_len = std::strlen(paths[0]);
+    if ( ( path_len > 7 ) && ( std::strcmp(paths[0] + path_len - 7, ".reglog") == 0 ) ) {
+
+        if ( !read_reglog(text, frames) ) {
+
+            std::fprintf(stderr, "%s: invalid register log\n", paths[0]);
+            return 1;
+        }
+        if ( ( loop_frame != PsgCtrl::REG_STREAM_NO_LOOP ) && ( loop_frame >= frames.size() ) ) {
+
+            std::fprintf(stderr, "%s: loop frame out of range\n", paths[0]);
+            return 1;
+        }
+
+    } else if ( !render_mml(text, mode, fs_clock, proc_freq, max_ticks, frames, loop_frame) ) {
+
+        std::fprintf(stderr, "%s: invalid MML\n", paths[0]);
+        return 1;
+    }
+
+    if ( frames.empty() ) {
+
+        std::fprintf(stderr, "%s: no frames\n", paths[0]);
+        return 1;
+    }
+
+    std::vector<FRAME> deltas = make_deltas(frames, loop_frame);
+    size_t loop_token;
+    std::vector<TOKEN> tokens = make_tokens(deltas, loop_frame, loop_token);
+    uint32_t loop_ofs;
+    std::vector<uint8_t> data = compress(tokens, loop_token, loop_ofs);
+
+    std::vector<uint8_t> image;
+    image.push_back('P');
+    image.push_back('S');
+    image.push_back('G');
+    image.push_back('R');
+    image.push_back(PsgCtrl::REG_STREAM_VERSION);
+    image.push_back(0);
+    put_le16(image, proc_freq);
+    put_le32(image, static_cast<uint32_t>(frames.size()));
+    put_le32(image, ( loop_frame != PsgCtrl::REG_STREAM_NO_LOOP ) ? loop_frame : 0);
+    put_le32(image, loop_ofs);
+    put_le32(image, static_cast<uint32_t>(data.size()));
+    image.insert(image.end(), data.begin(), data.end());
+
+    std::ofstream ofs(paths[1], std::ios::binary);
+    if ( !ofs.write(reinterpret_cast<const char *>(image.data()), image.size()) ) {
+
+        std::fprintf(stderr, "%s: cannot write\n", paths[1]);
+        return 1;
+    }
+    ofs.close();
+
+    size_t delta_size = 0;
+    for ( size_t i = 0; i < tokens.size(); i++ ) {
+
+        delta_size += tokens[i].size();
+    }
+    std::printf("%s: %lu frames, %s, raw %lu bytes, delta %lu bytes, stream %lu bytes\n",
+            paths[1],
+            static_cast<unsigned long>(frames.size()),
+            ( loop_frame != PsgCtrl::REG_STREAM_NO_LOOP ) ? "loops" : "no loop",
+            static_cast<unsigned long>(frames.size() * PsgCtrl::REG_STREAM_NUM_REGS),
+            static_cast<unsigned long>(delta_size),
+            static_cast<unsigned long>(image.size()));
+
+    if ( do_verify ) {
+
+        if ( !verify(image, deltas, loop_frame) ) {
+
+            std::fprintf(stderr, "%s: the stream does not play back as %s\n", paths[1], paths[0]);
+            return 1;
+        }
+        std::printf("%s: verified\n", paths[1]);
+    }
+
+    return 0;
+}
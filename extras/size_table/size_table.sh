@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# MIT License, see the LICENSE file for details.
+#
+# Copyright (c) 2023 nyannkov
+#
+# Prints the code size and the state sizes of the library for each
+# feature configuration of psg_ctrl_config.h as a Markdown table.
+#
+# Usage: size_table.sh [extra compiler flags...]
+#
+# The compiler and the binutils can be overridden, e.g. for AVR:
+#   CXX=avr-g++ NM=avr-nm SIZE=avr-size size_table.sh -mmcu=atmega328p
+#
+set -e
+
+CXX=${CXX:-g++}
+NM=${NM:-nm}
+SIZE=${SIZE:-size}
+CXXFLAGS=${CXXFLAGS:--std=c++11 -Os}
+
+SRC_DIR=$(cd "$(dirname "$0")/../../src" && pwd)
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+cat > "$WORK_DIR/sizes.cpp" <<'EOS'
+#include "psg_ctrl/psg_ctrl.h"
+PsgCtrl::CHANNEL_INFO size_of_channel_info;
+PsgCtrl::SLOT size_of_slot;
+EOS
+
+symbol_size() {
+    # Sizes printed by nm -S are hexadecimal.
+    printf '%d' "0x$("$NM" -S "$WORK_DIR/sizes.o" | awk -v s="$1" '$4 == s { print $2 }')"
+}
+
+measure() {
+    name=$1
+    shift
+    # shellcheck disable=SC2086
+    $CXX $CXXFLAGS "$@" -I"$SRC_DIR" -c "$SRC_DIR/psg_ctrl/psg_ctrl.cpp" -o "$WORK_DIR/psg_ctrl.o"
+    # shellcheck disable=SC2086
+    $CXX $CXXFLAGS "$@" -I"$SRC_DIR" -c "$SRC_DIR/Psgino.cpp" -o "$WORK_DIR/Psgino.o"
+    # shellcheck disable=SC2086
+    $CXX $CXXFLAGS "$@" -I"$SRC_DIR" -c "$WORK_DIR/sizes.cpp" -o "$WORK_DIR/sizes.o"
+
+    text=$("$SIZE" "$WORK_DIR/psg_ctrl.o" "$WORK_DIR/Psgino.o" | awk 'NR > 1 { t += $1 } END { print t }')
+    ch=$(symbol_size size_of_channel_info)
+    slot=$(symbol_size size_of_slot)
+
+    echo "|$name|$text|$ch|$slot|"
+}
+
+echo "|Configuration|Code (bytes)|\`CHANNEL_INFO\` (bytes)|\`SLOT\` (bytes)|"
+echo "|--|--|--|--|"
+measure "Default settings" "$@"
+for feature in MML_QUEUE MML_PATTERN LIVE_NOTE SEEK; do
+    measure "\`PSGINO_USE_$feature=1\`" -DPSGINO_USE_$feature=1 "$@"
+done
+measure "\`PSGINO_MML_INSTRUMENTS=8\`" -DPSGINO_MML_INSTRUMENTS=8 "$@"
+for feature in SW_ENV LFO PITCHBEND NOISE_SWEEP USER_CALLBACK FINISH_PRIMARY_LOOP; do
+    measure "\`PSGINO_USE_$feature=0\`" -DPSGINO_USE_$feature=0 "$@"
+done
+measure "All of the \`=0\` above" \
+    -DPSGINO_USE_SW_ENV=0 -DPSGINO_USE_LFO=0 -DPSGINO_USE_PITCHBEND=0 \
+    -DPSGINO_USE_NOISE_SWEEP=0 -DPSGINO_USE_USER_CALLBACK=0 \
+    -DPSGINO_USE_FINISH_PRIMARY_LOOP=0 "$@"
@@ -0,0 +1,332 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "psg_ctrl/psg_ctrl.h"
+#include "smf_to_mml.h"
+
+namespace {
+
+    struct Job {
+        std::string in_path;
+        std::string out_path;
+        std::string log;        /* what the job prints, written out in job order */
+        bool is_ok;
+    };
+
+    void usage(const char *prog) {
+
+        std::fprintf(stderr,
+            "usage: %s [-j threads] [-f proc_freq] [-c fs_clock] [-n channels] [-o out_dir] [-D] [-L] [-v] in.mid|dir ...\n"
+            "Converts Standard MIDI Files to MML, written to <in>.mml (or out_dir/<name>.mml).\n"
+            "A directory stands for the .mid and .midi files in it. The files are converted in\n"
+            "parallel on -j threads (default: all cores). -D drops the drums of MIDI channel 10\n"
+            "instead of playing them with noise, -L writes no loops, and -v checks that each MML\n"
+            "is valid and as long as the MIDI file.\n",
+            prog);
+    }
+
+    bool read_file(const std::string &path, std::string &out) {
+
+        std::ifstream ifs(path, std::ios::binary);
+        if ( !ifs ) {
+
+            return false;
+        }
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    bool has_midi_ext(const std::string &name) {
+
+        auto ends_with = [&](const char *ext) {
+
+            size_t n = std::strlen(ext);
+            if ( name.size() < n ) {
+
+                return false;
+            }
+            for ( size_t i = 0; i < n; i++ ) {
+
+                char c = name[name.size() - n + i];
+                if ( ( c >= 'A' ) && ( c <= 'Z' ) ) {
+
+                    c = c - 'A' + 'a';
+                }
+                if ( c != ext[i] ) {
+
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        return ends_with(".mid") || ends_with(".midi");
+    }
+
+    /* Adds the file, or the MIDI files of the directory, as jobs. */
+    bool add_jobs(const std::string &path, const std::string &out_dir, std::vector<Job> &jobs) {
+
+        struct stat st;
+        std::vector<std::string> files;
+
+        if ( stat(path.c_str(), &st) != 0 ) {
+
+            return false;
+        }
+
+        if ( S_ISDIR(st.st_mode) ) {
+
+            DIR *dir = opendir(path.c_str());
+            if ( dir == nullptr ) {
+
+                return false;
+            }
+            for ( struct dirent *e = readdir(dir); e != nullptr; e = readdir(dir) ) {
+
+                if ( has_midi_ext(e->d_name) ) {
+
+                    files.push_back(path + "/" + e->d_name);
+                }
+            }
+            closedir(dir);
+            std::sort(files.begin(), files.end());
+        } else {
+
+            files.push_back(path);
+        }
+
+        for ( const auto &f : files ) {
+
+            Job job;
+            size_t dot = f.rfind('.');
+            size_t slash = f.rfind('/');
+            std::string stem = f.substr(0, ( ( dot != std::string::npos ) && ( ( slash == std::string::npos ) || ( dot > slash ) ) ) ? dot : f.size());
+
+            if ( !out_dir.empty() ) {
+
+                stem = out_dir + "/" + stem.substr( ( slash == std::string::npos ) ? 0 : slash + 1 );
+            }
+            job.in_path = f;
+            job.out_path = stem + ".mml";
+            job.is_ok = false;
+            jobs.push_back(job);
+        }
+
+        return true;
+    }
+
+    void convert(Job &job, const PsginoSmf::Options &options, uint32_t s_clock, bool do_verify) {
+
+        std::string data;
+        std::string mml;
+        PsginoSmf::Stats stats;
+        char buf[256];
+        int status;
+
+        if ( !read_file(job.in_path, data) ) {
+
+            job.log = job.in_path + ": cannot read\n";
+            return;
+        }
+
+        status = PsginoSmf::Convert(reinterpret_cast<const uint8_t *>(data.data()), data.size(), options, mml, stats);
+        if ( status < 0 ) {
+
+            job.log = job.in_path + ": " + PsginoSmf::ErrorString(status) + "\n";
+            return;
+        }
+
+        if ( do_verify ) {
+
+            PsgCtrl::SONG_INFO info;
+            uint32_t max_ticks = stats.total_ticks + options.proc_freq;
+            int ret = PsgCtrl::analyze_mml(mml.c_str(), 0, s_clock, options.proc_freq, info, max_ticks);
+
+            /* analyze_mml counts the tick in which it finds every channel ended, and one more
+             * when a channel ends with a loop, whose last ']' is read after its last note. */
+            if ( ( ret < 0 ) || ( info.total_ticks < stats.total_ticks + 1 ) || ( info.total_ticks > stats.total_ticks + 2 ) ) {
+
+                std::snprintf(buf, sizeof(buf), "%s: the MML is %s (%d, %lu ticks, expected %lu)\n",
+                        job.out_path.c_str(),
+                        ( ret < 0 ) ? "invalid" : "not as long as the MIDI file",
+                        ret,
+                        static_cast<unsigned long>(info.total_ticks - 1),
+                        static_cast<unsigned long>(stats.total_ticks));
+                job.log = buf;
+                return;
+            }
+        }
+
+        std::ofstream ofs(job.out_path, std::ios::binary);
+        if ( !ofs.write(mml.data(), mml.size()) ) {
+
+            job.log = job.out_path + ": cannot write\n";
+            return;
+        }
+
+        std::snprintf(buf, sizeof(buf),
+                "%s: %lu bytes, %lu ticks, T%u L%u (%u ticks), %lu notes, %lu dropped, %lu cut, %lu loops\n",
+                job.out_path.c_str(),
+                static_cast<unsigned long>(mml.size()),
+                static_cast<unsigned long>(stats.total_ticks),
+                stats.tempo,
+                stats.note_len,
+                stats.quantum,
+                static_cast<unsigned long>(stats.num_notes),
+                static_cast<unsigned long>(stats.num_dropped),
+                static_cast<unsigned long>(stats.num_cut),
+                static_cast<unsigned long>(stats.num_loops));
+        job.log = buf;
+        job.is_ok = true;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    unsigned num_threads = 0;
+    float fs_clock = 2000000.0F;
+    bool do_verify = false;
+    std::string out_dir;
+    std::vector<std::string> paths;
+    PsginoSmf::Options options;
+
+    options.proc_freq = PsgCtrl::DEFAULT_PROC_FREQ;
+    options.num_channels = PsgCtrl::NUM_CHANNEL;
+    options.use_drums = true;
+    options.use_loops = true;
+
+    for ( int i = 1; i < argc; i++ ) {
+
+        if ( ( std::strcmp(argv[i], "-j") == 0 ) && ( i+1 < argc ) ) {
+
+            num_threads = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-f") == 0 ) && ( i+1 < argc ) ) {
+
+            options.proc_freq = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-c") == 0 ) && ( i+1 < argc ) ) {
+
+            fs_clock = std::strtof(argv[++i], nullptr);
+
+        } else if ( ( std::strcmp(argv[i], "-n") == 0 ) && ( i+1 < argc ) ) {
+
+            options.num_channels = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-o") == 0 ) && ( i+1 < argc ) ) {
+
+            out_dir = argv[++i];
+
+        } else if ( std::strcmp(argv[i], "-D") == 0 ) {
+
+            options.use_drums = false;
+
+        } else if ( std::strcmp(argv[i], "-L") == 0 ) {
+
+            options.use_loops = false;
+
+        } else if ( std::strcmp(argv[i], "-v") == 0 ) {
+
+            do_verify = true;
+
+        } else if ( argv[i][0] == '-' ) {
+
+            usage(argv[0]);
+            return 1;
+
+        } else {
+
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if ( paths.empty() || ( options.proc_freq == 0 )
+        || ( options.num_channels < 1 ) || ( options.num_channels > PsgCtrl::NUM_CHANNEL ) ) {
+
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    for ( const auto &p : paths ) {
+
+        if ( !add_jobs(p, out_dir, jobs) ) {
+
+            std::fprintf(stderr, "%s: cannot read\n", p.c_str());
+            return 1;
+        }
+    }
+
+    if ( num_threads == 0 ) {
+
+        num_threads = std::thread::hardware_concurrency();
+    }
+    if ( num_threads == 0 ) {
+
+        num_threads = 1;
+    }
+    if ( num_threads > jobs.size() ) {
+
+        num_threads = static_cast<unsigned>(jobs.size());
+    }
+
+    /* Workers pull the files from a shared cursor, as PsginoBatch::Render does. */
+    const uint32_t s_clock = static_cast<uint32_t>(fs_clock*100+0.5F);
+    std::atomic<size_t> cursor(0);
+    std::vector<std::thread> workers;
+    auto worker = [&]() {
+
+        for (;;) {
+
+            size_t i = cursor.fetch_add(1, std::memory_order_relaxed);
+            if ( i >= jobs.size() ) {
+
+                break;
+            }
+            convert(jobs[i], options, s_clock, do_verify);
+        }
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    for ( unsigned i = 1; i < num_threads; i++ ) {
+
+        workers.emplace_back(worker);
+    }
+    worker();
+    for ( auto &t : workers ) {
+
+        t.join();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    int ret = 0;
+    for ( const auto &job : jobs ) {
+
+        std::fputs(job.log.c_str(), job.is_ok ? stdout : stderr);
+        if ( !job.is_ok ) {
+
+            ret = 1;
+        }
+    }
+
+    std::fprintf(stderr, "%zu files, %.3f s\n", jobs.size(), std::chrono::duration<double>(t1 - t0).count());
+
+    return ret;
+}
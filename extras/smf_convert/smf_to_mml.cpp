@@ -0,0 +1,885 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include "smf_to_mml.h"
+
+namespace PsginoSmf {
+
+    namespace {
+
+        constexpr uint32_t DEFAULT_USEC_PER_QN  = (500000);     /* 120 bpm */
+        constexpr uint16_t MIN_MML_TEMPO        = (10);
+        constexpr uint16_t MAX_MML_TEMPO        = (1000);
+        constexpr uint8_t MAX_MML_NOTE_LEN      = (64);
+        constexpr uint8_t MAX_LOOP_COUNT        = (255);
+        constexpr uint8_t MAX_LOOP_DEPTH        = (3);
+        constexpr size_t MAX_LOOP_BODY          = (128);        /* tokens */
+        constexpr uint8_t MIN_MIDI_NOTE         = (25);         /* O1C# ; O1C is N0, a rest */
+        constexpr uint8_t MAX_MIDI_NOTE         = (119);        /* O8B */
+        constexpr uint8_t NO_SWEEP              = (0xFF);
+
+        struct Note {
+            uint32_t    start;      /* quantum units */
+            uint32_t    end;
+            uint8_t     note;
+            uint8_t     velocity;
+            uint8_t     rank;       /* order of allotment within a chord */
+        };
+
+        struct TempoChange {
+            uint32_t    tick;
+            uint32_t    usec_per_qn;
+        };
+
+        enum TokenKind : uint8_t { TOKEN_REST, TOKEN_TONE, TOKEN_NOISE };
+
+        struct Token {
+            uint32_t    units;
+            TokenKind   kind;
+            uint8_t     note;       /* MIDI note of TOKEN_TONE */
+            uint8_t     volume;
+            uint8_t     noise;      /* noise period of TOKEN_NOISE */
+            uint8_t     sweep_end;  /* end of the J sweep, or NO_SWEEP for H */
+
+            bool operator==(const Token &o) const {
+
+                return ( units == o.units ) && ( kind == o.kind ) && ( note == o.note )
+                    && ( volume == o.volume ) && ( noise == o.noise ) && ( sweep_end == o.sweep_end );
+            }
+        };
+
+        struct Node {
+            size_t              token;      /* index in the channel, when body is empty */
+            uint8_t             count;
+            std::vector<Node>   body;
+        };
+
+        /* A note length of the MML and the units it lasts. */
+        struct Piece {
+            uint32_t    units;
+            uint8_t     len;
+            uint8_t     dots;
+        };
+
+        class Reader {
+        public:
+            Reader(const uint8_t *p, const uint8_t *p_end) : p(p), p_end(p_end), is_ok(true) {}
+
+            uint8_t u8() {
+
+                if ( p >= p_end ) {
+
+                    is_ok = false;
+                    return 0;
+                }
+                return *p++;
+            }
+
+            uint32_t be(uint8_t bytes) {
+
+                uint32_t v = 0;
+                while ( bytes-- > 0 ) {
+
+                    v = (v << 8) | u8();
+                }
+                return v;
+            }
+
+            uint32_t vlq() {
+
+                uint32_t v = 0;
+                for ( uint8_t i = 0; i < 4; i++ ) {
+
+                    uint8_t b = u8();
+                    v = (v << 7) | (b & 0x7F);
+                    if ( ( b & 0x80 ) == 0 ) {
+
+                        break;
+                    }
+                }
+                return v;
+            }
+
+            void skip(uint32_t n) {
+
+                if ( static_cast<size_t>(p_end - p) < n ) {
+
+                    is_ok = false;
+                    p = p_end;
+                } else {
+
+                    p += n;
+                }
+            }
+
+            const uint8_t *p;
+            const uint8_t *p_end;
+            bool is_ok;
+        };
+
+        struct RawNote {
+            uint32_t    start_tick;
+            uint32_t    end_tick;
+            uint8_t     ch;
+            uint8_t     note;
+            uint8_t     velocity;
+        };
+
+        /* Reads the notes and tempo changes of one MTrk chunk. */
+        bool read_track(Reader &r, std::vector<RawNote> &notes, std::vector<TempoChange> &tempos) {
+
+            std::deque<size_t> open[16][128];
+            uint32_t tick = 0;
+            uint8_t status = 0;
+
+            while ( r.is_ok && ( r.p < r.p_end ) ) {
+
+                uint8_t b;
+                uint8_t data1;
+                uint8_t data2 = 0;
+
+                tick += r.vlq();
+                b = r.u8();
+
+                if ( b == 0xFF ) {
+
+                    uint8_t type = r.u8();
+                    uint32_t len = r.vlq();
+
+                    if ( ( type == 0x51 ) && ( len == 3 ) ) {
+
+                        tempos.push_back(TempoChange{ tick, r.be(3) });
+                    } else {
+
+                        r.skip(len);
+                    }
+                    if ( type == 0x2F ) {
+
+                        break;
+                    }
+                    continue;
+                }
+
+                if ( ( b == 0xF0 ) || ( b == 0xF7 ) ) {
+
+                    r.skip(r.vlq());
+                    status = 0;
+                    continue;
+                }
+
+                if ( b & 0x80 ) {
+
+                    status = b;
+                    data1 = r.u8();
+                } else {
+
+                    if ( status == 0 ) {
+
+                        return false;
+                    }
+                    data1 = b;
+                }
+
+                if ( ( ( status & 0xF0 ) != 0xC0 ) && ( ( status & 0xF0 ) != 0xD0 ) ) {
+
+                    data2 = r.u8();
+                }
+
+                uint8_t ch = status & 0x0F;
+                uint8_t note = data1 & 0x7F;
+
+                if ( ( ( status & 0xF0 ) == 0x90 ) && ( data2 != 0 ) ) {
+
+                    open[ch][note].push_back(notes.size());
+                    notes.push_back(RawNote{ tick, tick, ch, note, data2 });
+
+                } else if ( ( ( status & 0xF0 ) == 0x80 ) || ( ( status & 0xF0 ) == 0x90 ) ) {
+
+                    /* The first note on of the key ends first. */
+                    if ( !open[ch][note].empty() ) {
+
+                        notes[open[ch][note].front()].end_tick = tick;
+                        open[ch][note].pop_front();
+                    }
+                }
+            }
+
+            /* Notes still on at the end of the track end there. */
+            for ( auto &per_ch : open ) {
+
+                for ( auto &per_note : per_ch ) {
+
+                    for ( size_t i : per_note ) {
+
+                        notes[i].end_tick = tick;
+                    }
+                }
+            }
+
+            return r.is_ok;
+        }
+
+        /* Converts ticks of the file to quantum units with the tempo map. */
+        class TimeMap {
+        public:
+            TimeMap(std::vector<TempoChange> &tempos, uint16_t division, uint16_t proc_freq, uint8_t quantum)
+                : division(division), proc_freq(proc_freq), quantum(quantum) {
+
+                std::stable_sort(tempos.begin(), tempos.end(),
+                        [](const TempoChange &a, const TempoChange &b) { return a.tick < b.tick; });
+
+                /* Time at each change in usec*division, exact. */
+                uint64_t time = 0;
+                uint32_t tick = 0;
+                uint32_t usec = DEFAULT_USEC_PER_QN;
+                for ( const auto &t : tempos ) {
+
+                    time += static_cast<uint64_t>(t.tick - tick) * usec;
+                    tick = t.tick;
+                    usec = t.usec_per_qn;
+                    points.push_back(Point{ tick, usec, time });
+                }
+                if ( points.empty() || ( points[0].tick != 0 ) ) {
+
+                    points.insert(points.begin(), Point{ 0, DEFAULT_USEC_PER_QN, 0 });
+                }
+            }
+
+            uint32_t units(uint32_t tick) const {
+
+                size_t i = std::upper_bound(points.begin(), points.end(), tick,
+                        [](uint32_t t, const Point &p) { return t < p.tick; }) - points.begin() - 1;
+                uint64_t time = points[i].time + static_cast<uint64_t>(tick - points[i].tick) * points[i].usec_per_qn;
+                uint64_t den = static_cast<uint64_t>(division) * 1000000 * quantum;
+
+                return static_cast<uint32_t>((time * proc_freq + den / 2) / den);
+            }
+
+        private:
+            struct Point {
+                uint32_t    tick;
+                uint32_t    usec_per_qn;
+                uint64_t    time;
+            };
+
+            std::vector<Point> points;
+            uint16_t division;
+            uint16_t proc_freq;
+            uint8_t quantum;
+        };
+
+        /* Finds the MML tempo and note length that last a whole number of ticks, the fewest possible. */
+        bool choose_timing(uint16_t proc_freq, Stats &stats) {
+
+            uint32_t whole = 240UL * proc_freq;     /* ticks of a whole note at 1 bpm */
+
+            for ( uint32_t quantum = 1; quantum <= 255; quantum++ ) {
+
+                for ( uint32_t len = MAX_MML_NOTE_LEN; len >= 1; len-- ) {
+
+                    if ( ( whole % (len * quantum) ) == 0 ) {
+
+                        uint32_t tempo = whole / (len * quantum);
+                        if ( ( tempo >= MIN_MML_TEMPO ) && ( tempo <= MAX_MML_TEMPO ) ) {
+
+                            stats.tempo = static_cast<uint16_t>(tempo);
+                            stats.note_len = static_cast<uint8_t>(len);
+                            stats.quantum = static_cast<uint8_t>(quantum);
+                            return true;
+                        }
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        /* Every length with dots that lasts a whole number of units, longest first. */
+        std::vector<Piece> make_pieces(uint8_t note_len) {
+
+            std::vector<Piece> pieces;
+
+            for ( uint8_t len = 1; len <= note_len; len++ ) {
+
+                if ( ( note_len % len ) != 0 ) {
+
+                    continue;
+                }
+                uint32_t base = note_len / len;
+                uint32_t units = base;
+                for ( uint8_t dots = 0; dots <= 3; dots++ ) {
+
+                    if ( ( base % (1U << dots) ) != 0 ) {
+
+                        break;
+                    }
+                    if ( dots > 0 ) {
+
+                        units += base >> dots;
+                    }
+                    pieces.push_back(Piece{ units, len, dots });
+                }
+            }
+
+            std::stable_sort(pieces.begin(), pieces.end(),
+                    [](const Piece &a, const Piece &b) { return a.units > b.units; });
+
+            return pieces;
+        }
+
+        void drum_sound(uint8_t note, uint8_t &noise, uint8_t &sweep_end, uint8_t &priority) {
+
+            sweep_end = NO_SWEEP;
+
+            switch ( note ) {
+            case 35: case 36:                       /* bass drum */
+                noise = 12; sweep_end = 31; priority = 0;
+                break;
+            case 38: case 40:                       /* snare */
+                noise = 8; priority = 1;
+                break;
+            case 37: case 39:                       /* side stick, clap */
+                noise = 5; priority = 2;
+                break;
+            case 41: case 43: case 45: case 47: case 48: case 50:   /* toms, low to high */
+                noise = static_cast<uint8_t>(26 - (note - 41));
+                priority = 3;
+                break;
+            case 42: case 44:                       /* closed and pedal hi-hat */
+                noise = 1; priority = 5;
+                break;
+            case 46:                                /* open hi-hat */
+                noise = 2; priority = 4;
+                break;
+            case 49: case 51: case 52: case 53: case 55: case 57: case 59:  /* cymbals */
+                noise = 3; priority = 4;
+                break;
+            default:
+                noise = 10; priority = 6;
+                break;
+            }
+        }
+
+        uint8_t to_volume(uint8_t velocity) {
+
+            return static_cast<uint8_t>((velocity * 15 + 126) / 127);
+        }
+
+        uint8_t to_tone_range(uint8_t note) {
+
+            while ( note < MIN_MIDI_NOTE ) {
+
+                note += 12;
+            }
+            while ( note > MAX_MIDI_NOTE ) {
+
+                note -= 12;
+            }
+            return note;
+        }
+
+        /* Allots the notes to `num` channels; they come sorted by start and rank. */
+        void allot_tones(const std::vector<Note> &notes, uint8_t num, std::vector<std::vector<Note>> &channels, Stats &stats) {
+
+            for ( const auto &n : notes ) {
+
+                int free_ch = -1;
+                int steal_ch = -1;
+
+                for ( uint8_t c = 0; c < num; c++ ) {
+
+                    if ( channels[c].empty() || ( channels[c].back().end <= n.start ) ) {
+
+                        if ( free_ch < 0 ) {
+
+                            free_ch = c;
+                        }
+                    } else if ( channels[c].back().start < n.start ) {
+
+                        if ( ( steal_ch < 0 ) || ( channels[c].back().start < channels[steal_ch].back().start ) ) {
+
+                            steal_ch = c;
+                        }
+                    }
+                }
+
+                if ( free_ch >= 0 ) {
+
+                    channels[free_ch].push_back(n);
+                } else if ( steal_ch >= 0 ) {
+
+                    channels[steal_ch].back().end = n.start;
+                    channels[steal_ch].push_back(n);
+                    stats.num_cut++;
+                } else {
+
+                    stats.num_dropped++;
+                }
+            }
+        }
+
+        std::vector<Token> make_tokens(const std::vector<Note> &notes, bool is_drum) {
+
+            std::vector<Token> tokens;
+            uint32_t time = 0;
+
+            for ( const auto &n : notes ) {
+
+                if ( n.start > time ) {
+
+                    tokens.push_back(Token{ n.start - time, TOKEN_REST, 0, 0, 0, NO_SWEEP });
+                }
+
+                Token t = Token{ n.end - n.start, TOKEN_TONE, n.note, to_volume(n.velocity), 0, NO_SWEEP };
+                if ( is_drum ) {
+
+                    uint8_t priority;
+                    t.kind = TOKEN_NOISE;
+                    t.note = 0;
+                    drum_sound(n.note, t.noise, t.sweep_end, priority);
+                }
+                tokens.push_back(t);
+                time = n.end;
+            }
+
+            return tokens;
+        }
+
+        class Writer {
+        public:
+            Writer(const std::vector<Piece> &pieces) : pieces(pieces) {
+
+                forget();
+            }
+
+            /* The next token writes its octave, volume and noise period. */
+            void forget() {
+
+                octave = 0;
+                volume = 0xFF;
+                noise = 0xFF;
+                length = 0;
+            }
+
+            void token(const Token &t, std::string &out) {
+
+                static const char *const names[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+                uint32_t rest = t.units;
+
+                if ( t.kind != TOKEN_REST ) {
+
+                    if ( t.volume != volume ) {
+
+                        volume = t.volume;
+                        out += "V" + std::to_string(volume);
+                    }
+                }
+
+                switch ( t.kind ) {
+
+                case TOKEN_REST:
+                    while ( rest > 0 ) {
+
+                        const Piece &p = fit(rest);
+                        out += "R" + text(p);
+                        rest -= p.units;
+                    }
+                    break;
+
+                case TOKEN_TONE: {
+
+                    uint8_t o = static_cast<uint8_t>((t.note - 24) / 12 + 1);
+                    if ( o != octave ) {
+
+                        if ( octave == 0 ) {
+
+                            out += "O" + std::to_string(o);
+                        } else {
+
+                            out += ( o == octave + 1 ) ? ">" : ( o + 1 == octave ) ? "<" : ("O" + std::to_string(o));
+                        }
+                        octave = o;
+                    }
+                    bool is_first = true;
+                    while ( rest > 0 ) {
+
+                        const Piece &p = fit(rest);
+                        if ( !is_first ) {
+
+                            out += "&";
+                        }
+                        out += names[t.note % 12] + text(p);
+                        rest -= p.units;
+                        is_first = false;
+                    }
+                    break;
+                }
+
+                case TOKEN_NOISE: {
+
+                    /* A hit does not tie; the rest of its time is silent. */
+                    const Piece &p = fit(rest);
+                    if ( t.sweep_end != NO_SWEEP ) {
+
+                        std::string len = std::to_string(p.len);
+                        if ( p.len != length ) {
+
+                            out += "L" + len;
+                            length = p.len;
+                        }
+                        out += "J" + std::to_string(t.noise) + "~" + std::to_string(t.sweep_end) + std::string(p.dots, '.');
+                    } else {
+
+                        if ( t.noise != noise ) {
+
+                            out += "I" + std::to_string(t.noise);
+                            noise = t.noise;
+                        }
+                        out += "H" + text(p);
+                    }
+                    rest -= p.units;
+                    while ( rest > 0 ) {
+
+                        const Piece &q = fit(rest);
+                        out += "R" + text(q);
+                        rest -= q.units;
+                    }
+                    break;
+                }
+                }
+            }
+
+            void nodes(const std::vector<Node> &list, const std::vector<Token> &tokens, std::string &out) {
+
+                for ( const auto &n : list ) {
+
+                    if ( n.body.empty() ) {
+
+                        this->token(tokens[n.token], out);
+                    } else {
+
+                        /* Each pass must start from the same state, whatever the last one left. */
+                        out += "[" + std::to_string(n.count);
+                        forget();
+                        nodes(n.body, tokens, out);
+                        out += "]";
+                    }
+                }
+            }
+
+        private:
+            const Piece &fit(uint32_t units) const {
+
+                for ( const auto &p : pieces ) {
+
+                    if ( p.units <= units ) {
+
+                        return p;
+                    }
+                }
+                return pieces.back();
+            }
+
+            static std::string text(const Piece &p) {
+
+                return std::to_string(p.len) + std::string(p.dots, '.');
+            }
+
+            const std::vector<Piece> &pieces;
+            uint8_t octave;
+            uint8_t volume;
+            uint8_t noise;
+            uint8_t length;
+        };
+
+        /* Finds back-to-back repeats of a run of tokens and turns the one saving the most text into a loop. */
+        std::vector<Node> find_loops(
+                const std::vector<Token> &tokens,
+                const std::vector<size_t> &cost,    /* prefix sums of the text size of the tokens */
+                size_t begin,
+                size_t end,
+                uint8_t depth,
+                Stats &stats
+        ) {
+
+            std::vector<Node> out;
+            size_t i = begin;
+
+            while ( i < end ) {
+
+                size_t best_len = 0;
+                size_t best_count = 1;
+                size_t best_saving = 0;
+
+                for ( size_t len = 1; ( len <= MAX_LOOP_BODY ) && ( i + 2*len <= end ); len++ ) {
+
+                    size_t count = 1;
+                    while ( ( count < MAX_LOOP_COUNT ) && ( i + (count+1)*len <= end )
+                            && std::equal(&tokens[i], &tokens[i] + len, &tokens[i + count*len]) ) {
+
+                        count++;
+                    }
+
+                    /* "[n" and "]", and the state written again at the start of the body. */
+                    size_t body = cost[i+len] - cost[i];
+                    size_t saving = (count - 1) * body;
+                    size_t overhead = 8;
+                    if ( ( count > 1 ) && ( saving > overhead ) && ( saving - overhead > best_saving ) ) {
+
+                        best_len = len;
+                        best_count = count;
+                        best_saving = saving - overhead;
+                    }
+                }
+
+                if ( best_count > 1 ) {
+
+                    Node loop;
+                    loop.token = 0;
+                    loop.count = static_cast<uint8_t>(best_count);
+                    if ( depth + 1 < MAX_LOOP_DEPTH ) {
+
+                        loop.body = find_loops(tokens, cost, i, i + best_len, depth + 1, stats);
+                    } else {
+
+                        for ( size_t k = i; k < i + best_len; k++ ) {
+
+                            loop.body.push_back(Node{ k, 0, {} });
+                        }
+                    }
+                    out.push_back(loop);
+                    stats.num_loops++;
+                    i += best_len * best_count;
+                } else {
+
+                    out.push_back(Node{ i, 0, {} });
+                    i++;
+                }
+            }
+
+            return out;
+        }
+
+        std::string write_channel(const std::vector<Token> &tokens, const std::vector<Piece> &pieces, bool use_loops, Stats &stats) {
+
+            Writer writer(pieces);
+            std::vector<Node> list;
+            std::string out;
+
+            if ( use_loops ) {
+
+                std::vector<size_t> cost(tokens.size() + 1, 0);
+                for ( size_t i = 0; i < tokens.size(); i++ ) {
+
+                    Writer w(pieces);
+                    std::string s;
+                    w.token(tokens[i], s);
+                    cost[i+1] = cost[i] + s.size();
+                }
+                list = find_loops(tokens, cost, 0, tokens.size(), 0, stats);
+            } else {
+
+                for ( size_t i = 0; i < tokens.size(); i++ ) {
+
+                    list.push_back(Node{ i, 0, {} });
+                }
+            }
+
+            writer.nodes(list, tokens, out);
+            return out;
+        }
+    }
+
+    int Convert(const uint8_t *data, size_t size, const Options &options, std::string &mml, Stats &stats) {
+
+        Reader r(data, data + size);
+        std::vector<RawNote> raw;
+        std::vector<TempoChange> tempos;
+        uint32_t format;
+        uint32_t num_tracks;
+        uint32_t division;
+
+        stats = Stats{};
+        mml.clear();
+
+        if ( ( r.be(4) != 0x4D546864 ) || ( r.be(4) != 6 ) ) {    /* "MThd" */
+
+            return r.is_ok ? ERR_FORMAT : ERR_TRUNCATED;
+        }
+        format = r.be(2);
+        num_tracks = r.be(2);
+        division = r.be(2);
+        if ( !r.is_ok ) {
+
+            return ERR_TRUNCATED;
+        }
+        if ( format > 1 ) {
+
+            return ERR_FORMAT;
+        }
+        if ( ( division & 0x8000 ) || ( division == 0 ) ) {
+
+            return ERR_DIVISION;
+        }
+        if ( !choose_timing(options.proc_freq, stats) ) {
+
+            return ERR_TIMING;
+        }
+
+        for ( uint32_t t = 0; ( t < num_tracks ) && ( r.p < r.p_end ); t++ ) {
+
+            uint32_t id = r.be(4);
+            uint32_t len = r.be(4);
+
+            if ( !r.is_ok || ( static_cast<size_t>(r.p_end - r.p) < len ) ) {
+
+                return ERR_TRUNCATED;
+            }
+            if ( id == 0x4D54726B ) {   /* "MTrk" */
+
+                Reader tr(r.p, r.p + len);
+                if ( !read_track(tr, raw, tempos) ) {
+
+                    return ERR_TRUNCATED;
+                }
+            }
+            r.skip(len);
+        }
+
+        /* Quantize, and split the drums from the tones. */
+        TimeMap time_map(tempos, static_cast<uint16_t>(division), options.proc_freq, stats.quantum);
+        std::vector<Note> tones;
+        std::vector<Note> drums;
+        uint8_t num_tone_channels = options.num_channels;
+        uint32_t song_end = 0;
+
+        for ( const auto &n : raw ) {
+
+            Note q;
+            q.start = time_map.units(n.start_tick);
+            q.end = time_map.units(n.end_tick);
+            if ( q.end <= q.start ) {
+
+                q.end = q.start + 1;
+            }
+            q.velocity = n.velocity;
+            q.rank = 0;
+
+            stats.num_notes++;
+            if ( n.ch == DRUM_CHANNEL ) {
+
+                if ( !options.use_drums || ( options.num_channels < 2 ) ) {
+
+                    stats.num_dropped++;
+                    continue;
+                }
+                q.note = n.note;
+                drums.push_back(q);
+            } else {
+
+                q.note = to_tone_range(n.note);
+                tones.push_back(q);
+            }
+        }
+
+        if ( !drums.empty() ) {
+
+            num_tone_channels--;
+        }
+
+        /* In a chord, the highest note first, then the lowest one, then downwards. */
+        std::stable_sort(tones.begin(), tones.end(), [](const Note &a, const Note &b) {
+            return ( a.start != b.start ) ? ( a.start < b.start ) : ( a.note > b.note );
+        });
+        for ( size_t i = 0; i < tones.size(); ) {
+
+            size_t j = i;
+            while ( ( j < tones.size() ) && ( tones[j].start == tones[i].start ) ) {
+
+                j++;
+            }
+            for ( size_t k = i; k < j; k++ ) {
+
+                tones[k].rank = static_cast<uint8_t>(std::min<size_t>(( k == j-1 ) ? 1 : ( k == i ) ? 0 : (k - i + 1), 255));
+            }
+            i = j;
+        }
+        std::stable_sort(tones.begin(), tones.end(), [](const Note &a, const Note &b) {
+            return ( a.start != b.start ) ? ( a.start < b.start ) : ( a.rank < b.rank );
+        });
+
+        std::vector<std::vector<Note>> channels(options.num_channels);
+        allot_tones(tones, num_tone_channels, channels, stats);
+
+        /* Drums: one hit at a time, the one that matters most on a tie; a hit ends at the next. */
+        if ( !drums.empty() ) {
+
+            std::vector<Note> &ch = channels[num_tone_channels];
+            std::stable_sort(drums.begin(), drums.end(), [](const Note &a, const Note &b) {
+                uint8_t na, nb, sa, sb, pa, pb;
+                drum_sound(a.note, na, sa, pa);
+                drum_sound(b.note, nb, sb, pb);
+                return ( a.start != b.start ) ? ( a.start < b.start ) : ( pa < pb );
+            });
+            for ( const auto &d : drums ) {
+
+                if ( !ch.empty() && ( ch.back().start == d.start ) ) {
+
+                    stats.num_dropped++;
+                    continue;
+                }
+                if ( !ch.empty() && ( ch.back().end > d.start ) ) {
+
+                    ch.back().end = d.start;
+                }
+                ch.push_back(d);
+            }
+        }
+
+        std::vector<Piece> pieces = make_pieces(stats.note_len);
+        bool is_first = true;
+        for ( uint8_t c = 0; c < options.num_channels; c++ ) {
+
+            if ( channels[c].empty() ) {
+
+                continue;
+            }
+            song_end = std::max(song_end, channels[c].back().end);
+            if ( !is_first ) {
+
+                mml += ",\n";
+            }
+            is_first = false;
+            mml += "T" + std::to_string(stats.tempo);
+            mml += write_channel(make_tokens(channels[c], !drums.empty() && ( c == num_tone_channels )), pieces, options.use_loops, stats);
+        }
+
+        stats.total_ticks = song_end * stats.quantum;
+
+        return 0;
+    }
+
+    const char *ErrorString(int status) {
+
+        switch ( status ) {
+        case 0:
+            return "no error";
+        case ERR_FORMAT:
+            return "not a Standard MIDI File of format 0 or 1";
+        case ERR_DIVISION:
+            return "SMPTE time division is not supported";
+        case ERR_TRUNCATED:
+            return "truncated or malformed file";
+        case ERR_TIMING:
+            return "no MML tempo gives whole ticks at this proc_freq";
+        default:
+            return "unknown error";
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef PSGINO_SMF_TO_MML_H
+#define PSGINO_SMF_TO_MML_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace PsginoSmf {
+
+    constexpr int ERR_FORMAT    = (-1);     ///< Not a Standard MIDI File, or format 2.
+    constexpr int ERR_DIVISION  = (-2);     ///< SMPTE time division, which is not supported.
+    constexpr int ERR_TRUNCATED = (-3);     ///< A chunk or an event runs past the end of the file.
+    constexpr int ERR_TIMING    = (-4);     ///< No MML tempo gives whole ticks at this `proc_freq`.
+
+    constexpr uint8_t DRUM_CHANNEL = (9);   ///< MIDI channel 10, the General MIDI percussion.
+
+    /**
+     * @brief Settings of a conversion.
+     */
+    struct Options {
+        uint16_t    proc_freq;      ///< Processing frequency in Hz; the notes are quantized to its ticks.
+        uint8_t     num_channels;   ///< PSG channels to use (1 to 3).
+        bool        use_drums;      ///< Plays MIDI channel 10 with noise on the last channel; false drops it.
+        bool        use_loops;      ///< Writes repeated sections as loops.
+    };
+
+    /**
+     * @brief Figures of a conversion.
+     */
+    struct Stats {
+        uint32_t    num_notes;      ///< Notes read from the file.
+        uint32_t    num_dropped;    ///< Notes dropped because every channel was busy.
+        uint32_t    num_cut;        ///< Notes cut short by a later note on their channel.
+        uint32_t    num_loops;      ///< Loops written for repeated sections.
+        uint32_t    total_ticks;    ///< Length of the song in `proc_freq` ticks.
+        uint16_t    tempo;          ///< Tempo (`T`) of the MML.
+        uint8_t     note_len;       ///< Note length whose duration is `quantum` ticks at that tempo.
+        uint8_t     quantum;        ///< Ticks of the shortest note; note times are multiples of it.
+    };
+
+    /**
+     * @brief Converts a Standard MIDI File (format 0 or 1) to MML.
+     *
+     * The tempo map of the file is applied and every note is quantized to `quantum` ticks of
+     * `proc_freq`. The MML then plays at one fixed tempo, chosen so that its shortest note is
+     * exactly `quantum` ticks, and writes each note as tied lengths that add up to its time.
+     * The notes are allotted to the channels (the highest and the lowest of a chord first); a
+     * note that finds every channel busy cuts the one that started first, or is dropped if they
+     * all started with it. The velocity gives the volume (`V`). Drum notes become `H` with a
+     * noise period by instrument, and a `J` sweep for the bass drum. Repeated runs of notes
+     * become loops (`[n ...]`), nested up to three levels.
+     *
+     * Program changes, controllers and pitch bends are ignored.
+     *
+     * @param data The file.
+     * @param size Size of the file in bytes.
+     * @param options Settings of the conversion.
+     * @param mml Receives the MML.
+     * @param stats Receives the figures of the conversion.
+     * @return 0 on success, or one of the `ERR_*` values.
+     */
+    int Convert(const uint8_t *data, size_t size, const Options &options, std::string &mml, Stats &stats);
+
+    /**
+     * @brief Returns a description of an `ERR_*` value.
+     */
+    const char *ErrorString(int status);
+}
+
+#endif/*PSGINO_SMF_TO_MML_H*/
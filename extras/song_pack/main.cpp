@@ -0,0 +1,306 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Psgino.h"
+
+/*
+ * Packs an MML file into a song image for Psgino::SetSong / PsgCtrl::set_song:
+ *
+ *   SONG_HEADER | MML text (NUL-terminated) | SEEK_POINT table
+ *
+ * The image is written in the byte order and with the SEEK_POINT layout of this
+ * build. The seek table is a raw copy of the SEEK_POINT array, so it is only valid
+ * for a target with the same ABI (padding, bitfield order, byte order, pointer
+ * size) and settings; set_song drops it when STATE_CONFIG or sizeof(SEEK_POINT)
+ * differs, but cannot detect every other difference.
+ */
+
+namespace {
+
+    const uint32_t DEFAULT_MAX_TICKS = 100UL*60*60;
+
+    void usage(const char *prog) {
+
+        std::fprintf(stderr,
+            "usage: %s [-c fs_clock] [-f proc_freq] [-m mode] [-i interval_ms] [-t max_ticks] [-v] in.mml out.psgs\n"
+            "Writes a song image with the channel offsets, the loop points and a seek table every\n"
+            "interval_ms (default 1000, 0 for none). -v maps the image back with mmap and checks\n"
+            "that it plays the same as the MML.\n",
+            prog);
+    }
+
+    bool read_file(const char *path, std::string &out) {
+
+        std::ifstream ifs(path, std::ios::binary);
+        if ( !ifs ) {
+
+            return false;
+        }
+        std::ostringstream ss;
+        ss << ifs.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    uint32_t align_up(uint32_t ofs, uint32_t align) {
+
+        return (ofs + align - 1) / align * align;
+    }
+
+    std::string reg_log;
+    uint32_t reg_tick;
+
+    void write_log(uint8_t addr, uint8_t data) {
+
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%lu %u %u\n", static_cast<unsigned long>(reg_tick), addr, data);
+        reg_log += buf;
+    }
+
+    /* Plays the MML and the mapped image side by side and compares the register writes. */
+    bool verify(const char *path, const std::string &text, uint16_t mode, float fs_clock, uint16_t proc_freq, uint32_t ticks) {
+
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        void *p_map;
+        bool same = false;
+
+        if ( ( fd < 0 ) || ( fstat(fd, &st) != 0 ) ) {
+
+            return false;
+        }
+        p_map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if ( p_map == MAP_FAILED ) {
+
+            return false;
+        }
+
+        Psgino a(write_log, fs_clock, proc_freq);
+        Psgino b(write_log, fs_clock, proc_freq);
+        std::string log_a;
+
+        a.SetMML(text.c_str(), mode);
+        a.Play();
+        reg_log.clear();
+        for ( reg_tick = 0; reg_tick < ticks; reg_tick++ ) {
+
+            a.Proc();
+        }
+        log_a.swap(reg_log);
+
+        if ( b.SetSong(p_map, static_cast<uint32_t>(st.st_size)) == 0 ) {
+
+            b.Play();
+            reg_log.clear();
+            for ( reg_tick = 0; reg_tick < ticks; reg_tick++ ) {
+
+                b.Proc();
+            }
+            same = ( log_a == reg_log );
+        }
+
+        munmap(p_map, st.st_size);
+
+        return same;
+    }
+}
+
+int main(int argc, char **argv) {
+
+    float fs_clock = 2000000.0F;
+    uint16_t proc_freq = PsgCtrl::DEFAULT_PROC_FREQ;
+    uint16_t mode = 0;
+    uint32_t interval_ms = 1000;
+    uint32_t max_ticks = DEFAULT_MAX_TICKS;
+    bool do_verify = false;
+    std::vector<const char *> paths;
+
+    for ( int i = 1; i < argc; i++ ) {
+
+        if ( ( std::strcmp(argv[i], "-c") == 0 ) && ( i+1 < argc ) ) {
+
+            fs_clock = std::strtof(argv[++i], nullptr);
+
+        } else if ( ( std::strcmp(argv[i], "-f") == 0 ) && ( i+1 < argc ) ) {
+
+            proc_freq = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-m") == 0 ) && ( i+1 < argc ) ) {
+
+            mode = std::strtoul(argv[++i], nullptr, 0);
+
+        } else if ( ( std::strcmp(argv[i], "-i") == 0 ) && ( i+1 < argc ) ) {
+
+            interval_ms = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( ( std::strcmp(argv[i], "-t") == 0 ) && ( i+1 < argc ) ) {
+
+            max_ticks = std::strtoul(argv[++i], nullptr, 10);
+
+        } else if ( std::strcmp(argv[i], "-v") == 0 ) {
+
+            do_verify = true;
+
+        } else if ( argv[i][0] == '-' ) {
+
+            usage(argv[0]);
+            return 1;
+
+        } else {
+
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if ( paths.size() != 2 ) {
+
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string text;
+    if ( !read_file(paths[0], text) ) {
+
+        std::fprintf(stderr, "%s: cannot read\n", paths[0]);
+        return 1;
+    }
+
+    const uint32_t s_clock = static_cast<uint32_t>(fs_clock*100+0.5F);
+    PsgCtrl::SONG_INFO info;
+    int status = PsgCtrl::analyze_mml(text.c_str(), mode, s_clock, proc_freq, info, max_ticks);
+    if ( status < 0 ) {
+
+        std::fprintf(stderr, "%s: invalid MML (%d)\n", paths[0], status);
+        return 1;
+    }
+
+    /* Split the MML the way set_mml does, on a scratch slot. */
+    PsgCtrl::SLOT slot;
+    PsgCtrl::CHANNEL_INFO ch[PsgCtrl::NUM_CHANNEL];
+    PsgCtrl::init_slot(slot, s_clock, proc_freq, false, &ch[0], &ch[1], &ch[2]);
+    PsgCtrl::set_mml(slot, text.c_str(), mode);
+
+    /* Seek table, at 100% speed as build_seek_index takes it. */
+    std::vector<PsgCtrl::SEEK_POINT> points;
+    uint32_t interval = (interval_ms / 1000) * proc_freq + ((interval_ms % 1000) * proc_freq + 500) / 1000;
+    if ( ( interval_ms != 0 ) && ( interval != 0 ) ) {
+
+        PsgCtrl::SEEK_INDEX index;
+        uint32_t num_points;
+
+        interval = ( interval < 0xFFFF ) ? interval : 0xFFFF;
+        num_points = info.total_ticks / interval + 1;
+        num_points = ( num_points < 0xFFFF ) ? num_points : 0xFFFF;
+        points.resize(num_points);
+        PsgCtrl::build_seek_index(
+                slot, index, points.data(), static_cast<uint16_t>(num_points),
+                static_cast<uint16_t>(interval), info.total_ticks
+        );
+        points.resize(index.num_points);
+
+        /* The points are used with the MML of the image, wherever it is mapped. */
+        for ( size_t i = 0; i < points.size(); i++ ) {
+
+            for ( uint8_t c = 0; c < PsgCtrl::NUM_CHANNEL; c++ ) {
+
+                points[i].ch_info[c].mml.p_mml_head = nullptr;
+            }
+        }
+    }
+
+    PsgCtrl::SONG_HEADER header = {};
+    header.magic = PsgCtrl::SONG_MAGIC;
+    header.version = PsgCtrl::SONG_VERSION;
+    header.num_channels = slot.gl_info.sys_status.NUM_CH_USED;
+    header.mml_version = slot.gl_info.mml_version;
+    header.rh_len = slot.gl_info.sys_status.RH_LEN;
+    header.s_clock = s_clock;
+    header.proc_freq = proc_freq;
+    header.seek_interval = points.empty() ? 0 : static_cast<uint16_t>(interval);
+    header.total_ticks = info.total_ticks;
+    header.ofs_mml = sizeof(PsgCtrl::SONG_HEADER);
+    for ( uint8_t i = 0; i < header.num_channels; i++ ) {
+
+        header.ofs_channel[i] = header.ofs_mml + static_cast<uint32_t>(ch[i].mml.p_mml_head - text.c_str());
+        header.len_channel[i] = ch[i].mml.mml_len;
+        header.loop_start_tick[i] = info.loop_start_tick[i];
+        header.loop_ticks[i] = info.loop_ticks[i];
+        header.ofs_loop[i] = ( info.loop_start_tick[i] != PsgCtrl::NO_LOOP ) ? (header.ofs_channel[i] + info.loop_ofs[i]) : 0;
+    }
+    for ( uint8_t i = header.num_channels; i < PsgCtrl::NUM_CHANNEL; i++ ) {
+
+        header.loop_start_tick[i] = PsgCtrl::NO_LOOP;
+    }
+    header.ofs_seek = points.empty() ? 0 : align_up(header.ofs_mml + text.size() + 1, alignof(PsgCtrl::SEEK_POINT));
+    header.num_seek_points = static_cast<uint16_t>(points.size());
+    header.seek_config = PsgCtrl::STATE_CONFIG;
+    header.seek_point_size = sizeof(PsgCtrl::SEEK_POINT);
+    header.image_size = points.empty()
+                      ? (header.ofs_mml + text.size() + 1)
+                      : (header.ofs_seek + points.size() * sizeof(PsgCtrl::SEEK_POINT));
+
+    std::vector<char> image(header.image_size, 0);
+    std::memcpy(&image[0], &header, sizeof(header));
+    std::memcpy(&image[header.ofs_mml], text.c_str(), text.size() + 1);
+    if ( !points.empty() ) {
+
+        std::memcpy(&image[header.ofs_seek], points.data(), points.size() * sizeof(PsgCtrl::SEEK_POINT));
+    }
+
+    std::ofstream ofs(paths[1], std::ios::binary);
+    if ( !ofs.write(image.data(), image.size()) ) {
+
+        std::fprintf(stderr, "%s: cannot write\n", paths[1]);
+        return 1;
+    }
+    ofs.close();
+
+    if ( !points.empty() ) {
+
+        const uint16_t one = 1;
+
+        std::fprintf(stderr,
+            "%s: warning: the seek table is a raw copy of PsgCtrl::SEEK_POINT as laid out by this build\n"
+            "(%lu bytes per point, %s-endian, %lu-byte pointers, STATE_CONFIG 0x%02X). It is only valid\n"
+            "on a target with the same ABI and settings; build psgino_pack for the target or use -i 0.\n",
+            paths[1],
+            static_cast<unsigned long>(sizeof(PsgCtrl::SEEK_POINT)),
+            ( *reinterpret_cast<const uint8_t *>(&one) == 1 ) ? "little" : "big",
+            static_cast<unsigned long>(sizeof(void *)),
+            PsgCtrl::STATE_CONFIG);
+    }
+
+    std::printf("%s: %lu bytes, %u channels, %lu ticks, %u seek points\n",
+            paths[1],
+            static_cast<unsigned long>(header.image_size),
+            header.num_channels,
+            static_cast<unsigned long>(header.total_ticks),
+            header.num_seek_points);
+
+    if ( do_verify ) {
+
+        uint32_t ticks = header.total_ticks + proc_freq;
+        if ( !verify(paths[1], text, mode, fs_clock, proc_freq, ticks) ) {
+
+            std::fprintf(stderr, "%s: the image does not play the same as %s\n", paths[1], paths[0]);
+            return 1;
+        }
+        std::printf("%s: verified over %lu ticks\n", paths[1], static_cast<unsigned long>(ticks));
+    }
+
+    return 0;
+}
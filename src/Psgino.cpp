@@ -10,6 +10,9 @@ Psgino::Psgino() {
     this->slot0 = (PsgCtrl::SLOT){};
     this->p_write = nullptr;
     this->p_reset = nullptr;
+#if PSGINO_USE_SEEK
+    this->seek_index = (PsgCtrl::SEEK_INDEX){};
+#endif
     this->ch0 = (PsgCtrl::CHANNEL_INFO){};
     this->ch1 = (PsgCtrl::CHANNEL_INFO){};
     this->ch2 = (PsgCtrl::CHANNEL_INFO){};
@@ -25,23 +28,40 @@ Psgino::Psgino(
     Psgino::Initialize(write, fs_clock, proc_freq, reset);
 }
 
-void Psgino::SetMML(const char *mml, uint16_t mode) {
+bool Psgino::SetMML(const char *mml, uint16_t mode) {
 
-    PsgCtrl::set_mml(this->slot0, mml, mode);
+    return ( PsgCtrl::post_mml(this->slot0, mml, mode) == 0 );
 }
 
-void Psgino::Play() {
+#if PSGINO_USE_MML_STREAM
+int Psgino::SetMMLReader(PsgCtrl::MML_READ_FUNC read, void *user, uint16_t mode) {
 
-    this->slot0.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
-    this->slot0.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+    return PsgCtrl::set_mml_reader(this->slot0, read, user, mode);
 }
+#endif
 
-void Psgino::Stop() {
+bool Psgino::Play() {
 
-    this->slot0.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_STOP;
-    this->slot0.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+    return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_PLAY);
 }
 
+bool Psgino::Stop() {
+
+    return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_STOP);
+}
+
+#if PSGINO_USE_MML_QUEUE
+int Psgino::QueueMML(const char *mml, uint16_t mode, bool at_loop) {
+
+    return PsgCtrl::queue_mml(this->slot0, mml, mode, at_loop);
+}
+
+bool Psgino::IsMMLQueued() const {
+
+    return PsgCtrl::is_mml_queued(this->slot0);
+}
+#endif
+
 Psgino::PlayStatus Psgino::GetStatus() {
 
     switch ( this->slot0.gl_info.sys_status.CTRL_STAT ) {
@@ -70,7 +90,7 @@ void Psgino::SetUserCallback(
 
 void Psgino::SetSpeedFactor(uint16_t speed_factor) {
 
-    PsgCtrl::set_speed_factor(this->slot0, speed_factor);
+    PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_SET_SPEED_FACTOR, (int16_t)speed_factor);
 }
 
 uint16_t Psgino::GetSpeedFactor() const {
@@ -78,9 +98,14 @@ uint16_t Psgino::GetSpeedFactor() const {
     return this->slot0.gl_info.speed_factor;
 }
 
+void Psgino::SetDecodeBudget(uint8_t budget) {
+
+    PsgCtrl::set_decode_budget(this->slot0, budget);
+}
+
 void Psgino::ShiftFrequency(int16_t shift_degrees) {
 
-    PsgCtrl::shift_frequency(this->slot0, shift_degrees);
+    PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_SHIFT_FREQUENCY, shift_degrees);
 }
 
 int16_t Psgino::GetFrequencyShiftDegrees() const {
@@ -88,6 +113,144 @@ int16_t Psgino::GetFrequencyShiftDegrees() const {
     return this->slot0.gl_info.shift_degrees;
 }
 
+#if PSGINO_USE_LIVE_NOTE
+bool Psgino::NoteOn(uint8_t ch, uint8_t note, uint8_t volume) {
+
+    return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_NOTE_ON, (int16_t)(((volume < 15) ? volume : 15) << 8 | ((note < 0x7F) ? note : 0x7F)), nullptr, ch);
+}
+
+bool Psgino::NoteOff(uint8_t ch) {
+
+    return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_NOTE_OFF, 0, nullptr, ch);
+}
+
+bool Psgino::SetPitchBend(uint8_t ch, int16_t degrees) {
+
+    return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_SET_PITCHBEND, degrees, nullptr, ch);
+}
+
+bool Psgino::SetEffect(uint8_t ch, char effect, int16_t value) {
+
+    /* The command refers to the letter until Proc() executes it, so it points into this table. */
+    static const char effect_codes[] = "ABDEFHJLMORSTUV";
+
+    if ( ( effect >= 'a' ) && ( effect <= 'z' ) ) {
+
+        effect = effect - 'a' + 'A';
+    }
+
+    for ( const char *p_code = effect_codes; *p_code != '\0'; p_code++ ) {
+
+        if ( *p_code == effect ) {
+
+            return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_SET_EFFECT, value, p_code, ch);
+        }
+    }
+
+    return false;
+}
+
+#if PSGINO_MML_INSTRUMENTS
+bool Psgino::SetInstrument(uint8_t ch, uint8_t instrument) {
+
+    return PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_SET_INSTRUMENT, instrument, nullptr, ch);
+}
+#endif
+#endif
+
+#if PSGINO_USE_SEEK
+void Psgino::BuildSeekIndex(
+        PsgCtrl::SEEK_POINT *points,
+        uint16_t num_points,
+        uint32_t interval_ms,
+        uint32_t max_ms
+) {
+
+    uint32_t proc_freq = this->slot0.gl_info.proc_freq;
+    uint32_t interval = (interval_ms / 1000) * proc_freq + ((interval_ms % 1000) * proc_freq + 500) / 1000;
+
+    PsgCtrl::build_seek_index(
+            this->slot0,
+            this->seek_index,
+            points,
+            num_points,
+            ( interval < 0xFFFF ) ? static_cast<uint16_t>(interval) : 0xFFFF,
+            (max_ms / 1000) * proc_freq + ((max_ms % 1000) * proc_freq) / 1000
+    );
+}
+
+void Psgino::Seek(uint32_t ms) {
+
+    uint32_t proc_freq = this->slot0.gl_info.proc_freq;
+
+    PsgCtrl::seek(
+            this->slot0,
+            &this->seek_index,
+            (ms / 1000) * proc_freq + ((ms % 1000) * proc_freq) / 1000
+    );
+}
+#endif
+
+int Psgino::SetSong(const void *image, uint32_t size) {
+
+    int ret = PsgCtrl::post_song(this->slot0, image, size);
+
+    if ( ret < 0 ) {
+
+        return ret;
+    }
+
+#if PSGINO_USE_SEEK
+    PsgCtrl::get_song_seek_index(this->slot0, image, this->seek_index);
+#endif
+
+    return 0;
+}
+
+int Psgino::AnalyzeMML(
+        const char *mml,
+        PsgCtrl::SONG_INFO &info,
+        uint16_t mode,
+        uint32_t max_ms
+) const {
+
+    uint32_t proc_freq = this->slot0.gl_info.proc_freq;
+
+    return PsgCtrl::analyze_mml(
+            mml,
+            mode,
+            this->slot0.gl_info.s_clock,
+            this->slot0.gl_info.proc_freq,
+            info,
+            (max_ms / 1000) * proc_freq + ((max_ms % 1000) * proc_freq) / 1000
+    );
+}
+
+void Psgino::SaveState(PsgCtrl::SLOT_STATE &state) {
+
+    PsgCtrl::save_state(this->slot0, state);
+}
+
+bool Psgino::RestoreState(const PsgCtrl::SLOT_STATE &state, const char *mml) {
+
+    return PsgCtrl::restore_state(this->slot0, state, mml);
+}
+
+#if PSGINO_USE_SEEK
+uint32_t Psgino::GetPosition() const {
+
+    uint32_t proc_freq = this->slot0.gl_info.proc_freq;
+    uint32_t tick = this->slot0.gl_info.song_tick;
+
+    if ( proc_freq == 0 ) {
+
+        return 0;
+    }
+
+    return (tick / proc_freq) * 1000 + ((tick % proc_freq) * 1000) / proc_freq;
+}
+#endif
+
 void Psgino::Initialize(
         void (*write)(uint8_t addr, uint8_t data),
         float fs_clock,
@@ -97,6 +260,9 @@ void Psgino::Initialize(
 
     this->p_write = write;
     this->p_reset = reset;
+#if PSGINO_USE_SEEK
+    this->seek_index = (PsgCtrl::SEEK_INDEX){};
+#endif
     PsgCtrl::init_slot(
             this->slot0,
             (uint32_t)(fs_clock*100+0.5F),
@@ -110,8 +276,17 @@ void Psgino::Initialize(
 
 void Psgino::Proc() {
 
+#if PSGINO_USE_TIMING_STATS
+    uint32_t t_start = PsgCtrl::read_timing_counter(this->slot0);
+    uint32_t t_output;
+#endif
+
     PsgCtrl::control_psg(this->slot0);
 
+#if PSGINO_USE_TIMING_STATS
+    t_output = PsgCtrl::read_timing_counter(this->slot0);
+#endif
+
     if ( this->p_write != nullptr ) {
         for ( uint8_t addr = 0; addr <= 0xF; addr++ ) {
 
@@ -122,6 +297,16 @@ void Psgino::Proc() {
         }
     }
 
+#if PSGINO_USE_TIMING_STATS
+    /* Only the ticks that control_psg recorded, i.e. not while stopped. */
+    if ( this->slot0.timing.is_recorded ) {
+
+        uint32_t t_end = PsgCtrl::read_timing_counter(this->slot0);
+        PsgCtrl::add_timing_sample(this->slot0, PsgCtrl::TIMING_PHASE_OUTPUT, t_end - t_output);
+        PsgCtrl::add_timing_sample(this->slot0, PsgCtrl::TIMING_PHASE_PROC, t_end - t_start);
+    }
+#endif
+
     this->slot0.psg_reg.flags_addr = 0;
     this->slot0.psg_reg.flags_mixer = 0;
 }
@@ -144,14 +329,30 @@ void Psgino::Reset() {
     }
 }
 
+#if PSGINO_USE_TIMING_STATS
+void Psgino::SetTimingCounter(uint32_t (*counter)()) {
+
+    PsgCtrl::set_timing_counter(this->slot0, counter);
+}
+
+const PsgCtrl::TIMING_STATS& Psgino::GetTimingStats() const {
+
+    return this->slot0.timing;
+}
+
+void Psgino::ResetTimingStats() {
+
+    PsgCtrl::reset_timing_stats(this->slot0);
+}
+#endif
+
 void Psgino::FinishPrimaryLoop(bool force) {
 
-    this->slot0.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG = 1;
-    if ( force ) {
-        this->slot0.gl_info.sys_request.FIN_PRI_LOOP_REQ = PsgCtrl::FIN_PRI_LOOP_REQ_FORCE;
-    } else {
-        this->slot0.gl_info.sys_request.FIN_PRI_LOOP_REQ = PsgCtrl::FIN_PRI_LOOP_REQ_NORMAL;
-    }
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+    PsgCtrl::post_command(this->slot0, PsgCtrl::CMD_FIN_PRI_LOOP, force ? 1 : 0);
+#else
+    (void)force;
+#endif
 }
 
 PsginoZ::PsginoZ() : Psgino() {
@@ -181,9 +382,9 @@ PsginoZ::PsginoZ(
     this->mixer_mask = 0;
 }
 
-void PsginoZ::SetSeMML(const char *mml, uint16_t mode) {
+bool PsginoZ::SetSeMML(const char *mml, uint16_t mode) {
 
-    PsgCtrl::set_mml(this->slot1, mml, mode);
+    return ( PsgCtrl::post_mml(this->slot1, mml, mode) == 0 );
 }
 
 PsginoZ::PlayStatus PsginoZ::GetSeStatus() {
@@ -205,16 +406,14 @@ PsginoZ::PlayStatus PsginoZ::GetSeStatus() {
     }
 }
 
-void PsginoZ::PlaySe() {
+bool PsginoZ::PlaySe() {
 
-    this->slot1.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_PLAY;
-    this->slot1.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+    return PsgCtrl::post_command(this->slot1, PsgCtrl::CMD_PLAY);
 }
 
-void PsginoZ::StopSe() {
+bool PsginoZ::StopSe() {
 
-    this->slot1.gl_info.sys_request.CTRL_REQ = PsgCtrl::CTRL_REQ_STOP;
-    this->slot1.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+    return PsgCtrl::post_command(this->slot1, PsgCtrl::CMD_STOP);
 }
 
 void PsginoZ::SetSeUserCallback(
@@ -226,7 +425,7 @@ void PsginoZ::SetSeUserCallback(
 
 void PsginoZ::SetSeSpeedFactor(uint16_t speed_factor) {
 
-    PsgCtrl::set_speed_factor(this->slot1, speed_factor);
+    PsgCtrl::post_command(this->slot1, PsgCtrl::CMD_SET_SPEED_FACTOR, (int16_t)speed_factor);
 }
 
 uint16_t PsginoZ::GetSeSpeedFactor() const {
@@ -234,9 +433,14 @@ uint16_t PsginoZ::GetSeSpeedFactor() const {
     return this->slot1.gl_info.speed_factor;
 }
 
+void PsginoZ::SetSeDecodeBudget(uint8_t budget) {
+
+    PsgCtrl::set_decode_budget(this->slot1, budget);
+}
+
 void PsginoZ::ShiftSeFrequency(int16_t shift_degrees) {
 
-    PsgCtrl::shift_frequency(this->slot1, shift_degrees);
+    PsgCtrl::post_command(this->slot1, PsgCtrl::CMD_SHIFT_FREQUENCY, shift_degrees);
 }
 
 int16_t PsginoZ::GetSeFrequencyShiftDegrees() const {
@@ -270,9 +474,18 @@ void PsginoZ::Proc() {
     uint16_t masked_flags_addr;
     uint16_t mixer;
 
+#if PSGINO_USE_TIMING_STATS
+    uint32_t t_start = PsgCtrl::read_timing_counter(this->slot0);
+    uint32_t t_output;
+#endif
+
     PsgCtrl::control_psg(this->slot0);
     PsgCtrl::control_psg(this->slot1);
 
+#if PSGINO_USE_TIMING_STATS
+    t_output = PsgCtrl::read_timing_counter(this->slot0);
+#endif
+
     for ( uint8_t i = 0; i < PsgCtrl::NUM_CHANNEL; i++ ) {
 
         /* MASK TP AND VOLUME CONTROL */
@@ -339,6 +552,16 @@ void PsginoZ::Proc() {
             this->mixer_mask = 0;
         }
     }
+
+#if PSGINO_USE_TIMING_STATS
+    if ( this->slot0.timing.is_recorded || this->slot1.timing.is_recorded ) {
+
+        /* Output includes the SE masking. */
+        uint32_t t_end = PsgCtrl::read_timing_counter(this->slot0);
+        PsgCtrl::add_timing_sample(this->slot0, PsgCtrl::TIMING_PHASE_OUTPUT, t_end - t_output);
+        PsgCtrl::add_timing_sample(this->slot0, PsgCtrl::TIMING_PHASE_PROC, t_end - t_start);
+    }
+#endif
 }
 
 void PsginoZ::Reset() {
@@ -346,3 +569,22 @@ void PsginoZ::Reset() {
     PsgCtrl::reset(this->slot1);
     Psgino::Reset();
 }
+
+#if PSGINO_USE_TIMING_STATS
+void PsginoZ::SetTimingCounter(uint32_t (*counter)()) {
+
+    Psgino::SetTimingCounter(counter);
+    PsgCtrl::set_timing_counter(this->slot1, counter);
+}
+
+const PsgCtrl::TIMING_STATS& PsginoZ::GetSeTimingStats() const {
+
+    return this->slot1.timing;
+}
+
+void PsginoZ::ResetTimingStats() {
+
+    Psgino::ResetTimingStats();
+    PsgCtrl::reset_timing_stats(this->slot1);
+}
+#endif
@@ -14,6 +14,14 @@
  * 
  * This class provides methods to play and control sound using PSG, including setting MML commands,
  * adjusting playback speed, and handling sound generation.
+ *
+ * SetMML, Play, Stop, FinishPrimaryLoop, SetSpeedFactor and ShiftFrequency do not modify the
+ * playback state directly. They post a command to a wait-free queue that `Proc()` executes
+ * at the start of its next call, so they may be called while `Proc()` runs in a timer interrupt.
+ * Up to `PSGINO_CMD_QUEUE_SIZE`-1 commands can be pending; further commands are discarded,
+ * and Play, Stop, PlaySe and StopSe return false for them. A pending MML is replaced by the
+ * next SetMML instead, and is set even when the queue is full.
+ * The Get functions reflect a command only after it has been executed.
  */
 class Psgino {
 public:
@@ -47,18 +55,68 @@ public:
      * @param mode Mode for MML processing (default is 0).
      * 
      * For details on the `mode` parameter, refer to the M command in the Header command section of MML.md.
+     * The MML is split into channels here, so that `Proc()` only has to switch to it. If an
+     * MML set before is still pending, this one replaces it, as the last call wins.
+     * 
+     * @return false if the MML is invalid; the MML is not set then.
+     */
+    bool SetMML(const char *mml, uint16_t mode = 0);
+
+#if PSGINO_USE_MML_STREAM
+    /**
+     * @brief Sets an MML that is read on demand, for songs larger than RAM.
+     * 
+     * `read(user, ofs, buf, len)` must copy `len` bytes of the MML source from offset `ofs` into
+     * `buf` and return the number of bytes copied, which is less than `len` only at the end of
+     * the source. It is called here to find the channels, and from `Proc()` whenever a channel
+     * needs the next part of its MML, at most `PSGINO_MML_STREAM_WINDOW` bytes at a time. The
+     * header must fit in the first window, and each command in half a window. Unlike `SetMML()`,
+     * this takes effect at once, so call it while `Proc()` is not running.
+     * 
+     * @param read Function that reads the MML source.
+     * @param user Pointer passed to `read`.
+     * @param mode Mode for MML processing, as in `SetMML()`.
+     * @return 0 on success, negative on an invalid source (see `PsgCtrl::set_mml_reader`).
      */
-    void SetMML(const char *mml, uint16_t mode = 0);
+    int SetMMLReader(PsgCtrl::MML_READ_FUNC read, void *user, uint16_t mode = 0);
+#endif
 
     /**
      * @brief Starts playback of the MML string.
+     * @return false if the command queue is full.
      */
-    void Play();
+    bool Play();
 
     /**
      * @brief Stops playback of the MML string.
+     * @return false if the command queue is full.
+     */
+    bool Stop();
+
+#if PSGINO_USE_MML_QUEUE
+    /**
+     * @brief Queues an MML string to follow the current one without a gap.
+     * 
+     * The MML is split into channels here, so that `Proc()` only has to switch to it. The switch
+     * happens in the tick in which the current MML would run out, or, with `at_loop`, when the
+     * first channel reaches the end of a pass of its primary loop. If no MML is set or the
+     * current one has ended, the queued MML starts at the next `Proc()` call. The string must
+     * remain valid until it has been replaced.
+     * 
+     * @param mml Pointer to the MML string.
+     * @param mode Mode for MML processing, as in `SetMML()`.
+     * @param at_loop true to switch at the end of a pass of the primary loop.
+     * @return 0 on success, negative if the MML is invalid (-1 to -3) or an MML is already queued (-4).
+     */
+    int QueueMML(const char *mml, uint16_t mode = 0, bool at_loop = false);
+
+    /**
+     * @brief Checks whether the MML queued by `QueueMML()` is still waiting.
+     * 
+     * @return true while the queued MML has not started.
      */
-    void Stop();
+    bool IsMMLQueued() const;
+#endif
 
     /**
      * @brief Enumeration for the playback status.
@@ -80,6 +138,7 @@ public:
      * @brief Sets a user-defined callback function.
      * 
      * This callback function is executed when the @C command within the MML is decoded.
+     * Does nothing when `PSGINO_USE_USER_CALLBACK` is 0.
      * 
      * @param cb Function pointer for the user callback.
      */
@@ -99,6 +158,8 @@ public:
      * Note: When `force` is `true`, executing this function between the break symbol `|` and the loop's end `]` may lead to an unintended melody sequence.
      *       Therefore, it's recommended to adjust the timing of this function's execution using MML callback functions, such as the `@C` command.
      *
+     * Does nothing when `PSGINO_USE_FINISH_PRIMARY_LOOP` is 0.
+     *
      * @param force Determines whether to forcefully exit the primary loop (`true`) or not (`false`).
      */
     void FinishPrimaryLoop(bool force = false);
@@ -112,7 +173,8 @@ public:
      * @param speed_factor The speed factor to be set.
      * 
      * @note If this function is called during playback and the `speed_factor` is set too high,
-     * it may cause timing discrepancies between the channels.
+     * it may cause timing discrepancies between the channels. With `PSGINO_USE_SONG_CLOCK` set to 1,
+     * the change is exact and cheap, so it can be called every tick to ramp the tempo.
      */
     void SetSpeedFactor(uint16_t speed_factor);
 
@@ -122,6 +184,19 @@ public:
      */
     uint16_t GetSpeedFactor() const;
 
+    /**
+     * @brief Limits the number of MML commands decoded per channel in one `Proc()` call.
+     * 
+     * A long run of setup commands (`T`, `V`, `$`, `@C`, loop brackets, ...) before a note is
+     * then spread over several calls, which bounds the worst-case time of `Proc()`.
+     * The next note starts up to `PsgCtrl::MAX_DECODE_DEBT` calls late and is shortened by
+     * the same amount, or the notes after it are if it is too short, so the following notes
+     * stay on time and the channels stay aligned.
+     * 
+     * @param budget Number of commands per channel per call. 0 (default) means unlimited.
+     */
+    void SetDecodeBudget(uint8_t budget);
+
     /**
      * @brief Shifts the frequency of the sound.
      * 
@@ -139,6 +214,181 @@ public:
      */
     int16_t GetFrequencyShiftDegrees() const;
 
+#if PSGINO_USE_LIVE_NOTE
+    /**
+     * @brief Starts a note on a channel directly, without MML.
+     * 
+     * The channel becomes live: the MML no longer plays it, and its part of the MML waits
+     * until the next `Play()`, which gives every channel back to the MML. A live channel
+     * keeps sounding whether the MML plays, stops or ends. The note starts in the next
+     * `Proc()` call with the envelope and LFO settings of the channel (see `SetInstrument()`),
+     * and sounds until `NoteOff()` or the next `NoteOn()` on the channel.
+     * 
+     * @param ch Channel (0 to 2).
+     * @param note Note number, as in the `N` command of the MML (0 to 95).
+     * @param volume Volume level, as in the `V` command (0 to 15).
+     * @return false if the command queue is full; the note is not played then.
+     */
+    bool NoteOn(uint8_t ch, uint8_t note, uint8_t volume = 15);
+
+    /**
+     * @brief Ends the note of a live channel, with the release of its software envelope if set.
+     * 
+     * @param ch Channel (0 to 2).
+     * @return false if the command queue is full.
+     */
+    bool NoteOff(uint8_t ch);
+
+    /**
+     * @brief Bends the pitch of a live channel, including the note that is sounding.
+     * 
+     * The bend is the bias of the `$B` command: 360 degrees is one octave, 30 degrees a semitone.
+     * 
+     * @param ch Channel (0 to 2).
+     * @param degrees Bend in degrees, from -500 to 500.
+     * @return false if the command queue is full.
+     */
+    bool SetPitchBend(uint8_t ch, int16_t degrees);
+
+    /**
+     * @brief Sets an effect of a live channel, as the `$` command of the MML does.
+     * 
+     * For example, `SetEffect(0, 'J', 20)` sets the LFO depth of channel 0 as `$J20` would.
+     * Times and LFO speeds are converted with the tempo and units (`$U`, `$V`) of the channel.
+     * The effects apply from the next note, except the LFO depth, which applies at once.
+     * 
+     * @param ch Channel (0 to 2).
+     * @param effect Letter of the `$` command: `A`, `B`, `D`, `E`, `F`, `H`, `J`, `L`, `M`,
+     *               `O`, `R`, `S`, `T`, `U` or `V`.
+     * @param value Value of the command.
+     * @return false if the letter is not one of the above or the command queue is full.
+     */
+    bool SetEffect(uint8_t ch, char effect, int16_t value);
+
+#if PSGINO_MML_INSTRUMENTS
+    /**
+     * @brief Selects an instrument of the MML header for a live channel, as `@I` does.
+     * 
+     * The instruments are those of the MML set last. An MML made only of a header, such
+     * as `":I0{$E1$A10$D100$S40$R200};"`, defines instruments for live channels.
+     * 
+     * @param ch Channel (0 to 2).
+     * @param instrument Instrument number.
+     * @return false if the command queue is full.
+     */
+    bool SetInstrument(uint8_t ch, uint8_t instrument);
+#endif
+#endif
+
+#if PSGINO_USE_SEEK
+    /**
+     * @brief Builds an index of playback positions of the current MML, used by `Seek()`.
+     * 
+     * The MML is run silently from the start, and the state of every channel is stored in
+     * `points` every `interval_ms`. Each point takes `sizeof(PsgCtrl::SEEK_POINT)` bytes, and
+     * the buffer must stay valid while the index is used. Building stops at the end of the MML,
+     * when the buffer is full or after `max_ms`. Playback is stopped, and the user callback is
+     * not called. Call it again after `SetMML()`.
+     * 
+     * @param points Buffer for the index.
+     * @param num_points Number of points in the buffer.
+     * @param interval_ms Time between two points in milliseconds at 100% speed.
+     * @param max_ms Length of MML to index in milliseconds, for MML that loops forever.
+     * 
+     * @note Must not be called while `Proc()` is running, for example from a timer interrupt.
+     */
+    void BuildSeekIndex(
+            PsgCtrl::SEEK_POINT *points,
+            uint16_t num_points,
+            uint32_t interval_ms = 1000,
+            uint32_t max_ms = 600000
+    );
+
+    /**
+     * @brief Starts playback at a position of the MML.
+     * 
+     * The nearest position stored by `BuildSeekIndex()` is restored and only the rest is run,
+     * so the cost is bounded by `interval_ms`. Without an index for the current MML, the MML
+     * is run from the start. The user callback is not called for the skipped part.
+     * 
+     * @param ms Position in milliseconds at 100% speed.
+     * 
+     * @note Must not be called while `Proc()` is running, for example from a timer interrupt.
+     */
+    void Seek(uint32_t ms);
+#endif
+
+    /**
+     * @brief Sets a song image written by `psgino_pack` (extras/song_pack) instead of an MML string.
+     * 
+     * The image is used in place, for example from `mmap()` or from memory-mapped flash: the
+     * channels are set from the offsets in its header, so the MML is not split or copied, and its
+     * seek table becomes the index of `Seek()` (with `PSGINO_USE_SEEK`) if it was built for this
+     * PSG clock, `proc_freq` and build settings. Like `SetMML()`, the change takes effect at the
+     * next `Proc()`.
+     * 
+     * @param image Start of the image, aligned to `alignof(PsgCtrl::SONG_HEADER)`. Must remain
+     *              valid while it is played.
+     * @param size Size of the image in bytes.
+     * @return 0 on success, or negative if the image is invalid (see `PsgCtrl::check_song`).
+     *         A pending MML or image is replaced as in `SetMML()`.
+     */
+    int SetSong(const void *image, uint32_t size);
+
+#if PSGINO_USE_SEEK
+    /**
+     * @brief Gets the current playback position.
+     * @return Position in milliseconds at 100% speed, 0 before `Initialize()`.
+     */
+    uint32_t GetPosition() const;
+#endif
+
+    /**
+     * @brief Analyzes an MML without playing it.
+     * 
+     * Reports the length (to the end, or through the first pass of an infinite `[0 ...]` loop),
+     * the loop point of each channel, and the peak number of MML commands and register writes
+     * in a single `Proc()` call. Playback is not affected; the PSG clock and `proc_freq` of this
+     * instance are used. Needs about one SLOT and three CHANNEL_INFO of stack.
+     * 
+     * @param mml The MML string to be analyzed.
+     * @param info Receives the result. Ticks are `Proc()` calls at 100% speed.
+     * @param mode Mode for MML processing, as in `SetMML()`.
+     * @param max_ms Length after which the analysis stops (`info.complete` is then false).
+     * @return Negative when the MML is invalid.
+     */
+    int AnalyzeMML(
+            const char *mml,
+            PsgCtrl::SONG_INFO &info,
+            uint16_t mode = 0,
+            uint32_t max_ms = 600000
+    ) const;
+
+    /**
+     * @brief Saves the playback state, to be resumed later with `RestoreState()`.
+     * 
+     * The state holds no pointers; the MML position of each channel is stored as an offset.
+     * 
+     * @param state Receives the state (`sizeof(PsgCtrl::SLOT_STATE)` bytes).
+     * 
+     * @note Must not be called while `Proc()` is running, for example from a timer interrupt.
+     */
+    void SaveState(PsgCtrl::SLOT_STATE &state);
+
+    /**
+     * @brief Resumes the playback state saved by `SaveState()`.
+     * 
+     * Playback continues from the saved position with the saved tempo, speed factor and
+     * frequency shift, even if another MML was set in between.
+     * 
+     * @param state The saved state.
+     * @param mml The MML that was playing when the state was saved.
+     * @return false if the state comes from a build with other settings; nothing is changed then.
+     * 
+     * @note Must not be called while `Proc()` is running, for example from a timer interrupt.
+     */
+    bool RestoreState(const PsgCtrl::SLOT_STATE &state, const char *mml);
+
     /**
      * @brief Initializes the PSG with the given parameters.
      * 
@@ -170,6 +420,34 @@ public:
      */
     virtual void Reset();
 
+#if PSGINO_USE_TIMING_STATS
+    /**
+     * @brief Sets the cycle counter used to time `Proc()`, and clears the statistics.
+     * 
+     * Call this after `Initialize()`. The counter must be free-running; wrap-around is handled.
+     * Examples are `DWT->CYCCNT` on Cortex-M, `rdtsc` on x86 or `micros()`.
+     * 
+     * @param counter Function returning the current counter value. nullptr stops recording.
+     */
+    virtual void SetTimingCounter(uint32_t (*counter)());
+
+    /**
+     * @brief Gets the timing statistics of the MML playback.
+     * 
+     * `phase[PsgCtrl::TIMING_PHASE_*]` holds the minimum, maximum, sample count and a
+     * power-of-two histogram of each phase in counter units. Ticks in which playback is
+     * stopped are not recorded.
+     * 
+     * @return Reference to the statistics.
+     */
+    const PsgCtrl::TIMING_STATS& GetTimingStats() const;
+
+    /**
+     * @brief Clears the timing statistics.
+     */
+    virtual void ResetTimingStats();
+#endif
+
 protected:
     /** 
      * @brief PSG control handler used for MML playback.
@@ -186,6 +464,13 @@ protected:
      */
     void (*p_reset)();
 
+#if PSGINO_USE_SEEK
+    /** 
+     * @brief Index of playback positions built by `BuildSeekIndex()`.
+     */
+    PsgCtrl::SEEK_INDEX seek_index;
+#endif
+
 private:
     /** 
      * @brief Channel information for channel 0 (Channel A).
@@ -241,20 +526,24 @@ public:
      * @param mml The MML string to be used for SE processing.
      * @param mode The mode for SE MML processing (default is 0).
      * 
+     * @return false if the MML is invalid. A pending SE MML is replaced as in `SetMML()`.
+     * 
      * @note Only one channel can be used for SE MML (single note only). 
      * SE playback utilizes Channel 2 (Channel C).
      */
-    void SetSeMML(const char *mml, uint16_t mode = 0);
+    bool SetSeMML(const char *mml, uint16_t mode = 0);
 
     /**
      * @brief Starts playback of the SE MML string.
+     * @return false if the command queue is full.
      */
-    void PlaySe();
+    bool PlaySe();
 
     /**
      * @brief Stops playback of the SE MML string.
+     * @return false if the command queue is full.
      */
-    void StopSe();
+    bool StopSe();
 
     /**
      * @brief Gets the current playback status of the SE.
@@ -293,6 +582,14 @@ public:
      */
     uint16_t GetSeSpeedFactor() const;
 
+    /**
+     * @brief Limits the number of SE MML commands decoded in one `Proc()` call.
+     * 
+     * @param budget Number of commands per call. 0 (default) means unlimited.
+     * @see Psgino::SetDecodeBudget()
+     */
+    void SetSeDecodeBudget(uint8_t budget);
+
     /**
      * @brief Shifts the frequency of the SE sound.
      * 
@@ -341,6 +638,30 @@ public:
      */
     void Reset() override;
 
+#if PSGINO_USE_TIMING_STATS
+    /**
+     * @brief Sets the cycle counter used to time `Proc()` for both BGM and SE, and clears the statistics.
+     * 
+     * @param counter Function returning the current counter value. nullptr stops recording.
+     */
+    void SetTimingCounter(uint32_t (*counter)()) override;
+
+    /**
+     * @brief Gets the timing statistics of the SE playback.
+     * 
+     * Only the phases of `control_psg` are recorded here. The register output and the whole
+     * `Proc()` call are recorded in `GetTimingStats()`.
+     * 
+     * @return Reference to the statistics.
+     */
+    const PsgCtrl::TIMING_STATS& GetSeTimingStats() const;
+
+    /**
+     * @brief Clears the timing statistics of both BGM and SE.
+     */
+    void ResetTimingStats() override;
+#endif
+
 private:
     /** 
      * @brief PSG control handler used for SE MML playback.
@@ -0,0 +1,519 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include "PsginoMidi.h"
+
+#if PSGINO_USE_LIVE_NOTE
+
+namespace {
+
+    constexpr uint8_t NO_VOICE              = (0xFF);
+    constexpr uint8_t MIDI_NOTE_OFS         = (24);     /* MIDI note 60 is N36 (O4C). */
+    constexpr uint8_t DEFAULT_BEND_RANGE    = (2);
+    constexpr uint8_t MAX_BEND_RANGE        = (16);
+    constexpr int16_t DEGREES_PER_SEMITONE  = (30);
+    constexpr uint16_t MAX_EFFECT_TIME      = (10000);  /* ms, as the $A, $D and $R commands. */
+
+    /* Effects of the control changes, by index of PsginoMidi::effects. */
+    constexpr uint8_t EFFECT_J              = (0);
+    constexpr uint8_t EFFECT_L              = (1);
+    constexpr uint8_t EFFECT_A              = (2);
+    constexpr uint8_t EFFECT_D              = (3);
+    constexpr uint8_t EFFECT_R              = (4);
+    const char EFFECT_LETTERS[]             = { 'J', 'L', 'A', 'D', 'R' };
+}
+
+PsginoMidi::PsginoMidi() {
+
+    this->Initialize(nullptr, 0);
+}
+
+PsginoMidi::PsginoMidi(Psgino *const *chips, uint8_t num_chips, uint8_t midi_ch) {
+
+    this->Initialize(chips, num_chips, midi_ch);
+}
+
+void PsginoMidi::Initialize(Psgino *const *chips, uint8_t num_chips, uint8_t midi_ch) {
+
+    if ( chips == nullptr ) {
+
+        num_chips = 0;
+    }
+
+    if ( num_chips > PSGINO_MIDI_MAX_CHIPS ) {
+
+        num_chips = PSGINO_MIDI_MAX_CHIPS;
+    }
+
+    for ( uint8_t i = 0; i < PSGINO_MIDI_MAX_CHIPS; i++ ) {
+
+        this->chips[i] = ( i < num_chips ) ? chips[i] : nullptr;
+    }
+
+    for ( uint8_t v = 0; v < MAX_VOICES; v++ ) {
+
+        this->voices[v] = (VOICE){};
+    }
+
+    this->sustained = 0;
+    this->pending_on = 0;
+    this->pending_off = 0;
+    this->pending_bend = 0;
+    this->clock = 0;
+    this->bend = 0;
+    for ( uint8_t i = 0; i < NUM_EFFECTS; i++ ) {
+
+        this->effects[i] = 0;
+    }
+    for ( uint8_t v = 0; v < MAX_VOICES; v++ ) {
+
+        this->pending_fx[v] = 0;
+    }
+    this->is_fx_pending = false;
+#if PSGINO_MML_INSTRUMENTS
+    this->program = 0;
+#endif
+    this->num_voices = num_chips * PsgCtrl::NUM_CHANNEL;
+    this->midi_ch = midi_ch;
+    this->status = 0;
+    this->data1 = 0;
+    this->num_data = 0;
+    this->steal_mode = STEAL_OLDEST;
+    this->bend_range = DEFAULT_BEND_RANGE;
+    this->volume = 127;
+    this->is_sustain = false;
+}
+
+void PsginoMidi::Receive(uint8_t data) {
+
+    this->Proc();
+
+    if ( data >= 0xF8 ) {
+
+        /* Real-time messages do not affect the running status. */
+        return;
+    }
+
+    if ( data & 0x80 ) {
+
+        /* System exclusive and system common messages cancel the running status. */
+        this->status = ( data < 0xF0 ) ? data : 0;
+        this->num_data = 0;
+        return;
+    }
+
+    if ( this->status == 0 ) {
+
+        return;
+    }
+
+    switch ( this->status & 0xF0 ) {
+
+    case 0xC0:
+    case 0xD0:
+        this->dispatch(this->status, data, 0);
+        break;
+
+    default:
+        if ( this->num_data == 0 ) {
+
+            this->data1 = data;
+            this->num_data = 1;
+        } else {
+
+            this->num_data = 0;
+            this->dispatch(this->status, this->data1, data);
+        }
+        break;
+    }
+}
+
+void PsginoMidi::Proc() {
+
+    if ( ( ( this->pending_on | this->pending_off | this->pending_bend ) != 0 ) || this->is_fx_pending ) {
+
+        this->send_pending();
+    }
+}
+
+void PsginoMidi::SetStealMode(StealMode mode) {
+
+    this->steal_mode = mode;
+}
+
+void PsginoMidi::SetBendRange(uint8_t semitones) {
+
+    this->bend_range = ( semitones < 1 ) ? 1 : ( semitones > MAX_BEND_RANGE ) ? MAX_BEND_RANGE : semitones;
+}
+
+void PsginoMidi::AllNotesOff() {
+
+    this->sustained = 0;
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        if ( this->voices[v].velocity != 0 ) {
+
+            this->release_voice(v);
+        }
+    }
+}
+
+void PsginoMidi::dispatch(uint8_t status, uint8_t data1, uint8_t data2) {
+
+    if ( ( this->midi_ch != OMNI ) && ( ( status & 0x0F ) != this->midi_ch ) ) {
+
+        return;
+    }
+
+    switch ( status & 0xF0 ) {
+
+    case 0x80:
+        this->note_off(data1);
+        break;
+
+    case 0x90:
+        if ( data2 != 0 ) {
+
+            this->note_on(data1, data2);
+        } else {
+
+            this->note_off(data1);
+        }
+        break;
+
+    case 0xB0:
+        this->control_change(data1, data2);
+        break;
+
+    case 0xC0:
+#if PSGINO_MML_INSTRUMENTS
+        if ( data1 < PsgCtrl::NUM_MML_INSTRUMENTS ) {
+
+            this->send_program(data1);
+        }
+#endif
+        break;
+
+    case 0xE0:
+        this->bend = static_cast<int16_t>(
+                ( static_cast<int32_t>((data2 << 7) | data1) - 0x2000 )
+                * this->bend_range * DEGREES_PER_SEMITONE / 0x2000
+        );
+        this->send_bend();
+        break;
+
+    default:
+        /* Polyphonic and channel pressure are not used. */
+        break;
+    }
+}
+
+void PsginoMidi::note_on(uint8_t note, uint8_t velocity) {
+
+    uint8_t v;
+
+    if ( ( note <= MIDI_NOTE_OFS ) || ( note > MIDI_NOTE_OFS + PsgCtrl::MAX_NOTE_NUMBER ) ) {
+
+        return;
+    }
+
+    v = this->find_voice(note);
+    if ( v == NO_VOICE ) {
+
+        v = this->alloc_voice();
+        if ( v == NO_VOICE ) {
+
+            return;
+        }
+    }
+
+    /* The new note replaces whatever the voice was playing or releasing. */
+    this->sustained &= ~(1UL << v);
+    this->pending_off &= ~(1UL << v);
+    this->voices[v].note = note;
+    this->voices[v].velocity = velocity;
+    this->voices[v].stamp = this->clock++;
+
+    if ( this->send_note_on(v) ) {
+
+        this->pending_on &= ~(1UL << v);
+    } else {
+
+        this->pending_on |= 1UL << v;
+    }
+}
+
+void PsginoMidi::note_off(uint8_t note) {
+
+    uint8_t v = this->find_voice(note);
+
+    if ( v == NO_VOICE ) {
+
+        return;
+    }
+
+    if ( this->is_sustain ) {
+
+        this->sustained |= 1UL << v;
+    } else {
+
+        this->release_voice(v);
+    }
+}
+
+void PsginoMidi::control_change(uint8_t number, uint8_t value) {
+
+    switch ( number ) {
+
+    case 1:
+    case 77:
+        this->send_effect(EFFECT_J, static_cast<int16_t>(value) * 2);
+        break;
+
+    case 76:
+        this->send_effect(EFFECT_L, static_cast<int16_t>((static_cast<uint16_t>(value) * 200 + 63) / 127));
+        break;
+
+    case 72:
+    case 73:
+    case 75:
+        /* Squared, for a finer control of the short times. */
+        this->send_effect(
+                ( number == 72 ) ? EFFECT_R : ( number == 73 ) ? EFFECT_A : EFFECT_D,
+                static_cast<int16_t>(static_cast<uint32_t>(value) * value * MAX_EFFECT_TIME / (127*127))
+        );
+        break;
+
+    case 7:
+        this->volume = value;
+        break;
+
+    case 64:
+        this->is_sustain = ( value >= 64 );
+        if ( !this->is_sustain ) {
+
+            for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+                if ( this->sustained & (1UL << v) ) {
+
+                    this->release_voice(v);
+                }
+            }
+            this->sustained = 0;
+        }
+        break;
+
+    case 121:
+        this->bend = 0;
+        this->send_bend();
+        this->send_effect(EFFECT_J, 0);
+        if ( this->is_sustain ) {
+
+            this->control_change(64, 0);
+        }
+        break;
+
+    case 120:
+    case 123:
+        this->AllNotesOff();
+        break;
+
+    default:
+        break;
+    }
+}
+
+void PsginoMidi::release_voice(uint8_t v) {
+
+    this->pending_on &= ~(1UL << v);
+    this->voices[v].velocity = 0;
+    this->voices[v].stamp = this->clock++;
+
+    if ( !this->chips[v / PsgCtrl::NUM_CHANNEL]->NoteOff(v % PsgCtrl::NUM_CHANNEL) ) {
+
+        this->pending_off |= 1UL << v;
+    }
+}
+
+bool PsginoMidi::send_note_on(uint8_t v) {
+
+    uint16_t level;
+
+    /* Velocity and CC7 scaled to 1-15, rounded up so that any note is heard. */
+    level = static_cast<uint16_t>(this->voices[v].velocity) * this->volume;
+    level = static_cast<uint16_t>((static_cast<uint32_t>(level) * 15 + 127*127 - 1) / (127*127));
+
+    return this->chips[v / PsgCtrl::NUM_CHANNEL]->NoteOn(
+            v % PsgCtrl::NUM_CHANNEL,
+            this->voices[v].note - MIDI_NOTE_OFS,
+            static_cast<uint8_t>(level)
+    );
+}
+
+void PsginoMidi::send_bend() {
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        if ( this->chips[v / PsgCtrl::NUM_CHANNEL]->SetPitchBend(v % PsgCtrl::NUM_CHANNEL, this->bend) ) {
+
+            this->pending_bend &= ~(1UL << v);
+        } else {
+
+            this->pending_bend |= 1UL << v;
+        }
+    }
+}
+
+void PsginoMidi::send_effect(uint8_t index, int16_t value) {
+
+    this->effects[index] = value;
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        /* After a pending program change, so that the instrument does not override the effect. */
+        if ( ( ( this->pending_fx[v] & PENDING_PROGRAM ) == 0 ) && this->send_effect_to(v, index) ) {
+
+            this->pending_fx[v] &= ~(1 << index);
+        } else {
+
+            this->pending_fx[v] |= 1 << index;
+            this->is_fx_pending = true;
+        }
+    }
+}
+
+bool PsginoMidi::send_effect_to(uint8_t v, uint8_t index) {
+
+    return this->chips[v / PsgCtrl::NUM_CHANNEL]->SetEffect(
+            v % PsgCtrl::NUM_CHANNEL,
+            EFFECT_LETTERS[index],
+            this->effects[index]
+    );
+}
+
+#if PSGINO_MML_INSTRUMENTS
+void PsginoMidi::send_program(uint8_t program) {
+
+    this->program = program;
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        /* The instrument replaces the effects that are still pending. */
+        this->pending_fx[v] = 0;
+
+        if ( this->chips[v / PsgCtrl::NUM_CHANNEL]->SetInstrument(v % PsgCtrl::NUM_CHANNEL, program) ) {
+
+            this->pending_fx[v] &= ~PENDING_PROGRAM;
+        } else {
+
+            this->pending_fx[v] |= PENDING_PROGRAM;
+            this->is_fx_pending = true;
+        }
+    }
+}
+#endif
+
+void PsginoMidi::send_pending() {
+
+    bool is_fx_pending = false;
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        Psgino *p_chip = this->chips[v / PsgCtrl::NUM_CHANNEL];
+        uint8_t ch = v % PsgCtrl::NUM_CHANNEL;
+
+        if ( ( this->pending_off & (1UL << v) ) && p_chip->NoteOff(ch) ) {
+
+            this->pending_off &= ~(1UL << v);
+        }
+
+        if ( ( this->pending_on & (1UL << v) ) && this->send_note_on(v) ) {
+
+            this->pending_on &= ~(1UL << v);
+        }
+
+        if ( ( this->pending_bend & (1UL << v) ) && p_chip->SetPitchBend(ch, this->bend) ) {
+
+            this->pending_bend &= ~(1UL << v);
+        }
+
+#if PSGINO_MML_INSTRUMENTS
+        /* The program first, as the effects set after it are pending behind it. */
+        if ( ( this->pending_fx[v] & PENDING_PROGRAM ) && p_chip->SetInstrument(ch, this->program) ) {
+
+            this->pending_fx[v] &= ~PENDING_PROGRAM;
+        }
+#endif
+
+        for ( uint8_t i = 0; i < NUM_EFFECTS; i++ ) {
+
+            if ( ( this->pending_fx[v] & (1 << i) ) && this->send_effect_to(v, i) ) {
+
+                this->pending_fx[v] &= ~(1 << i);
+            }
+        }
+
+        is_fx_pending = is_fx_pending || ( this->pending_fx[v] != 0 );
+    }
+
+    this->is_fx_pending = is_fx_pending;
+}
+
+uint8_t PsginoMidi::find_voice(uint8_t note) const {
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        if ( ( this->voices[v].velocity != 0 ) && ( this->voices[v].note == note ) ) {
+
+            return v;
+        }
+    }
+
+    return NO_VOICE;
+}
+
+uint8_t PsginoMidi::alloc_voice() const {
+
+    uint8_t free_v = NO_VOICE;
+    uint8_t steal_v = NO_VOICE;
+    uint16_t free_age = 0;
+    uint16_t steal_age = 0;
+
+    for ( uint8_t v = 0; v < this->num_voices; v++ ) {
+
+        const VOICE &voice = this->voices[v];
+        uint16_t age = this->clock - voice.stamp;
+
+        if ( voice.velocity == 0 ) {
+
+            /* The voice released first has the least of its release left. */
+            if ( ( free_v == NO_VOICE ) || ( age > free_age ) ) {
+
+                free_v = v;
+                free_age = age;
+            }
+        } else if ( steal_v == NO_VOICE ) {
+
+            steal_v = v;
+            steal_age = age;
+        } else if ( ( this->steal_mode == STEAL_QUIETEST ) && ( voice.velocity != this->voices[steal_v].velocity ) ) {
+
+            if ( voice.velocity < this->voices[steal_v].velocity ) {
+
+                steal_v = v;
+                steal_age = age;
+            }
+        } else if ( age > steal_age ) {
+
+            steal_v = v;
+            steal_age = age;
+        }
+    }
+
+    return ( free_v != NO_VOICE ) ? free_v : steal_v;
+}
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef PSGINO_MIDI_H
+#define PSGINO_MIDI_H
+
+#include "Psgino.h"
+
+#if PSGINO_USE_LIVE_NOTE
+
+static_assert(
+    ( PSGINO_MIDI_MAX_CHIPS >= 1 ) && ( PSGINO_MIDI_MAX_CHIPS <= 8 ),
+    "PSGINO_MIDI_MAX_CHIPS must be between 1 and 8"
+);
+
+/**
+ * @class PsginoMidi
+ * @brief Plays a MIDI byte stream on the tone channels of one or more Psgino instances.
+ *
+ * Requires `PSGINO_USE_LIVE_NOTE=1`.
+ *
+ * `Receive()` parses the stream one byte at a time, with running status, and allocates the
+ * notes of one MIDI channel (or all of them) to the voices, the three channels of each chip.
+ * A note takes a free voice, the one released first; when every voice sounds, it steals the
+ * oldest note or the quietest one (see `SetStealMode()`). The voices play through the live
+ * commands of Psgino (`NoteOn()`, `NoteOff()`, `SetPitchBend()`, `SetEffect()`,
+ * `SetInstrument()`), so each voice is a live channel from its first message.
+ *
+ * | Message | Effect |
+ * |---|---|
+ * | Note on / off | Note on a voice; note numbers 25 to 119 (MIDI 60 is `O4C`). The volume is the velocity scaled by CC7, 1 to 15. |
+ * | Pitch bend | `SetPitchBend()` of every voice, within the bend range (see `SetBendRange()`). |
+ * | Program change | `SetInstrument()` of every voice (instruments `I0`, `I1`, ... of the MML header). |
+ * | CC1, CC77 | LFO depth (`$J`, 0 to 254). The instrument needs `$M1`. |
+ * | CC76 | LFO speed (`$L`, 0 to 200). |
+ * | CC73, CC75, CC72 | Attack, decay and release time (`$A`, `$D`, `$R`, 0 to 10000 ms). The instrument needs `$E1`. |
+ * | CC7 | Volume of the following notes. |
+ * | CC64 | Sustain pedal. |
+ * | CC120, CC123 | All notes off. |
+ * | CC121 | Resets the bend, the sustain pedal and the LFO depth. |
+ *
+ * The settings are shared by all voices; messages of other MIDI channels are ignored.
+ *
+ * `Receive()` takes a bounded time per byte (a few loops over the voices), so it may be
+ * called from the UART receive interrupt while `Proc()` of the chips runs elsewhere. It is
+ * then the only caller of the command functions of those chips that may interrupt them:
+ * call the other commands (`Play()`, `SetMML()`, ...) from the same context or with the
+ * interrupt masked. A pitch bend or a control change sends one command per voice of a chip,
+ * so `PSGINO_CMD_QUEUE_SIZE` should hold a few of them. A note on, note off, bend, effect
+ * or program change that finds the queue full is sent again, with the latest value, by the
+ * next `Receive()` or `Proc()` call, so call `Proc()` before `Proc()` of the chips, as with
+ * PsginoVoices.
+ */
+class PsginoMidi {
+public:
+    /**
+     * @brief The note that is replaced when a note arrives and every voice sounds.
+     */
+    enum StealMode : uint8_t {
+        STEAL_OLDEST = 0,   /**< The note that started first. */
+        STEAL_QUIETEST = 1  /**< The note with the lowest velocity; the oldest of them on a tie. */
+    };
+
+    /**
+     * @brief Value of `midi_ch` that receives every MIDI channel.
+     */
+    static constexpr uint8_t OMNI = 0xFF;
+
+    /**
+     * @brief Maximum number of voices.
+     */
+    static constexpr uint8_t MAX_VOICES = PSGINO_MIDI_MAX_CHIPS * PsgCtrl::NUM_CHANNEL;
+
+    /**
+     * @brief Default constructor for PsginoMidi. Call `Initialize()` before `Receive()`.
+     */
+    PsginoMidi();
+
+    /**
+     * @brief Parameterized constructor for PsginoMidi.
+     *
+     * @param chips Psgino instances whose channels are the voices.
+     * @param num_chips Number of instances, up to `PSGINO_MIDI_MAX_CHIPS`.
+     * @param midi_ch MIDI channel to receive (0 to 15), or `OMNI`.
+     */
+    PsginoMidi(Psgino *const *chips, uint8_t num_chips, uint8_t midi_ch = OMNI);
+
+    /**
+     * @brief Sets the chips and the MIDI channel, and clears the voices and settings.
+     *
+     * @param chips Psgino instances whose channels are the voices.
+     * @param num_chips Number of instances, up to `PSGINO_MIDI_MAX_CHIPS`.
+     * @param midi_ch MIDI channel to receive (0 to 15), or `OMNI`.
+     */
+    void Initialize(Psgino *const *chips, uint8_t num_chips, uint8_t midi_ch = OMNI);
+
+    /**
+     * @brief Parses one byte of the MIDI stream, and plays the message it completes.
+     *
+     * System exclusive and system common messages are skipped; real-time bytes may appear
+     * anywhere and are ignored.
+     *
+     * @param data Received byte.
+     */
+    void Receive(uint8_t data);
+
+    /**
+     * @brief Sends again the commands that found the command queue full.
+     *
+     * Call this at `proc_freq`, before `Proc()` of the chips, so that a note ends even when no
+     * byte follows its note off. `Receive()` also does this with every byte. If `Receive()` is
+     * called from an interrupt, mask it while this runs.
+     */
+    void Proc();
+
+    /**
+     * @brief Sets the note replaced when every voice sounds (default `STEAL_OLDEST`).
+     *
+     * @param mode Steal mode.
+     */
+    void SetStealMode(StealMode mode);
+
+    /**
+     * @brief Sets the pitch bend range (default 2 semitones).
+     *
+     * @param semitones Bend at either end of the pitch bend wheel, from 1 to 16.
+     */
+    void SetBendRange(uint8_t semitones);
+
+    /**
+     * @brief Ends every note, including those held by the sustain pedal.
+     */
+    void AllNotesOff();
+
+private:
+    static constexpr uint8_t NUM_EFFECTS = 5;                   /* $J, $L, $A, $D, $R. */
+    static constexpr uint8_t PENDING_PROGRAM = (1<<NUM_EFFECTS);
+
+    struct VOICE {
+        uint16_t    stamp;          /* Value of `clock` when the note started or ended. */
+        uint8_t     note;
+        uint8_t     velocity;       /* 0 while the voice is free. */
+    };
+
+    void dispatch(uint8_t status, uint8_t data1, uint8_t data2);
+    void note_on(uint8_t note, uint8_t velocity);
+    void note_off(uint8_t note);
+    void control_change(uint8_t number, uint8_t value);
+    void release_voice(uint8_t v);
+    bool send_note_on(uint8_t v);
+    void send_bend();
+    void send_effect(uint8_t index, int16_t value);
+    bool send_effect_to(uint8_t v, uint8_t index);
+#if PSGINO_MML_INSTRUMENTS
+    void send_program(uint8_t program);
+#endif
+    void send_pending();
+    uint8_t find_voice(uint8_t note) const;
+    uint8_t alloc_voice() const;
+
+    Psgino      *chips[PSGINO_MIDI_MAX_CHIPS];
+    VOICE       voices[MAX_VOICES];
+    uint32_t    sustained;          /* Voices whose note off waits for the sustain pedal. */
+    uint32_t    pending_on;         /* Voices whose NoteOn found the queue full. */
+    uint32_t    pending_off;        /* Voices whose NoteOff found the queue full. */
+    uint32_t    pending_bend;       /* Voices whose SetPitchBend found the queue full. */
+    uint16_t    clock;
+    int16_t     bend;               /* Degrees. */
+    int16_t     effects[NUM_EFFECTS];       /* Last value of each effect of the control changes. */
+    uint8_t     pending_fx[MAX_VOICES];     /* Effects (bits by index) and program change (PENDING_PROGRAM) that found the queue full. */
+    bool        is_fx_pending;      /* Set while any pending_fx bit is set. */
+#if PSGINO_MML_INSTRUMENTS
+    uint8_t     program;            /* Last program change. */
+#endif
+    uint8_t     num_voices;
+    uint8_t     midi_ch;
+    uint8_t     status;             /* Running status, 0 when data bytes are skipped. */
+    uint8_t     data1;
+    uint8_t     num_data;
+    uint8_t     steal_mode;
+    uint8_t     bend_range;
+    uint8_t     volume;             /* CC7. */
+    bool        is_sustain;         /* CC64. */
+};
+
+#endif
+
+#endif/*PSGINO_MIDI_H*/
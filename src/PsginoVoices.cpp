@@ -0,0 +1,291 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include "PsginoVoices.h"
+
+#if PSGINO_USE_LIVE_NOTE
+
+namespace {
+
+    constexpr uint8_t NO_VOICE          = (0xFF);
+    constexpr uint8_t VOICE_ON          = (0x01);
+    constexpr uint8_t VOICE_RETRIGGER   = (0x02);   /* The note changed since it was sent. */
+    constexpr uint8_t ALL_CHANNELS      = ((1 << PsgCtrl::NUM_CHANNEL) - 1);
+}
+
+PsginoVoices::PsginoVoices() {
+
+    this->Initialize(nullptr);
+}
+
+PsginoVoices::PsginoVoices(Psgino *psgino) {
+
+    this->Initialize(psgino);
+}
+
+void PsginoVoices::Initialize(Psgino *psgino) {
+
+    this->psgino = psgino;
+
+    for ( uint8_t v = 0; v < MAX_VOICES; v++ ) {
+
+        this->voices[v] = (VOICE){};
+    }
+
+    for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+        this->ch_voice[ch] = NO_VOICE;
+    }
+
+    this->clock = 0;
+    this->ch_mask = ALL_CHANNELS;
+    this->arp_period = 0;
+    this->arp_count = 0;
+    this->arp_voice = NO_VOICE;
+}
+
+bool PsginoVoices::VoiceOn(uint8_t voice, uint8_t note, uint8_t volume, uint8_t priority) {
+
+    if ( voice >= MAX_VOICES ) {
+
+        return false;
+    }
+
+    this->voices[voice].note = note;
+    this->voices[voice].volume = volume;
+    this->voices[voice].priority = priority;
+    this->voices[voice].state = VOICE_ON | VOICE_RETRIGGER;
+    this->voices[voice].stamp = this->clock++;
+
+    return true;
+}
+
+void PsginoVoices::VoiceOff(uint8_t voice) {
+
+    if ( voice < MAX_VOICES ) {
+
+        this->voices[voice].state = 0;
+    }
+}
+
+void PsginoVoices::AllVoicesOff() {
+
+    for ( uint8_t v = 0; v < MAX_VOICES; v++ ) {
+
+        this->voices[v].state = 0;
+    }
+}
+
+void PsginoVoices::SetChannelMask(uint8_t mask) {
+
+    this->ch_mask = mask & ALL_CHANNELS;
+}
+
+void PsginoVoices::SetArpeggio(uint8_t period) {
+
+    this->arp_period = period;
+    this->arp_count = 0;
+}
+
+uint8_t PsginoVoices::GetVoiceChannel(uint8_t voice) const {
+
+    for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+        if ( ( this->ch_voice[ch] == voice ) && ( voice != NO_VOICE ) ) {
+
+            return ch;
+        }
+    }
+
+    return NO_CHANNEL;
+}
+
+void PsginoVoices::Proc() {
+
+    uint8_t sel[PsgCtrl::NUM_CHANNEL];      /* Voices of the highest priority, best first. */
+    uint8_t target[PsgCtrl::NUM_CHANNEL];   /* Voice that each channel is to play. */
+    uint8_t num_ch = 0;
+    uint8_t num_sel = 0;
+    uint8_t num_on = 0;
+
+    if ( this->psgino == nullptr ) {
+
+        return;
+    }
+
+    for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+        target[ch] = NO_VOICE;
+        if ( this->ch_mask & (1 << ch) ) {
+
+            num_ch++;
+        }
+    }
+
+    /* SELECT: insertion into a list of at most num_ch voices, one pass over the voices. */
+    for ( uint8_t v = 0; v < MAX_VOICES; v++ ) {
+
+        uint8_t i;
+
+        if ( ( this->voices[v].state & VOICE_ON ) == 0 ) {
+
+            continue;
+        }
+
+        num_on++;
+
+        if ( num_sel < num_ch ) {
+
+            i = num_sel++;
+        } else if ( ( num_ch > 0 ) && this->is_before(v, sel[num_ch-1]) ) {
+
+            i = num_ch-1;
+        } else {
+
+            continue;
+        }
+
+        while ( ( i > 0 ) && this->is_before(v, sel[i-1]) ) {
+
+            sel[i] = sel[i-1];
+            i--;
+        }
+        sel[i] = v;
+    }
+
+    /* The last channel is shared by the voices left over. */
+    bool is_arp = ( this->arp_period > 0 ) && ( num_on > num_ch ) && ( num_ch > 0 );
+    if ( is_arp ) {
+
+        num_sel = num_ch-1;
+    }
+
+    /* ALLOT: a chosen voice keeps its channel, the others take the free ones. */
+    for ( uint8_t i = 0; i < num_sel; i++ ) {
+
+        for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+            if ( ( this->ch_mask & (1 << ch) ) && ( this->ch_voice[ch] == sel[i] ) ) {
+
+                target[ch] = sel[i];
+                sel[i] = NO_VOICE;
+                break;
+            }
+        }
+    }
+
+    for ( uint8_t i = 0; i < num_sel; i++ ) {
+
+        if ( sel[i] == NO_VOICE ) {
+
+            continue;
+        }
+
+        for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+            if ( ( this->ch_mask & (1 << ch) ) && ( target[ch] == NO_VOICE ) ) {
+
+                target[ch] = sel[i];
+                break;
+            }
+        }
+    }
+
+    /* ARPEGGIO: the one channel left plays the next voice that has none. */
+    if ( is_arp ) {
+
+        uint8_t shared = 0;
+        bool is_next;
+
+        while ( ( ( this->ch_mask & (1 << shared) ) == 0 ) || ( target[shared] != NO_VOICE ) ) {
+
+            shared++;
+        }
+
+        is_next = ( this->arp_voice >= MAX_VOICES );
+        is_next = is_next || ( ( this->voices[this->arp_voice].state & VOICE_ON ) == 0 );
+        for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+            is_next |= ( target[ch] == this->arp_voice );
+        }
+        is_next = is_next || ( ++this->arp_count >= this->arp_period );
+
+        if ( is_next ) {
+
+            this->arp_voice = this->next_arp_voice(target, PsgCtrl::NUM_CHANNEL);
+            this->arp_count = 0;
+        }
+
+        target[shared] = this->arp_voice;
+    } else {
+
+        this->arp_count = 0;
+    }
+
+    /* SEND: only the channels whose voice or note has changed. */
+    for ( uint8_t ch = 0; ch < PsgCtrl::NUM_CHANNEL; ch++ ) {
+
+        uint8_t v = target[ch];
+
+        if ( v == NO_VOICE ) {
+
+            if ( ( this->ch_voice[ch] != NO_VOICE ) && this->psgino->NoteOff(ch) ) {
+
+                this->ch_voice[ch] = NO_VOICE;
+            }
+        } else if ( ( this->ch_voice[ch] != v ) || ( this->voices[v].state & VOICE_RETRIGGER ) ) {
+
+            if ( this->psgino->NoteOn(ch, this->voices[v].note, this->voices[v].volume) ) {
+
+                this->ch_voice[ch] = v;
+                this->voices[v].state &= ~VOICE_RETRIGGER;
+            }
+        } else {
+        }
+    }
+}
+
+bool PsginoVoices::is_before(uint8_t a, uint8_t b) const {
+
+    if ( this->voices[a].priority != this->voices[b].priority ) {
+
+        return ( this->voices[a].priority > this->voices[b].priority );
+    }
+
+    /* The newer note first. */
+    return static_cast<uint16_t>(this->clock - this->voices[a].stamp)
+         < static_cast<uint16_t>(this->clock - this->voices[b].stamp);
+}
+
+uint8_t PsginoVoices::next_arp_voice(const uint8_t *busy, uint8_t num_busy) const {
+
+    uint8_t v = ( this->arp_voice < MAX_VOICES ) ? this->arp_voice : MAX_VOICES-1;
+
+    for ( uint8_t n = 0; n < MAX_VOICES; n++ ) {
+
+        bool is_busy = false;
+
+        v = ( v+1 < MAX_VOICES ) ? v+1 : 0;
+
+        if ( ( this->voices[v].state & VOICE_ON ) == 0 ) {
+
+            continue;
+        }
+
+        for ( uint8_t i = 0; i < num_busy; i++ ) {
+
+            is_busy |= ( busy[i] == v );
+        }
+
+        if ( !is_busy ) {
+
+            return v;
+        }
+    }
+
+    return NO_VOICE;
+}
+
+#endif
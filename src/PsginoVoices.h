@@ -0,0 +1,166 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef PSGINO_VOICES_H
+#define PSGINO_VOICES_H
+
+#include "Psgino.h"
+
+#if PSGINO_USE_LIVE_NOTE
+
+static_assert(
+    ( PSGINO_VIRTUAL_VOICES >= 1 ) && ( PSGINO_VIRTUAL_VOICES <= 64 ),
+    "PSGINO_VIRTUAL_VOICES must be between 1 and 64"
+);
+
+/**
+ * @class PsginoVoices
+ * @brief Plays more logical voices than the PSG has channels, on the live channels of a Psgino.
+ *
+ * Requires `PSGINO_USE_LIVE_NOTE=1`.
+ *
+ * A voice is a note that the program starts and ends (`VoiceOn()`, `VoiceOff()`) with a
+ * priority. `Proc()` gives the channels that the voices may use (see `SetChannelMask()`) to the
+ * voices of the highest priority, the newest note first on a tie. A voice without a channel is
+ * silent but keeps its note, and sounds again as soon as a channel is free, so a part that loses
+ * its channel to a sound effect comes back with it. With `SetArpeggio()`, when there are more
+ * voices than channels, the last channel plays the voices left over in turn, a few ticks each,
+ * so that a chord keeps its harmony as an arpeggio.
+ *
+ * A voice keeps its channel while it is chosen, and a channel only gets a command when its
+ * voice changes, so `Proc()` sends at most one command per channel. Its time is proportional
+ * to the number of voices. Call every method of the class from the same context, and
+ * `Proc()` once before each `Proc()` of the Psgino:
+ *
+ * @code
+ * voices.Proc();
+ * psgino.Proc();
+ * @endcode
+ */
+class PsginoVoices {
+public:
+    /**
+     * @brief Maximum number of voices.
+     */
+    static constexpr uint8_t MAX_VOICES = PSGINO_VIRTUAL_VOICES;
+
+    /**
+     * @brief Value returned by `GetVoiceChannel()` for a voice that has no channel.
+     */
+    static constexpr uint8_t NO_CHANNEL = 0xFF;
+
+    /**
+     * @brief Default constructor for PsginoVoices. Call `Initialize()` before `Proc()`.
+     */
+    PsginoVoices();
+
+    /**
+     * @brief Parameterized constructor for PsginoVoices.
+     *
+     * @param psgino Psgino instance whose channels play the voices.
+     */
+    explicit PsginoVoices(Psgino *psgino);
+
+    /**
+     * @brief Sets the Psgino instance, and clears the voices and settings.
+     *
+     * @param psgino Psgino instance whose channels play the voices.
+     */
+    void Initialize(Psgino *psgino);
+
+    /**
+     * @brief Starts a note on a voice, or replaces the note of the voice.
+     *
+     * The note starts in the next `Proc()` call if the voice gets a channel.
+     *
+     * @param voice Voice (0 to `MAX_VOICES`-1).
+     * @param note Note number, as in the `N` command of the MML (0 to 95).
+     * @param volume Volume level, as in the `V` command (0 to 15).
+     * @param priority Priority of the voice; a higher value takes a channel first.
+     * @return false if the voice is out of range.
+     */
+    bool VoiceOn(uint8_t voice, uint8_t note, uint8_t volume = 15, uint8_t priority = 0);
+
+    /**
+     * @brief Ends the note of a voice, and frees its channel in the next `Proc()` call.
+     *
+     * @param voice Voice (0 to `MAX_VOICES`-1).
+     */
+    void VoiceOff(uint8_t voice);
+
+    /**
+     * @brief Ends the notes of every voice.
+     */
+    void AllVoicesOff();
+
+    /**
+     * @brief Sets the channels that the voices may use (default 0x7, all three).
+     *
+     * A channel removed from the mask is released in the next `Proc()` call, and its voice
+     * moves to another channel if its priority allows. For example, give channel C up while
+     * a sound effect of PsginoZ plays:
+     *
+     * @code
+     * voices.SetChannelMask(( psgino_z.GetSeStatus() == Psgino::Playing ) ? 0x3 : 0x7);
+     * @endcode
+     *
+     * Channels the voices have never used are left to the MML.
+     *
+     * @param mask Bit n set allows channel n.
+     */
+    void SetChannelMask(uint8_t mask);
+
+    /**
+     * @brief Sets the arpeggio of the voices that find no channel.
+     *
+     * With a period, when there are more voices than channels, the voices of the highest
+     * priority keep all channels but the last, which plays each of the other voices for
+     * `period` `Proc()` calls in turn, in the order of the voice numbers.
+     *
+     * @param period Calls per note of the arpeggio, or 0 to leave these voices silent (default).
+     */
+    void SetArpeggio(uint8_t period);
+
+    /**
+     * @brief Gets the channel that plays a voice.
+     *
+     * @param voice Voice (0 to `MAX_VOICES`-1).
+     * @return The channel (0 to 2), or `NO_CHANNEL` if the voice is silent.
+     */
+    uint8_t GetVoiceChannel(uint8_t voice) const;
+
+    /**
+     * @brief Allots the channels to the voices, and sends the notes that change.
+     *
+     * Call this at `proc_freq`, before `Proc()` of the Psgino. A command that finds the queue
+     * full is sent again in the next call.
+     */
+    void Proc();
+
+private:
+    struct VOICE {
+        uint16_t    stamp;          /* Value of `clock` when the note started. */
+        uint8_t     note;
+        uint8_t     volume;
+        uint8_t     priority;
+        uint8_t     state;          /* VOICE_* flags. */
+    };
+
+    bool is_before(uint8_t a, uint8_t b) const;
+    uint8_t next_arp_voice(const uint8_t *busy, uint8_t num_busy) const;
+
+    Psgino      *psgino;
+    VOICE       voices[MAX_VOICES];
+    uint8_t     ch_voice[PsgCtrl::NUM_CHANNEL];     /* Voice that the channel plays, as sent. */
+    uint16_t    clock;
+    uint8_t     ch_mask;
+    uint8_t     arp_period;
+    uint8_t     arp_count;
+    uint8_t     arp_voice;
+};
+
+#endif
+
+#endif/*PSGINO_VOICES_H*/
@@ -9,7 +9,9 @@
 namespace PsgCtrl {
 namespace {
 
-    bool parse_mml_header(SLOT &slot, const char **pp_text);
+    bool parse_mml_header(MML_LAYOUT &layout, const char **pp_text);
+    int split_mml(const SLOT &slot, const char *p_mml, uint16_t mode, MML_LAYOUT &layout);
+    void apply_mml_layout(SLOT &slot, const MML_LAYOUT &layout);
 
     int16_t decode_mml(SLOT &slot, uint8_t ch);
     void decode_dollar(
@@ -24,6 +26,16 @@ namespace {
             const char **pp_pos,
             const char *p_tail
     );
+#if PSGINO_USE_MML_PATTERN
+    void call_mml_pattern(SLOT &slot, uint8_t ch, const char **pp_pos, const char **pp_tail);
+    void return_mml_pattern(SLOT &slot, uint8_t ch, const char **pp_pos, const char **pp_tail);
+#endif
+#if PSGINO_MML_INSTRUMENTS
+    void compile_instrument(SLOT &slot, uint8_t index, uint16_t tempo);
+    void compile_instruments(SLOT &slot);
+    void select_instrument(SLOT &slot, uint8_t ch, uint8_t index);
+#endif
+    uint8_t get_loop_base(const CHANNEL_INFO *p_ch_info);
 
     const char * read_number_ex(
             const char *p_pos,
@@ -53,6 +65,11 @@ namespace {
 
     uint16_t shift_tp(uint16_t tp, int16_t bias);
     uint16_t calc_tp(int16_t n, uint32_t s_clock);
+    uint16_t calc_note_tp(const SLOT &slot, const CHANNEL_INFO *p_ch_info, int16_t note_num);
+#if PSGINO_USE_DECODE_AHEAD
+    uint16_t get_staged_tp(const SLOT &slot, const CHANNEL_INFO *p_ch_info, int16_t note_num);
+    void stage_next_tone(SLOT &slot, uint8_t ch);
+#endif
     uint8_t get_tp_table_column_number(const char note_name);
     const char * shift_half_note_number(
             const char *p_pos,
@@ -60,6 +77,7 @@ namespace {
             int16_t note_num,
             int16_t *p_out
     );
+#if PSGINO_USE_PITCHBEND
     const char * get_legato_end_note_num(
             const char *p_pos,
             const char *p_tail,
@@ -67,6 +85,7 @@ namespace {
             int32_t *p_out,
             int16_t start_note_num
     );
+#endif
     const char * count_dot(
             const char *p_pos,
             const char *p_tail,
@@ -85,16 +104,33 @@ namespace {
             const char *p_tail,
             uint32_t q12_exclude_note_len
     );
-
+    void start_tone(SLOT &slot, uint8_t ch, uint16_t tp, uint16_t tp_end);
+    void write_tone_volume(SLOT &slot, uint8_t ch);
+#if PSGINO_USE_LIVE_NOTE
+    CHANNEL_INFO *take_live_channel(SLOT &slot, uint8_t ch);
+    void live_note_on(SLOT &slot, uint8_t ch, int16_t note_num, int16_t volume);
+    void live_note_off(SLOT &slot, uint8_t ch);
+    void set_live_pitchbend(SLOT &slot, uint8_t ch, int16_t degrees);
+    void set_live_effect(SLOT &slot, uint8_t ch, char code, int16_t value);
+#endif
+
+#if PSGINO_USE_PITCHBEND
     void init_pitchbend(SLOT &slot, uint8_t ch);
     void proc_pitchbend(SLOT &slot, uint8_t ch);
+#endif
 
+#if PSGINO_USE_NOISE_SWEEP
     void init_noise_sweep(SLOT &slot, uint8_t ch);
     void proc_noise_sweep(SLOT &slot);
+#endif
 
+#if PSGINO_USE_LFO
     int16_t get_lfo_speed(int16_t freq_value, uint16_t speed_unit, uint16_t tempo);
+    uint32_t get_lfo_omega(const SLOT &slot, const CHANNEL_INFO *p_ch_info);
     void proc_lfo(SLOT &slot, uint8_t ch);
+#endif
 
+#if PSGINO_USE_SW_ENV
     uint16_t sw_env_time2tk(
             uint16_t env_time,
             uint16_t time_unit,
@@ -105,10 +141,32 @@ namespace {
     void trans_sw_env_state(SLOT &slot, uint8_t ch);
     void update_sw_env_volume(SLOT &slot, uint8_t ch);
     void proc_sw_env_gen(SLOT &slot, uint8_t ch);
+#endif
 
     void reset_ch_info(CHANNEL_INFO *p_ch_info);
+    const char *get_mml_pos(SLOT &slot, uint8_t ch, MML_OFS ofs, const char **pp_tail);
+    MML_OFS get_mml_ofs(const SLOT &slot, uint8_t ch, const char *p_pos);
+    bool is_mml_tail(const SLOT &slot, uint8_t ch);
+#if PSGINO_USE_MML_STREAM
+    void load_mml_window(SLOT &slot, uint8_t ch, MML_OFS ofs);
+#endif
     void reset_psg(PSG_REG &psg_reg);
     void rewind_mml(SLOT &slot);
+    void restart_channels(SLOT &slot);
+#if PSGINO_USE_MML_QUEUE
+    bool is_next_mml_pending(const SLOT &slot, bool at_loop);
+    void switch_to_next_mml(SLOT &slot);
+#endif
+    void take_posted_mml(SLOT &slot);
+    void drain_commands(SLOT &slot);
+    void post_layout(SLOT &slot, const MML_LAYOUT &layout);
+    const char *get_mml_head(const SLOT &slot);
+#if PSGINO_USE_SEEK
+    void run_silently(SLOT &slot, uint32_t song_tick);
+    void save_seek_point(const SLOT &slot, SEEK_POINT &point);
+    void load_seek_point(SLOT &slot, const SEEK_POINT &point);
+#endif
+    void split_song(const SLOT &slot, const SONG_HEADER *p_header, MML_LAYOUT &layout);
 
     void skip_white_space(const char **pp_text);
     inline char to_upper_case(char c) {
@@ -120,6 +178,26 @@ namespace {
         return c;
     }
 
+    inline bool is_note_command(const char c) {
+
+        switch ( to_upper_case(c) ) {
+        case 'A': /*@fallthrough@*/
+        case 'B': /*@fallthrough@*/
+        case 'C': /*@fallthrough@*/
+        case 'D': /*@fallthrough@*/
+        case 'E': /*@fallthrough@*/
+        case 'F': /*@fallthrough@*/
+        case 'G': /*@fallthrough@*/
+        case 'H': /*@fallthrough@*/
+        case 'J': /*@fallthrough@*/
+        case 'N': /*@fallthrough@*/
+        case 'R':
+            return true;
+        default:
+            return false;
+        }
+    }
+
     inline bool is_white_space(const char c) {
 
         switch(c) {
@@ -157,6 +235,88 @@ namespace {
               );
     }
 
+    inline uint16_t get_proc_freq(const SLOT &slot) {
+
+#if PSGINO_PROC_FREQ
+        /* Fixed at build time, so divisions by the processing frequency fold into multiplications. */
+        (void)slot;
+        return PSGINO_PROC_FREQ;
+#else
+        return slot.gl_info.proc_freq;
+#endif
+    }
+
+    inline uint16_t get_timer_speed_factor(const SLOT &slot) {
+
+#if PSGINO_USE_SONG_CLOCK
+        /* Timers count in song ticks; the speed factor is applied by the phase accumulator in control_psg. */
+        (void)slot;
+        return DEFAULT_SPEED_FACTOR;
+#else
+        return slot.gl_info.speed_factor;
+#endif
+    }
+
+    /* Accumulates the time of each phase of one control_psg() call. Empty when the instrumentation is disabled. */
+    struct TIMING_PROBE {
+#if PSGINO_USE_TIMING_STATS
+        uint32_t    t_start;
+        uint32_t    t_mark;
+        uint32_t    cycles[TIMING_PHASE_CONTROL];
+#endif
+    };
+
+    inline void timing_begin(SLOT &slot, TIMING_PROBE &probe) {
+
+#if PSGINO_USE_TIMING_STATS
+        slot.timing.is_recorded = false;
+        probe = (TIMING_PROBE){};
+        probe.t_start = read_timing_counter(slot);
+        probe.t_mark = probe.t_start;
+#else
+        (void)slot;
+        (void)probe;
+#endif
+    }
+
+    inline void timing_mark(const SLOT &slot, TIMING_PROBE &probe, uint8_t phase) {
+
+#if PSGINO_USE_TIMING_STATS
+        uint32_t now = read_timing_counter(slot);
+        probe.cycles[phase] += now - probe.t_mark;
+        probe.t_mark = now;
+#else
+        (void)slot;
+        (void)probe;
+        (void)phase;
+#endif
+    }
+
+    inline void timing_end(SLOT &slot, TIMING_PROBE &probe) {
+
+#if PSGINO_USE_TIMING_STATS
+        if ( slot.timing.p_counter == nullptr ) {
+
+            return;
+        }
+
+        for ( uint8_t i = 0; i < TIMING_PHASE_CONTROL; i++ ) {
+
+            add_timing_sample(slot, i, probe.cycles[i]);
+        }
+        add_timing_sample(slot, TIMING_PHASE_CONTROL, probe.t_mark - probe.t_start);
+        slot.timing.is_recorded = true;
+#else
+        (void)slot;
+        (void)probe;
+#endif
+    }
+
+    void run_song_tick(SLOT &slot, TIMING_PROBE &probe);
+#if PSGINO_USE_LIVE_NOTE
+    void run_live_tick(SLOT &slot, TIMING_PROBE &probe);
+#endif
+
     inline uint8_t clamp_channel(uint8_t ch) {
         if ( ch >= NUM_CHANNEL ) {
             // Should never reach here.
@@ -165,6 +325,19 @@ namespace {
         return ch;
     }
 
+    /* A live channel is played by the live commands instead of the MML. */
+    inline bool is_live_channel(const SLOT &slot, uint8_t ch) {
+
+#if PSGINO_USE_LIVE_NOTE
+        return ( ( slot.gl_info.live_mask & (1<<ch) ) != 0 );
+#else
+        (void)slot;
+        (void)ch;
+        return false;
+#endif
+    }
+
+#if PSGINO_USE_SW_ENV
     uint16_t sw_env_time2tk(
             uint16_t env_time,
             uint16_t time_unit,
@@ -187,7 +360,9 @@ namespace {
             return 0;
         }
     }
+#endif
 
+#if PSGINO_USE_LFO
     int16_t get_lfo_speed(int16_t freq_value, uint16_t speed_unit, uint16_t tempo) {
 
         if ( speed_unit == 0 ) {
@@ -202,6 +377,29 @@ namespace {
         }
     }
 
+    uint32_t get_lfo_omega(const SLOT &slot, const CHANNEL_INFO *p_ch_info) {
+
+        uint16_t speed_abs;
+        uint32_t q6_omega;
+
+        if ( p_ch_info->lfo.speed > 0 ) {
+
+            speed_abs = p_ch_info->lfo.speed;
+
+        } else {
+
+            speed_abs = p_ch_info->lfo.speed * -1;
+        }
+        speed_abs = (static_cast<uint32_t>(speed_abs) * get_timer_speed_factor(slot) + 50)/100;
+
+        q6_omega = 1<<6;
+        q6_omega *= static_cast<uint32_t>(p_ch_info->lfo.depth)*4*speed_abs;
+        q6_omega /= (static_cast<uint16_t>(get_proc_freq(slot))*MAX_LFO_PERIOD);
+
+        return q6_omega;
+    }
+#endif
+
     void skip_white_space(const char **pp_text) {
 
         size_t n = MAX_MML_TEXT_LEN;
@@ -217,10 +415,11 @@ namespace {
         }
     }
 
-    bool parse_mml_header(SLOT &slot, const char **pp_text) {
+    bool parse_mml_header(MML_LAYOUT &layout, const char **pp_text) {
 
         const char *p_pos;
         bool parse_cont;
+        bool is_parsed = false;
         long value;
 
         /* MML header sections must start with a colon (:). */
@@ -231,6 +430,9 @@ namespace {
         }
 
         p_pos = *pp_text + 1;
+#if PSGINO_USE_MML_HEADER_DEFS
+        layout.header.p_mml_top = *pp_text;
+#endif
 
         /* The MML version number must start immediately after the colon. */
         if ( to_upper_case(*p_pos) == 'V' ) {
@@ -240,7 +442,7 @@ namespace {
             /* Here is a provisional implementation. This processing will change according to the MML version upgrade. */
             if ( value == 1 ) {
 
-                slot.gl_info.mml_version = 1;
+                layout.mml_version = 1;
             }
         }
 
@@ -251,11 +453,74 @@ namespace {
 
             case 'M':
                 value = std::strtol(&p_pos[1], const_cast<char**>(&p_pos), 10);
-                slot.gl_info.sys_status.RH_LEN = (( value & 0x1 ) != 0) ? 1 : 0;
+                layout.rh_len = (( value & 0x1 ) != 0) ? 1 : 0;
+                break;
+
+            case 'P': /*@fallthrough@*/
+            case 'I':
+            {
+                /* Pattern P<n>{...} or instrument I<n>{...}. The body is skipped here and used by @P<n> or @I<n>. */
+                const char kind = to_upper_case(*p_pos);
+                const char *p_body;
+
+                value = std::strtol(&p_pos[1], const_cast<char**>(&p_pos), 10);
+                if ( *p_pos != '{' ) {
+
+                    break;
+                }
+                p_body = ++p_pos;
+                while ( ( *p_pos != '}' ) && ( *p_pos != ';' ) && ( *p_pos != '\0' ) ) {
+
+                    p_pos++;
+                }
+                if ( *p_pos != '}' ) {
+
+                    /* Unterminated body: the header ends at the ';' or fails. */
+                    break;
+                }
+                p_pos++;
+#if PSGINO_USE_MML_HEADER_DEFS
+                if ( ( value >= 0 ) &&
+                     ( static_cast<size_t>(p_pos - layout.header.p_mml_top) <= MAX_MML_TEXT_LEN )
+                ) {
+
+                    const MML_OFS ofs_body = static_cast<MML_OFS>(p_body - layout.header.p_mml_top);
+
+#if PSGINO_USE_MML_PATTERN
+                    if ( ( kind == 'P' ) && ( value < MAX_MML_PATTERNS ) ) {
+
+                        layout.header.ofs_pattern[value] = ofs_body;
+                    }
+#endif
+#if PSGINO_MML_INSTRUMENTS
+                    if ( ( kind == 'I' ) && ( value < NUM_MML_INSTRUMENTS ) ) {
+
+                        layout.header.ofs_instrument[value] = ofs_body;
+                    }
+#endif
+                    (void)kind;
+                    (void)ofs_body;
+                }
+#else
+                (void)kind;
+                (void)p_body;
+#endif
                 break;
+            }
 
             case ';':
                 /* End of MML header section. */
+                is_parsed = true;
+#if PSGINO_USE_MML_HEADER_DEFS
+                if ( static_cast<size_t>(p_pos - layout.header.p_mml_top) <= MAX_MML_TEXT_LEN ) {
+
+                    layout.header.ofs_header_end = static_cast<MML_OFS>(p_pos - layout.header.p_mml_top);
+
+                } else {
+
+                    layout.header = (MML_HEADER){};
+                }
+#endif
                 p_pos++;
                 parse_cont = false;
                 break;
@@ -274,7 +539,8 @@ namespace {
 
         *pp_text = p_pos;
 
-        return ( **pp_text != '\0' );
+        /* Failed without the ';'. A header alone, which only defines instruments, is valid. */
+        return is_parsed;
     }
 
     const char * count_dot(
@@ -541,6 +807,112 @@ namespace {
         return p;
     }
 
+    uint16_t calc_note_tp(const SLOT &slot, const CHANNEL_INFO *p_ch_info, int16_t note_num) {
+
+        uint16_t tp;
+        int16_t bias;
+
+        bias = static_cast<int16_t>(p_ch_info->tone.BIAS) - BIAS_LEVEL_OFS;
+        /* Apply bias-level to tp. */
+        tp = shift_tp(calc_tp(note_num, slot.gl_info.s_clock), bias);
+
+        /* Apply shift-degs to tp. */
+        tp = shift_tp(tp, slot.gl_info.shift_degrees);
+
+        /* Apply the TP offset to the BIAS calculation result for fine adjustments, such as detuning. */
+        tp = static_cast<uint16_t>(SAT(static_cast<int16_t>(tp) + static_cast<int16_t>(p_ch_info->tone.tp_ofs), MIN_TP, MAX_TP));
+
+        return tp;
+    }
+
+#if PSGINO_USE_DECODE_AHEAD
+    uint16_t get_staged_tp(const SLOT &slot, const CHANNEL_INFO *p_ch_info, int16_t note_num) {
+
+        const STAGED_TONE_INFO *p_staged = &p_ch_info->staged;
+
+        /* The staged value is used only if every input of calc_note_tp() is unchanged. */
+        if ( ( p_staged->VALID == 1 ) &&
+             ( p_staged->note_num == note_num ) &&
+             ( p_staged->BIAS == p_ch_info->tone.BIAS ) &&
+             ( p_staged->tp_ofs == p_ch_info->tone.tp_ofs ) &&
+             ( p_staged->shift_degrees == slot.gl_info.shift_degrees )
+        ) {
+
+            return p_staged->tp;
+        }
+
+        return calc_note_tp(slot, p_ch_info, note_num);
+    }
+
+    void stage_next_tone(SLOT &slot, uint8_t ch) {
+
+        const char *p_pos;
+        const char *p_tail;
+        int16_t note_num;
+        int32_t octave;
+        bool is_found = false;
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+
+        p_ch_info->staged.STAGED = 1;
+        p_ch_info->staged.VALID = 0;
+
+        p_pos  = get_mml_pos(slot, ch, p_ch_info->mml.ofs_mml_pos, &p_tail);
+        octave = p_ch_info->tone.OCTAVE;
+        note_num = 0;
+
+        /* Follow only the octave commands up to the next tone. Anything else ends the scan. */
+        while ( ( p_pos < p_tail ) && !is_found ) {
+
+            char c = to_upper_case(*p_pos);
+
+            if ( ('A' <= c) && (c <= 'G') ) {
+
+                note_num = get_tp_table_column_number(c) + static_cast<int16_t>(octave)*12;
+                shift_half_note_number(p_pos+1, p_tail, note_num, &note_num);
+                is_found = true;
+
+            } else if ( c == 'N' ) {
+
+                note_num = get_param(&p_pos, p_tail, MIN_NOTE_NUMBER, MAX_NOTE_NUMBER, DEFAULT_NOTE_NUMBER);
+                is_found = true;
+
+            } else if ( c == 'O' ) {
+
+                octave = get_param(&p_pos, p_tail, MIN_OCTAVE, MAX_OCTAVE, DEFAULT_OCTAVE) - 1;
+
+            } else if ( c == '<' ) {
+
+                octave = ( octave > (MIN_OCTAVE-1) ) ? (octave-1) : octave;
+                p_pos++;
+
+            } else if ( c == '>' ) {
+
+                octave = ( octave < (MAX_OCTAVE-1) ) ? (octave+1) : octave;
+                p_pos++;
+
+            } else if ( is_white_space(c) ) {
+
+                p_pos++;
+
+            } else {
+
+                return;
+            }
+        }
+
+        if ( is_found ) {
+
+            p_ch_info->staged.tp = calc_note_tp(slot, p_ch_info, note_num);
+            p_ch_info->staged.note_num = note_num;
+            p_ch_info->staged.BIAS = p_ch_info->tone.BIAS;
+            p_ch_info->staged.tp_ofs = p_ch_info->tone.tp_ofs;
+            p_ch_info->staged.shift_degrees = slot.gl_info.shift_degrees;
+            p_ch_info->staged.VALID = 1;
+        }
+    }
+#endif
+
+#if PSGINO_USE_SW_ENV
     uint16_t get_sus_volume(const SLOT &slot, uint8_t ch) {
 
         const CHANNEL_INFO *p_ch_info = slot.ch_info_list[clamp_channel(ch)];
@@ -566,7 +938,7 @@ namespace {
             return;
         }
 
-        q12_time_factor = (100 << 12) / slot.gl_info.speed_factor;
+        q12_time_factor = (100 << 12) / get_timer_speed_factor(slot);
 
         switch ( p_ch_info->ch_status.SW_ENV_STAT ) {
 
@@ -634,7 +1006,9 @@ namespace {
             break;
         }
     }
+#endif
 
+#if PSGINO_USE_PITCHBEND
     void init_pitchbend(SLOT &slot, uint8_t ch) {
 
         uint16_t tp_end;
@@ -759,7 +1133,9 @@ namespace {
         p_ch_info->pitchbend.TP_INT  = tp_int;
         p_ch_info->pitchbend.TP_FRAC = q6_tp&0x3F;
     }
+#endif
 
+#if PSGINO_USE_NOISE_SWEEP
     void init_noise_sweep(SLOT &slot, uint8_t ch) {
 
         uint16_t np_end;
@@ -879,7 +1255,9 @@ namespace {
         p_noise_info->NP_INT  = np_int;
         p_noise_info->NP_FRAC = q6_np&0x3F;
     }
+#endif
 
+#if PSGINO_USE_PITCHBEND
     const char * get_legato_end_note_num(
             const char *p_pos,
             const char *p_tail,
@@ -957,6 +1335,7 @@ namespace {
 
         return p_pos;
     }
+#endif
 
     uint32_t get_note_on_time(
             uint8_t note_len,
@@ -993,13 +1372,19 @@ namespace {
     ) {
 
         int32_t param;
+#if PSGINO_USE_LFO
         uint8_t dot_cnt;
         uint32_t q12_delay_tk;
+#endif
+#if !PSGINO_USE_SW_ENV && !PSGINO_USE_LFO
+        (void)proc_freq;
+#endif
 
         (*pp_pos)++;
 
         switch ( to_upper_case(**pp_pos) ) {
 
+#if PSGINO_USE_SW_ENV
         case 'A':
             param = get_param(
                 pp_pos,
@@ -1087,7 +1472,9 @@ namespace {
             );
             p_info->sw_env.time_unit = param;
             break;
+#endif
 
+#if PSGINO_USE_LFO
         case 'V':
             param = get_param(
                 pp_pos,
@@ -1109,6 +1496,7 @@ namespace {
             );
             p_info->ch_status.LFO_MODE = param;
             break;
+#endif
 
         case 'B':
             param = get_param(
@@ -1132,6 +1520,7 @@ namespace {
             p_info->tone.tp_ofs = param;
             break;
 
+#if PSGINO_USE_LFO
         case 'L':
             param = get_param(
                 pp_pos,
@@ -1182,7 +1571,9 @@ namespace {
             );
             p_info->lfo.delay_tk = (q12_delay_tk>>12)&0xFFFF;
             break;
+#endif
 
+#if PSGINO_USE_PITCHBEND
         case 'P':
             param = get_param(
                 pp_pos,
@@ -1193,6 +1584,7 @@ namespace {
             );
             p_info->pitchbend.level = param;
             break;
+#endif
 
         case '<':
             if ( p_info->tone.VOLUME > MIN_VOLUME_LEVEL ) {
@@ -1210,6 +1602,44 @@ namespace {
             (*pp_pos)++;
             break;
 
+#if !PSGINO_USE_SW_ENV
+        case 'A': /*@fallthrough@*/
+        case 'D': /*@fallthrough@*/
+        case 'E': /*@fallthrough@*/
+        case 'F': /*@fallthrough@*/
+        case 'H': /*@fallthrough@*/
+        case 'R': /*@fallthrough@*/
+        case 'S': /*@fallthrough@*/
+        case 'U': /*@fallthrough@*/
+#endif
+#if !PSGINO_USE_LFO
+        case 'V': /*@fallthrough@*/
+        case 'M': /*@fallthrough@*/
+        case 'L': /*@fallthrough@*/
+        case 'J': /*@fallthrough@*/
+#endif
+#if !PSGINO_USE_PITCHBEND
+        case 'P': /*@fallthrough@*/
+#endif
+#if !PSGINO_USE_SW_ENV || !PSGINO_USE_LFO || !PSGINO_USE_PITCHBEND
+            /* Removed at build time: skip the parameter. */
+            param = get_param(pp_pos, p_tail, 0, 0, 0);
+            (void)param;
+            break;
+#endif
+
+#if !PSGINO_USE_LFO
+        case 'T':
+            /* Removed at build time: skip the parameter and the dots. */
+            param = get_param(pp_pos, p_tail, 0, 0, 0);
+            (void)param;
+            while ( ( *pp_pos < p_tail ) && ( **pp_pos == '.' ) ) {
+
+                (*pp_pos)++;
+            }
+            break;
+#endif
+
         default:
             (*pp_pos)++;
             break;
@@ -1226,7 +1656,9 @@ namespace {
 
         const char *p_pos;
         int16_t note_num;
+#if PSGINO_USE_PITCHBEND
         int32_t legato_end_note_num;
+#endif
         int32_t note_len;
         char head;
         uint8_t dot_cnt;
@@ -1244,7 +1676,9 @@ namespace {
         head = to_upper_case(p_pos[0]);
 
         note_num = 0;
+#if PSGINO_USE_PITCHBEND
         legato_end_note_num = 0;
+#endif
         note_len = 0;
         dot_cnt = 0;
         is_start_legato_effect = false;
@@ -1292,6 +1726,7 @@ namespace {
             if ( *p_pos == '&' ) {
 
                 is_start_legato_effect = true;
+#if PSGINO_USE_PITCHBEND
                 p_pos = get_legato_end_note_num(
                         p_pos+1,
                         p_tail,
@@ -1299,6 +1734,10 @@ namespace {
                         &legato_end_note_num,
                         note_num
                 );
+#else
+                /* Without pitchbend the notes are only tied. */
+                p_pos++;
+#endif
 
             } else {
 
@@ -1372,7 +1811,11 @@ namespace {
                 slot.psg_reg.data[0x6] = np_base&0x1F;
                 slot.psg_reg.flags_addr |= 1<<0x6;
 
+#if PSGINO_USE_NOISE_SWEEP
                 slot.gl_info.noise_info.NP_END = np_end&0x1F;
+#else
+                (void)np_end;
+#endif
 
                 /* Count Dot-Repetition */
                 dot_cnt = 0;
@@ -1387,7 +1830,9 @@ namespace {
 
                 if ( note_type == E_NOTE_TYPE_NOISE ) {
 
+#if PSGINO_USE_NOISE_SWEEP
                     slot.gl_info.noise_info.NP_END = slot.gl_info.noise_info.NP_I;
+#endif
                     slot.psg_reg.data[0x6] = slot.gl_info.noise_info.NP_I;
                     slot.psg_reg.flags_addr |= 1<<0x6;
                 }
@@ -1443,84 +1888,36 @@ namespace {
 
             uint16_t tp;
             uint16_t tp_end;
-            int16_t bias;
-            bias = static_cast<int16_t>(p_ch_info->tone.BIAS) - BIAS_LEVEL_OFS;
-            /* Apply bias-level to tp. */
-            tp = shift_tp(calc_tp(note_num, slot.gl_info.s_clock), bias);
-
-            /* Apply shift-degs to tp. */
-            tp = shift_tp(tp, slot.gl_info.shift_degrees);
-
-            /* Apply the TP offset to the BIAS calculation result for fine adjustments, such as detuning. */
-            tp = static_cast<uint16_t>(SAT(static_cast<int16_t>(tp) + static_cast<int16_t>(p_ch_info->tone.tp_ofs), MIN_TP, MAX_TP));
+#if PSGINO_USE_DECODE_AHEAD
+            tp = get_staged_tp(slot, p_ch_info, note_num);
+#else
+            tp = calc_note_tp(slot, p_ch_info, note_num);
+#endif
 
+#if PSGINO_USE_PITCHBEND
             if ( is_start_legato_effect ) {
 
-                tp_end = shift_tp(calc_tp(legato_end_note_num, slot.gl_info.s_clock), bias);
-
-                /* Apply shift-degs to tp_end. */
-                tp_end = shift_tp(tp_end, slot.gl_info.shift_degrees);
-
-                /* Apply the TP offset to the BIAS calculation result for fine adjustments, such as detuning. */
-                tp_end = static_cast<uint16_t>(SAT(static_cast<int16_t>(tp_end) + static_cast<int16_t>(p_ch_info->tone.tp_ofs), MIN_TP, MAX_TP));
+                tp_end = calc_note_tp(slot, p_ch_info, legato_end_note_num);
 
             } else {
 
                 tp_end = shift_tp(tp, p_ch_info->pitchbend.level);
             }
+#else
+            tp_end = tp;
+#endif
 
-            slot.psg_reg.data[2*ch]     = U16_LO(tp);
-            slot.psg_reg.data[2*ch+1]   = U16_HI(tp);
-            slot.psg_reg.flags_addr    |= 0x3<<(2*ch);
-
-            p_ch_info->pitchbend.TP_INT = tp;
-            p_ch_info->pitchbend.TP_FRAC =0;
-            p_ch_info->pitchbend.TP_END_L = tp_end&0xF;
-            p_ch_info->pitchbend.TP_END_H = (tp_end>>4)&0xFF;
-
-            if ( p_ch_info->ch_status.LFO_MODE != LFO_MODE_OFF ) {
-
-                p_ch_info->ch_status.LFO_STAT = LFO_STAT_RUN;
-
-                if ( p_ch_info->ch_status.LEGATO == 0 ) {
-
-                    uint32_t q12_time_factor;
-                    q12_time_factor = (100 << 12) / slot.gl_info.speed_factor;
-                    p_ch_info->time.lfo_delay = (static_cast<uint32_t>(p_ch_info->lfo.delay_tk) * q12_time_factor + (1<<11)) >> 12;
-                    p_ch_info->lfo.theta = 0;
-                    p_ch_info->lfo.DELTA_FRAC = 0;
-                    p_ch_info->lfo.TP_FRAC = 0;
-                    p_ch_info->lfo.BASE_TP_H = (tp>>8)&0xF;
-                    p_ch_info->lfo.BASE_TP_L = tp&0xFF;
-                }
-
-            } else {
-
-                p_ch_info->ch_status.LFO_STAT = LFO_STAT_STOP;
-            }
+            start_tone(slot, ch, tp, tp_end);
         }
 
         if ( ( note_type == E_NOTE_TYPE_TONE ) ||
              ( note_type == E_NOTE_TYPE_NOISE )
         ) {
 
-            slot.psg_reg.data[0x8+ch] = p_ch_info->tone.VOLUME;
-            slot.psg_reg.flags_addr  |= 1<<(0x8+ch);
-            if ( p_ch_info->tone.HW_ENV != 0 ) {
-
-                slot.psg_reg.data[0x8+ch] |= 1<<4;
-
-                if ( p_ch_info->ch_status.LEGATO == 0 ) {
-
-                    slot.psg_reg.flags_addr |= 0x7<<0xB;
-                }
-
-            } else {
-
-                slot.psg_reg.data[0x8+ch] &= ~(1<<4);
-            }
+            write_tone_volume(slot, ch);
         }
 
+#if PSGINO_USE_SW_ENV
         if ( p_ch_info->ch_status.SW_ENV_MODE != SW_ENV_MODE_OFF ) {
 
             if ( note_type == E_NOTE_TYPE_REST ) {
@@ -1544,6 +1941,7 @@ namespace {
                 }
             }
         }
+#endif
 
         /* Note-ON */
         if ( note_len != 0 ) {
@@ -1551,14 +1949,15 @@ namespace {
             uint32_t q12_note_on_time;
             uint32_t q12_gate_time;
             uint8_t req_mixer;
+            uint8_t debt;
             bool is_update_mixer;
-            uint32_t tempo = (static_cast<uint32_t>(p_ch_info->tone.tempo) * slot.gl_info.speed_factor + 50)/ 100;
+            uint32_t tempo = (static_cast<uint32_t>(p_ch_info->tone.tempo) * get_timer_speed_factor(slot) + 50)/ 100;
 
             q12_note_on_time  = get_note_on_time(
                     note_len,
                     tempo,
                     dot_cnt,
-                    slot.gl_info.proc_freq
+                    get_proc_freq(slot)
             );
 
             q12_note_on_time += p_ch_info->time.NOTE_ON_FRAC;
@@ -1568,6 +1967,18 @@ namespace {
                 q12_note_on_time = p_ch_info->time.NOTE_ON_FRAC;
             }
 
+            /*
+             * Pay the ticks waited for the decode budget, and carry what this note is too short for
+             * to the next one. A note takes at least one tick, so that tick cannot pay.
+             */
+            debt = p_ch_info->time.DECODE_DEBT;
+            if ( ( debt > 0 ) && ( (q12_note_on_time>>12) <= debt ) ) {
+
+                debt = ( (q12_note_on_time>>12) > 0 ) ? static_cast<uint8_t>((q12_note_on_time>>12)-1) : 0;
+            }
+            q12_note_on_time -= static_cast<uint32_t>(debt)<<12;
+            p_ch_info->time.DECODE_DEBT -= debt;
+
             p_ch_info->time.NOTE_ON_FRAC = q12_note_on_time&0xFFF;
             p_ch_info->time.note_on = (q12_note_on_time>>12)&0xFFFF;
 
@@ -1584,11 +1995,14 @@ namespace {
 
                 req_mixer = 0x01;
                 is_update_mixer = true;
+#if PSGINO_USE_NOISE_SWEEP
                 init_noise_sweep(slot, ch);
+#endif
 
             } else if ( note_type == E_NOTE_TYPE_REST ) {
 
                 req_mixer = 0x09;
+#if PSGINO_USE_SW_ENV
                 if ( p_ch_info->ch_status.SW_ENV_MODE != SW_ENV_MODE_OFF ) {
 
                     if ( p_ch_info->ch_status.SW_ENV_STAT != SW_ENV_STAT_RELEASE ) {
@@ -1599,6 +2013,9 @@ namespace {
 
                     is_update_mixer = true;
                 }
+#else
+                is_update_mixer = true;
+#endif
 
             } else {
 
@@ -1615,25 +2032,101 @@ namespace {
             }
         }
 
+#if PSGINO_USE_PITCHBEND
         init_pitchbend(slot, ch);
+#endif
+
+#if PSGINO_USE_DECODE_AHEAD
+        /* The staged tone belonged to this note; look ahead again from the new position. */
+        p_ch_info->staged.STAGED = 0;
+        p_ch_info->staged.VALID = 0;
+#endif
 
         p_ch_info->ch_status.LEGATO = is_start_legato_effect ? 1 : 0;
     }
 
+    void start_tone(SLOT &slot, uint8_t ch, uint16_t tp, uint16_t tp_end) {
+
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+
+        slot.psg_reg.data[2*ch]     = U16_LO(tp);
+        slot.psg_reg.data[2*ch+1]   = U16_HI(tp);
+        slot.psg_reg.flags_addr    |= 0x3<<(2*ch);
+
+#if PSGINO_USE_PITCHBEND
+        p_ch_info->pitchbend.TP_INT = tp;
+        p_ch_info->pitchbend.TP_FRAC =0;
+        p_ch_info->pitchbend.TP_END_L = tp_end&0xF;
+        p_ch_info->pitchbend.TP_END_H = (tp_end>>4)&0xFF;
+#endif
+
+#if PSGINO_USE_LFO
+        if ( p_ch_info->ch_status.LFO_MODE != LFO_MODE_OFF ) {
+
+            p_ch_info->ch_status.LFO_STAT = LFO_STAT_RUN;
+
+            if ( p_ch_info->ch_status.LEGATO == 0 ) {
+
+                uint32_t q12_time_factor;
+                q12_time_factor = (100 << 12) / get_timer_speed_factor(slot);
+                p_ch_info->time.lfo_delay = (static_cast<uint32_t>(p_ch_info->lfo.delay_tk) * q12_time_factor + (1<<11)) >> 12;
+                p_ch_info->lfo.theta = 0;
+                p_ch_info->lfo.DELTA_FRAC = 0;
+                p_ch_info->lfo.TP_FRAC = 0;
+                p_ch_info->lfo.BASE_TP_H = (tp>>8)&0xF;
+                p_ch_info->lfo.BASE_TP_L = tp&0xFF;
+            }
+
+        } else {
+
+            p_ch_info->ch_status.LFO_STAT = LFO_STAT_STOP;
+        }
+#endif
+
+#if !PSGINO_USE_PITCHBEND
+        (void)tp_end;
+#endif
+#if !PSGINO_USE_LFO
+        (void)p_ch_info;
+#endif
+    }
+
+    void write_tone_volume(SLOT &slot, uint8_t ch) {
+
+        const CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+
+        slot.psg_reg.data[0x8+ch] = p_ch_info->tone.VOLUME;
+        slot.psg_reg.flags_addr  |= 1<<(0x8+ch);
+        if ( p_ch_info->tone.HW_ENV != 0 ) {
+
+            slot.psg_reg.data[0x8+ch] |= 1<<4;
+
+            if ( p_ch_info->ch_status.LEGATO == 0 ) {
+
+                slot.psg_reg.flags_addr |= 0x7<<0xB;
+            }
+
+        } else {
+
+            slot.psg_reg.data[0x8+ch] &= ~(1<<4);
+        }
+    }
+
     int16_t decode_mml(SLOT &slot, uint8_t ch) {
 
         const char *p_pos;
-        const char *p_head;
         const char *p_tail;
         int32_t param;
         uint32_t q12_exclude_note_len = static_cast<uint32_t>(DEFAULT_EXCLUDE_NOTE_LEN)<<12;
-        bool loop_flag = false;
+        bool loop_flag;
         bool decode_cont = true;
+        uint8_t num_cmds = 0;
         CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
 
-        p_head =  p_ch_info->mml.p_mml_head;
-        p_pos  = &p_ch_info->mml.p_mml_head[p_ch_info->mml.ofs_mml_pos];
-        p_tail = &p_ch_info->mml.p_mml_head[p_ch_info->mml.mml_len];
+        /* Continue a decode run that was cut by the decode budget. */
+        loop_flag = ( p_ch_info->time.DECODE_LOOP != 0 );
+
+        p_pos  = get_mml_pos(slot, ch, p_ch_info->mml.ofs_mml_pos, &p_tail);
 
         if ( p_pos >= p_tail ) {
 
@@ -1644,6 +2137,31 @@ namespace {
 
         while ( decode_cont ) {
 
+#if PSGINO_USE_MML_STREAM
+            /* Read the next part of the MML before a command can run past the window. */
+            if ( ( slot.mml_reader.read != nullptr ) && ( ( p_tail - p_pos ) < MML_STREAM_WINDOW/2 ) ) {
+
+                p_pos = get_mml_pos(slot, ch, get_mml_ofs(slot, ch, p_pos), &p_tail);
+            }
+#endif
+
+            const char cmd = p_pos[0];
+
+            if ( ( slot.gl_info.decode_budget != 0 ) &&
+                 ( num_cmds >= slot.gl_info.decode_budget ) &&
+                 ( !is_note_command(p_pos[0]) ) &&
+                 ( !is_white_space(p_pos[0]) ) &&
+                 ( q12_exclude_note_len == (static_cast<uint32_t>(DEFAULT_EXCLUDE_NOTE_LEN)<<12) ) &&
+                 ( p_ch_info->time.DECODE_DEBT < MAX_DECODE_DEBT )
+            ) {
+
+                /* Out of budget: resume here in the next tick and shorten the next notes by the wait. */
+                p_ch_info->time.DECODE_DEBT++;
+                p_ch_info->time.DECODE_LOOP = loop_flag ? 1 : 0;
+
+                return 0;
+            }
+
             switch ( to_upper_case(p_pos[0]) ) {
 
             case 'A':/*@fallthrough@*/
@@ -1657,22 +2175,37 @@ namespace {
             case 'J':/*@fallthrough@*/
             case 'N':/*@fallthrough@*/
             case 'R':
+                p_ch_info->time.DECODE_LOOP = 0;
                 generate_tone(slot, ch, &p_pos, p_tail, q12_exclude_note_len);
                 q12_exclude_note_len = static_cast<uint32_t>(DEFAULT_EXCLUDE_NOTE_LEN)<<12;
                 decode_cont = false;
                 break;
 
             case '$':
-                decode_dollar(p_ch_info, &p_pos, p_tail, slot.gl_info.proc_freq);
+                decode_dollar(p_ch_info, &p_pos, p_tail, get_proc_freq(slot));
                 break;
             case '@':
+#if PSGINO_USE_MML_PATTERN
+                if ( ( &p_pos[1] < p_tail ) && ( to_upper_case(p_pos[1]) == 'P' ) ) {
+
+                    call_mml_pattern(slot, ch, &p_pos, &p_tail);
+                    break;
+                }
+#endif
                 decode_atsign(slot, ch, &p_pos, p_tail);
                 break;
 
+#if PSGINO_USE_MML_PATTERN
+            case '}':
+                /* End of a pattern body. */
+                return_mml_pattern(slot, ch, &p_pos, &p_tail);
+                break;
+#endif
+
             case 'X':
             {
                 uint8_t dot_cnt = 0;
-                uint32_t tempo = (static_cast<uint32_t>(p_ch_info->tone.tempo) * slot.gl_info.speed_factor + 50)/ 100;
+                uint32_t tempo = (static_cast<uint32_t>(p_ch_info->tone.tempo) * get_timer_speed_factor(slot) + 50)/ 100;
                 param = get_param(
                     &p_pos,
                     p_tail,
@@ -1688,7 +2221,7 @@ namespace {
                         param,
                         tempo,
                         dot_cnt,
-                        slot.gl_info.proc_freq
+                        get_proc_freq(slot)
                 );
                 break;
             }
@@ -1826,7 +2359,7 @@ namespace {
                               DEFAULT_LOOP_TIMES
                     );
                     p_ch_info->mml.loop_times[loop_index] = param;
-                    p_ch_info->mml.ofs_mml_loop_head[loop_index] = (p_pos-p_head);
+                    p_ch_info->mml.ofs_mml_loop_head[loop_index] = get_mml_ofs(slot, ch, p_pos);
                     p_ch_info->ch_status.LOOP_DEPTH = loop_index + 1;
 
                 } else {
@@ -1836,14 +2369,16 @@ namespace {
                 break;
 
             case '|':
-                if ( p_ch_info->ch_status.LOOP_DEPTH > 0 ) {
+                if ( p_ch_info->ch_status.LOOP_DEPTH > get_loop_base(p_ch_info) ) {
                     bool skip_flag = false;
                     skip_flag |= (p_ch_info->mml.loop_times[p_ch_info->ch_status.LOOP_DEPTH - 1] == 1);
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
                     skip_flag |= (
                             ( p_ch_info->ch_status.LOOP_DEPTH == 1 ) &&
                             ( p_ch_info->ch_status.END_PRI_LOOP == 1 ) &&
                             ( slot.gl_info.sys_request.FIN_PRI_LOOP_REQ == FIN_PRI_LOOP_REQ_FORCE )
                     );
+#endif
 
                     if ( skip_flag ) {
 
@@ -1867,6 +2402,13 @@ namespace {
 
                                 break;
                             }
+#if PSGINO_USE_MML_STREAM
+                            if ( p_pos+1 >= p_tail ) {
+
+                                /* Continue the search in the next part of the MML. */
+                                p_pos = get_mml_pos(slot, ch, get_mml_ofs(slot, ch, p_pos), &p_tail);
+                            }
+#endif
                         }
 
                     } else {
@@ -1881,7 +2423,7 @@ namespace {
                 break;
 
             case ']':
-                if ( p_ch_info->ch_status.LOOP_DEPTH > 0 ) {
+                if ( p_ch_info->ch_status.LOOP_DEPTH > get_loop_base(p_ch_info) ) {
 
                     bool loop_exit_flag = false;
                     uint16_t loop_index = 0;
@@ -1890,6 +2432,7 @@ namespace {
                     loop_exit_flag |= loop_flag; // Force exit from the loop because there is no message in this loop.
                     loop_exit_flag |= ( p_ch_info->mml.loop_times[loop_index] == 1 );
 
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
                     // Exit the primary loop with the force flag.
                     if ( ( p_ch_info->ch_status.LOOP_DEPTH == 1 ) &&
                          ( p_ch_info->ch_status.END_PRI_LOOP == 1 ) &&
@@ -1898,19 +2441,36 @@ namespace {
                         loop_exit_flag = true;
                         p_ch_info->ch_status.END_PRI_LOOP = 0;
                     }
+#endif
 
                     if ( loop_exit_flag ) {
 
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
                         if ( p_ch_info->ch_status.LOOP_DEPTH == 1 ) {
 
                             p_ch_info->mml.prim_loop_counter = 0;
                         }
+#endif
                         p_ch_info->mml.loop_times[loop_index] = 0;
                         p_ch_info->ch_status.LOOP_DEPTH = loop_index;
                         p_pos++;
 
                     } else {
 
+#if PSGINO_USE_MML_QUEUE
+                        /* A pass of the primary loop of the first channel ends here: hand over to the queued MML. */
+                        if ( ( loop_index == 0 ) &&
+                             ( ch == clamp_channel(( slot.gl_info.sys_status.REVERSE == 1 ) ? NUM_CHANNEL-1 : 0) ) &&
+                             is_next_mml_pending(slot, true)
+                        ) {
+
+                            p_ch_info->mml.ofs_mml_pos = get_mml_ofs(slot, ch, p_pos);
+                            p_ch_info->time.DECODE_LOOP = 0;
+
+                            return 2;
+                        }
+#endif
+
                         if ( p_ch_info->mml.loop_times[loop_index] > 1 ) {
 
                             p_ch_info->mml.loop_times[loop_index]--;
@@ -1920,6 +2480,7 @@ namespace {
                             /* Infinite loop */
                         }
 
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
                         /* Exit the primary loop without using the force flag. */
                         if ( p_ch_info->ch_status.LOOP_DEPTH == 1 ) {
 
@@ -1930,8 +2491,9 @@ namespace {
                             }
                             p_ch_info->mml.prim_loop_counter++;
                         }
+#endif
 
-                        p_pos = p_head + p_ch_info->mml.ofs_mml_loop_head[loop_index];
+                        p_pos = get_mml_pos(slot, ch, p_ch_info->mml.ofs_mml_loop_head[loop_index], &p_tail);
                     }
 
                 } else {
@@ -1945,16 +2507,34 @@ namespace {
                 break;
             }
 
-            if ( p_pos >= p_tail ) {
+#if PSGINO_USE_MML_PATTERN
+            /* Leave finished patterns at once, so that the end of the channel is seen right after its last note. */
+            while ( ( p_ch_info->mml.CALL_DEPTH != 0 ) && ( p_pos < p_tail ) && ( *p_pos == '}' ) ) {
 
-                p_ch_info->mml.ofs_mml_pos = static_cast<uint16_t>(p_pos - p_head);
+                return_mml_pattern(slot, ch, &p_pos, &p_tail);
+            }
+#endif
+
+            if ( ( p_pos >= p_tail ) && is_mml_tail(slot, ch) ) {
+
+                p_ch_info->mml.ofs_mml_pos = get_mml_ofs(slot, ch, p_pos);
 
                 p_ch_info->ch_status.DECODE_END = 1;
 
                 return 1;
             }
 
-            p_ch_info->mml.ofs_mml_pos = static_cast<uint16_t>(p_pos - p_head);
+            p_ch_info->mml.ofs_mml_pos = get_mml_ofs(slot, ch, p_pos);
+            if ( !is_white_space(cmd) ) {
+
+                num_cmds++;
+#if PSGINO_USE_CMD_COUNT
+                if ( slot.gl_info.tick_cmds < 0xFF ) {
+
+                    slot.gl_info.tick_cmds++;
+                }
+#endif
+            }
         }
 
         return 0;
@@ -1986,11 +2566,24 @@ namespace {
                 param = static_cast<int32_t>(std::strtol((*pp_pos+1), const_cast<char**>(pp_pos), 10));
             }
 
+#if PSGINO_USE_USER_CALLBACK
             if ( slot.cb_info.user_callback ) {
 
                 slot.cb_info.user_callback(ch, param);
             }
+#else
+            (void)slot;
+            (void)ch;
+            (void)param;
+#endif
+            break;
+
+#if PSGINO_MML_INSTRUMENTS
+        case 'I':
+            param = get_param(pp_pos, p_tail, 0, NUM_MML_INSTRUMENTS-1, 0);
+            select_instrument(slot, ch, static_cast<uint8_t>(param));
             break;
+#endif
 
         default:
             (*pp_pos)++;
@@ -1998,47 +2591,239 @@ namespace {
         }
     }
 
-    void update_sw_env_volume(SLOT &slot, uint8_t ch) {
-
-        uint16_t vol, rel_vol;
-        uint16_t top;
-        uint16_t sus;
-        int32_t rate;
-        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+#if PSGINO_MML_INSTRUMENTS
+    void compile_instrument(SLOT &slot, uint8_t index, uint16_t tempo) {
 
-        vol = p_ch_info->sw_env.VOL_INT;
-        vol = (vol << 12)|p_ch_info->sw_env.VOL_FRAC;
-        rel_vol = p_ch_info->sw_env.REL_VOL_INT;
-        rel_vol = (rel_vol << 12)|p_ch_info->sw_env.REL_VOL_FRAC;
-        top = p_ch_info->tone.VOLUME;
-        top = top<<12;
-        sus = get_sus_volume(slot, ch);
-        sus = sus<<12;
+        MML_INSTRUMENT *p_inst = &slot.instruments[index];
+        CHANNEL_INFO info;
+        const char *p_pos;
+        const char *p_tail;
+        bool depends_on_tempo;
 
-        switch ( p_ch_info->ch_status.SW_ENV_STAT ) {
+        *p_inst = (MML_INSTRUMENT){};
+        if ( ( slot.header.p_mml_top == nullptr ) || ( slot.header.ofs_instrument[index] == 0 ) ) {
 
-        case SW_ENV_STAT_ATTACK:
-            rate = top/p_ch_info->sw_env.attack_tk;
-            if ( rate != 0 ) {
+            return;
+        }
 
-                if ( static_cast<int32_t>(top - vol) <= rate ) {
+        /* Run the $ commands of the body on a channel with default settings. */
+        reset_ch_info(&info);
+        info.tone.tempo = tempo;
+        depends_on_tempo = false;
+        p_pos = &slot.header.p_mml_top[slot.header.ofs_instrument[index]];
+        p_tail = &slot.header.p_mml_top[slot.header.ofs_header_end];
+        while ( ( p_pos < p_tail ) && ( *p_pos != '}' ) ) {
 
-                    vol = top;
+            if ( *p_pos == '$' ) {
 
-                } else {
+                if ( to_upper_case(p_pos[1]) == 'T' ) {
 
-                    vol += rate;
+                    depends_on_tempo = true;
                 }
+                decode_dollar(&info, &p_pos, p_tail, get_proc_freq(slot));
 
             } else {
 
-                vol = top;
+                p_pos++;
             }
-            break;
-
-        case SW_ENV_STAT_HOLD:
-            vol = top;
-            break;
+        }
+
+#if PSGINO_USE_SW_ENV
+        p_inst->attack_tk = info.sw_env.attack_tk;
+        p_inst->hold_tk = info.sw_env.hold_tk;
+        p_inst->decay_tk = info.sw_env.decay_tk;
+        p_inst->fade_tk = info.sw_env.fade_tk;
+        p_inst->release_tk = info.sw_env.release_tk;
+        p_inst->sustain = info.sw_env.sustain;
+        p_inst->time_unit = info.sw_env.time_unit;
+        p_inst->SW_ENV_MODE = info.ch_status.SW_ENV_MODE;
+        if ( info.sw_env.time_unit != 0 ) {
+
+            depends_on_tempo = true;
+        }
+#endif
+#if PSGINO_USE_LFO
+        p_inst->speed = info.lfo.speed;
+        p_inst->speed_unit = info.lfo.speed_unit;
+        p_inst->delay_tk = info.lfo.delay_tk;
+        p_inst->depth = info.lfo.depth;
+        p_inst->LFO_MODE = info.ch_status.LFO_MODE;
+        if ( info.lfo.speed_unit != 0 ) {
+
+            depends_on_tempo = true;
+        }
+#endif
+        p_inst->tempo = depends_on_tempo ? tempo : 0;
+        p_inst->DEFINED = 1;
+    }
+
+    void compile_instruments(SLOT &slot) {
+
+        for ( uint8_t i = 0; i < NUM_MML_INSTRUMENTS; i++ ) {
+
+            compile_instrument(slot, i, DEFAULT_TEMPO);
+        }
+        slot.instrument_mask = 0xFFFFFFFFUL;
+    }
+
+    void select_instrument(SLOT &slot, uint8_t ch, uint8_t index) {
+
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+        const MML_INSTRUMENT *p_inst = &slot.instruments[index];
+
+        if ( ( slot.instrument_mask & (1UL<<index) ) == 0 ) {
+
+            /* First use since the MML was set: compiled here rather than in apply_mml_layout. */
+            compile_instrument(slot, index, p_ch_info->tone.tempo);
+            slot.instrument_mask |= 1UL<<index;
+
+        } else if ( ( p_inst->tempo != 0 ) &&
+                    ( p_inst->tempo != p_ch_info->tone.tempo ) &&
+                    ( slot.header.p_mml_top != nullptr )
+        ) {
+
+            /* Timings in note lengths: convert again for the tempo of this channel. */
+            compile_instrument(slot, index, p_ch_info->tone.tempo);
+        }
+
+        if ( p_inst->DEFINED == 0 ) {
+
+            return;
+        }
+
+        /* An instrument replaces all envelope and LFO settings of the channel. */
+#if PSGINO_USE_SW_ENV
+        p_ch_info->sw_env.attack_tk = p_inst->attack_tk;
+        p_ch_info->sw_env.hold_tk = p_inst->hold_tk;
+        p_ch_info->sw_env.decay_tk = p_inst->decay_tk;
+        p_ch_info->sw_env.fade_tk = p_inst->fade_tk;
+        p_ch_info->sw_env.release_tk = p_inst->release_tk;
+        p_ch_info->sw_env.sustain = p_inst->sustain;
+        p_ch_info->sw_env.time_unit = p_inst->time_unit;
+        p_ch_info->ch_status.SW_ENV_MODE = p_inst->SW_ENV_MODE;
+#endif
+#if PSGINO_USE_LFO
+        p_ch_info->lfo.speed = p_inst->speed;
+        p_ch_info->lfo.speed_unit = p_inst->speed_unit;
+        p_ch_info->lfo.delay_tk = p_inst->delay_tk;
+        p_ch_info->lfo.depth = p_inst->depth;
+        p_ch_info->ch_status.LFO_MODE = p_inst->LFO_MODE;
+#endif
+    }
+#endif
+
+#if PSGINO_USE_MML_PATTERN
+    void call_mml_pattern(SLOT &slot, uint8_t ch, const char **pp_pos, const char **pp_tail) {
+
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+        MML_CALL *p_call;
+        int32_t param;
+
+        /* Skip '@' so that get_param reads the number after 'P'. */
+        (*pp_pos)++;
+        param = get_param(pp_pos, *pp_tail, 0, MAX_MML_PATTERNS-1, 0);
+
+#if PSGINO_USE_MML_STREAM
+        if ( slot.mml_reader.read != nullptr ) {
+
+            return;
+        }
+#endif
+        if ( ( slot.header.ofs_pattern[param] == 0 ) ||
+             ( p_ch_info->mml.CALL_DEPTH >= MAX_MML_CALL_DEPTH )
+        ) {
+
+            /* Undefined pattern or too deep: ignored. */
+            return;
+        }
+
+        p_call = &p_ch_info->mml.call_stack[p_ch_info->mml.CALL_DEPTH];
+        p_call->ofs_ret = get_mml_ofs(slot, ch, *pp_pos);
+        p_call->PATTERN = p_ch_info->mml.PATTERN;
+        p_call->LOOP_DEPTH = p_ch_info->ch_status.LOOP_DEPTH;
+        p_ch_info->mml.CALL_DEPTH++;
+        p_ch_info->mml.PATTERN = param + 1;
+
+        *pp_pos = get_mml_pos(slot, ch, 0, pp_tail);
+    }
+
+    void return_mml_pattern(SLOT &slot, uint8_t ch, const char **pp_pos, const char **pp_tail) {
+
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+        const MML_CALL *p_call;
+
+        if ( p_ch_info->mml.CALL_DEPTH == 0 ) {
+
+            (*pp_pos)++;
+            return;
+        }
+
+        /* Loops left open in the pattern are dropped. */
+        p_ch_info->mml.CALL_DEPTH--;
+        p_call = &p_ch_info->mml.call_stack[p_ch_info->mml.CALL_DEPTH];
+        p_ch_info->ch_status.LOOP_DEPTH = p_call->LOOP_DEPTH;
+        p_ch_info->mml.PATTERN = p_call->PATTERN;
+
+        *pp_pos = get_mml_pos(slot, ch, p_call->ofs_ret, pp_tail);
+    }
+#endif
+
+    uint8_t get_loop_base(const CHANNEL_INFO *p_ch_info) {
+
+#if PSGINO_USE_MML_PATTERN
+        /* A pattern can only close the loops it opened. */
+        if ( p_ch_info->mml.CALL_DEPTH != 0 ) {
+
+            return p_ch_info->mml.call_stack[p_ch_info->mml.CALL_DEPTH-1].LOOP_DEPTH;
+        }
+#else
+        (void)p_ch_info;
+#endif
+        return 0;
+    }
+
+#if PSGINO_USE_SW_ENV
+    void update_sw_env_volume(SLOT &slot, uint8_t ch) {
+
+        uint16_t vol, rel_vol;
+        uint16_t top;
+        uint16_t sus;
+        int32_t rate;
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+
+        vol = p_ch_info->sw_env.VOL_INT;
+        vol = (vol << 12)|p_ch_info->sw_env.VOL_FRAC;
+        rel_vol = p_ch_info->sw_env.REL_VOL_INT;
+        rel_vol = (rel_vol << 12)|p_ch_info->sw_env.REL_VOL_FRAC;
+        top = p_ch_info->tone.VOLUME;
+        top = top<<12;
+        sus = get_sus_volume(slot, ch);
+        sus = sus<<12;
+
+        switch ( p_ch_info->ch_status.SW_ENV_STAT ) {
+
+        case SW_ENV_STAT_ATTACK:
+            rate = top/p_ch_info->sw_env.attack_tk;
+            if ( rate != 0 ) {
+
+                if ( static_cast<int32_t>(top - vol) <= rate ) {
+
+                    vol = top;
+
+                } else {
+
+                    vol += rate;
+                }
+
+            } else {
+
+                vol = top;
+            }
+            break;
+
+        case SW_ENV_STAT_HOLD:
+            vol = top;
+            break;
 
         case SW_ENV_STAT_DECAY:
             rate = static_cast<int32_t>(top-sus)/p_ch_info->sw_env.decay_tk;
@@ -2155,12 +2940,13 @@ namespace {
 
         update_sw_env_volume(slot, ch);
     }
+#endif
 
+#if PSGINO_USE_LFO
     void proc_lfo(SLOT &slot, uint8_t ch) {
 
         uint8_t tp_hi;
         uint8_t tp_lo;
-        uint16_t speed_abs;
         bool is_phase_inverted;
         uint16_t delta_int;
         uint32_t tp_next;
@@ -2183,22 +2969,10 @@ namespace {
         tp_lo = slot.psg_reg.data[2*ch+0];
         tp_next = U16(tp_hi, tp_lo);
 
-        if ( p_ch_info->lfo.speed > 0 ) {
-
-            /* Inverted the phase when the speed is positive to maintain compatibility. */
-            is_phase_inverted = true;
-            speed_abs = p_ch_info->lfo.speed;
-
-        } else {
-
-            is_phase_inverted = false;
-            speed_abs = p_ch_info->lfo.speed * -1;
-        }
-        speed_abs = (static_cast<uint32_t>(speed_abs) * slot.gl_info.speed_factor + 50)/100;
+        /* Inverted the phase when the speed is positive to maintain compatibility. */
+        is_phase_inverted = ( p_ch_info->lfo.speed > 0 );
 
-        q6_omega = 1<<6;
-        q6_omega *= static_cast<uint32_t>(p_ch_info->lfo.depth)*4*speed_abs;
-        q6_omega /= (static_cast<uint16_t>(slot.gl_info.proc_freq)*MAX_LFO_PERIOD);
+        q6_omega = get_lfo_omega(slot, p_ch_info);
 
         q6_delta = p_ch_info->lfo.DELTA_FRAC;
 
@@ -2223,9 +2997,13 @@ namespace {
 
                 } else {
 
+#if PSGINO_USE_PITCHBEND
                     if ( ( theta == 0 ) &&
                          ( p_ch_info->ch_status.PBEND_STAT == PBEND_STAT_STOP )
                     ) {
+#else
+                    if ( theta == 0 ) {
+#endif
 
                         uint16_t tp_base;
                         tp_base = p_ch_info->lfo.BASE_TP_H;
@@ -2261,107 +3039,135 @@ namespace {
         }
         p_ch_info->lfo.DELTA_FRAC = q6_delta&0x3F;
     }
+#endif
 
-    void reset_ch_info(CHANNEL_INFO *p_ch_info) {
+    const char *get_mml_pos(SLOT &slot, uint8_t ch, MML_OFS ofs, const char **pp_tail) {
 
-        *p_ch_info = (CHANNEL_INFO){};
-        p_ch_info->tone.tempo = DEFAULT_TEMPO;
-        p_ch_info->tone.note_len = DEFAULT_NOTE_LENGTH;
-        p_ch_info->tone.OCTAVE = DEFAULT_OCTAVE-1;
-        p_ch_info->tone.GATE_TIME = DEFAULT_GATE_TIME-1;
-        p_ch_info->tone.VOLUME = DEFAULT_VOLUME_LEVEL;
-        p_ch_info->tone.BIAS = DEFAULT_BIAS_LEVEL+BIAS_LEVEL_OFS;
-        p_ch_info->tone.tp_ofs = DEFAULT_TP_OFS;
-    }
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
 
-    void reset_psg(PSG_REG &psg_reg) {
+#if PSGINO_USE_MML_STREAM
+        if ( slot.mml_reader.read != nullptr ) {
 
-        for ( uint8_t i = 0; i < 16; i++ ) {
+            MML_WINDOW *p_win = &p_ch_info->window;
 
-            psg_reg.data[i] = 0;
+            /* Keep half a window ahead of ofs, so that a command is never cut at the end of the window. */
+            if ( ( ofs < p_win->ofs_win ) ||
+                 ( ( static_cast<uint32_t>(ofs) + MML_STREAM_WINDOW/2 > static_cast<uint32_t>(p_win->ofs_win) + p_win->win_len ) &&
+                   ( static_cast<uint32_t>(p_win->ofs_win) + p_win->win_len < p_ch_info->mml.mml_len ) )
+            ) {
+
+                load_mml_window(slot, ch, ofs);
+            }
+
+            *pp_tail = &p_win->buf[p_win->win_len];
+
+            return &p_win->buf[ofs - p_win->ofs_win];
         }
-        psg_reg.data[0x7]   = 0x3F;
+#endif
+
+#if PSGINO_USE_MML_PATTERN
+        if ( p_ch_info->mml.PATTERN != 0 ) {
+
+            /* Inside a pattern: positions are from its body, which ends at '}' before the end of the header. */
+            const char *p_body = &slot.header.p_mml_top[slot.header.ofs_pattern[p_ch_info->mml.PATTERN-1]];
+
+            *pp_tail = &slot.header.p_mml_top[slot.header.ofs_header_end];
+
+            return &p_body[ofs];
+        }
+#endif
+
+        *pp_tail = &p_ch_info->mml.p_mml_head[p_ch_info->mml.mml_len];
+
+        return &p_ch_info->mml.p_mml_head[ofs];
     }
 
-    void rewind_mml(SLOT &slot) {
+    MML_OFS get_mml_ofs(const SLOT &slot, uint8_t ch, const char *p_pos) {
 
-        slot.psg_reg.data[0x7]   = 0x3F;
-        slot.psg_reg.flags_addr  = 1<<0x7;
-        slot.psg_reg.flags_mixer = 0;
-        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG = 0;
-        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ = FIN_PRI_LOOP_REQ_NORMAL;
+        const CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
 
-        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+#if PSGINO_USE_MML_STREAM
+        if ( slot.mml_reader.read != nullptr ) {
 
-            const char *p_mml_head;
-            uint8_t ch;
-            uint16_t mml_len;
+            return static_cast<MML_OFS>(p_ch_info->window.ofs_win + (p_pos - p_ch_info->window.buf));
+        }
+#endif
 
-            CHANNEL_INFO *p_ch_info;
+#if PSGINO_USE_MML_PATTERN
+        if ( p_ch_info->mml.PATTERN != 0 ) {
 
-            ch = clamp_channel(
-                    slot.gl_info.sys_status.REVERSE == 1 ?
-                    (NUM_CHANNEL-(i+1)) : i
-            );
-            slot.psg_reg.flags_mixer |= (1<<ch);
+            return static_cast<MML_OFS>(p_pos - &slot.header.p_mml_top[slot.header.ofs_pattern[p_ch_info->mml.PATTERN-1]]);
+        }
+#endif
 
-            p_ch_info = slot.ch_info_list[ch];
+        return static_cast<MML_OFS>(p_pos - p_ch_info->mml.p_mml_head);
+    }
 
-            p_mml_head = p_ch_info->mml.p_mml_head;
-            mml_len = p_ch_info->mml.mml_len;
+    bool is_mml_tail(const SLOT &slot, uint8_t ch) {
 
-            reset_ch_info(p_ch_info);
+#if PSGINO_USE_MML_STREAM
+        const CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
 
-            p_ch_info->mml.p_mml_head = p_mml_head;
-            p_ch_info->mml.mml_len = mml_len;
-            p_ch_info->ch_status.END_PRI_LOOP = 0;
+        if ( slot.mml_reader.read != nullptr ) {
+
+            return ( static_cast<uint32_t>(p_ch_info->window.ofs_win) + p_ch_info->window.win_len >= p_ch_info->mml.mml_len );
         }
+#else
+        (void)slot;
+        (void)ch;
+#endif
+
+        return true;
     }
-}
 
-    void init_slot(
-            SLOT &slot,
-            uint32_t s_clock,
-            uint16_t proc_freq,
-            bool reverse,
-            CHANNEL_INFO *p_ch0,
-            CHANNEL_INFO *p_ch1,
-            CHANNEL_INFO  *p_ch2
-    ) {
+#if PSGINO_USE_MML_STREAM
+    void load_mml_window(SLOT &slot, uint8_t ch, MML_OFS ofs) {
 
-        CHANNEL_INFO *p_list[NUM_CHANNEL] = { p_ch0, p_ch1, p_ch2 };
+        CHANNEL_INFO *p_ch_info = slot.ch_info_list[ch];
+        MML_WINDOW *p_win = &p_ch_info->window;
+        uint16_t len;
+        uint16_t len_read;
 
-        slot = (SLOT){};
+        len = ( p_ch_info->mml.mml_len - ofs < MML_STREAM_WINDOW ) ?
+              static_cast<uint16_t>(p_ch_info->mml.mml_len - ofs) : MML_STREAM_WINDOW;
 
-        slot.gl_info.s_clock = s_clock;
-        slot.gl_info.sys_status.REVERSE = reverse ? 1 : 0;
-        slot.gl_info.sys_status.NUM_CH_IMPL = 0;
-        slot.gl_info.proc_freq = (proc_freq != 0) ? proc_freq : PsgCtrl::DEFAULT_PROC_FREQ;
-        slot.gl_info.speed_factor = DEFAULT_SPEED_FACTOR;
+        len_read = slot.mml_reader.read(slot.mml_reader.p_user, p_win->ofs_src_head + ofs, p_win->buf, len);
+        if ( len_read < len ) {
 
-        slot.cb_info.user_callback = nullptr;
+            /* The source ended early: the channel ends here. */
+            p_ch_info->mml.mml_len = ofs + len_read;
+        }
 
-        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+        p_win->ofs_win = ofs;
+        p_win->win_len = static_cast<uint8_t>(( len_read < len ) ? len_read : len);
+        p_win->buf[p_win->win_len] = '\0';
+    }
+#endif
 
-            slot.ch_info_list[
-                clamp_channel( reverse ? (NUM_CHANNEL-(i+1)) : i )
-            ] = p_list[i];
+    void reset_ch_info(CHANNEL_INFO *p_ch_info) {
 
-            if ( p_list[i] != nullptr ) {
+        *p_ch_info = (CHANNEL_INFO){};
+        p_ch_info->tone.tempo = DEFAULT_TEMPO;
+        p_ch_info->tone.note_len = DEFAULT_NOTE_LENGTH;
+        p_ch_info->tone.OCTAVE = DEFAULT_OCTAVE-1;
+        p_ch_info->tone.GATE_TIME = DEFAULT_GATE_TIME-1;
+        p_ch_info->tone.VOLUME = DEFAULT_VOLUME_LEVEL;
+        p_ch_info->tone.BIAS = DEFAULT_BIAS_LEVEL+BIAS_LEVEL_OFS;
+        p_ch_info->tone.tp_ofs = DEFAULT_TP_OFS;
+    }
 
-                reset_ch_info(p_list[i]);
-                slot.gl_info.sys_status.NUM_CH_IMPL++;
+    void reset_psg(PSG_REG &psg_reg) {
 
-            } else {
+        for ( uint8_t i = 0; i < 16; i++ ) {
 
-                break;
-            }
+            psg_reg.data[i] = 0;
         }
-
-        reset_psg(slot.psg_reg);
+        psg_reg.data[0x7]   = 0x3F;
     }
 
-    int set_mml(SLOT &slot, const char *p_mml, uint16_t mode) {
+    int split_mml(const SLOT &slot, const char *p_mml, uint16_t mode, MML_LAYOUT &layout) {
+
+        layout = (MML_LAYOUT){};
 
         if ( p_mml == nullptr ) {
 
@@ -2371,38 +3177,36 @@ namespace {
         skip_white_space(&p_mml);
 
         /* Set default values. */
-        slot.gl_info.mml_version = DEFAULT_MML_VERSION;
-        slot.gl_info.sys_status.RH_LEN = (( mode & 0x1 ) != 0) ? 1 : 0;
+        layout.mml_version = DEFAULT_MML_VERSION;
+        layout.rh_len = (( mode & 0x1 ) != 0) ? 1 : 0;
 
         /* Parse MML header section. */
-        if ( !parse_mml_header(slot, &p_mml) ) {
+        if ( !parse_mml_header(layout, &p_mml) ) {
 
             return -2;
         }
 
-        slot.gl_info.sys_status.NUM_CH_USED = 0;
-
         for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_IMPL; i++ ) {
 
             uint8_t ch;
 
-            CHANNEL_INFO *p_ch_info;
             ch = clamp_channel(
                     ( slot.gl_info.sys_status.REVERSE == 1 ) ?
                     NUM_CHANNEL-(i+1) : i
             );
 
-            p_ch_info = slot.ch_info_list[ch];
-
-            p_ch_info->mml.p_mml_head = p_mml;
-            p_ch_info->mml.ofs_mml_pos = 0;
+            layout.p_mml_head[ch] = p_mml;
 
             while ((*p_mml != ',') && (*p_mml != '\0')) p_mml++;
 
-            p_ch_info->mml.mml_len = (p_mml - p_ch_info->mml.p_mml_head);
+            if ( static_cast<size_t>(p_mml - layout.p_mml_head[ch]) > MAX_MML_TEXT_LEN ) {
 
-            p_ch_info->ch_status.DECODE_END = 0;
-            slot.gl_info.sys_status.NUM_CH_USED++;
+                /* The positions of this channel do not fit in MML_OFS. */
+                return -3;
+            }
+
+            layout.mml_len[ch] = (p_mml - layout.p_mml_head[ch]);
+            layout.num_ch_used++;
 
             if ( *p_mml == '\0' ) {
 
@@ -2412,131 +3216,560 @@ namespace {
             p_mml++;
         }
 
-        slot.gl_info.sys_status.SET_MML = 1;
-
         return 0;
     }
 
-    void set_user_callback(
-            SLOT &slot,
-            void (*callback)(uint8_t ch, int32_t param)
-    ) {
+    void apply_mml_layout(SLOT &slot, const MML_LAYOUT &layout) {
 
-        slot.cb_info.user_callback = callback;
-    }
+#if PSGINO_USE_MML_STREAM
+        slot.mml_reader = (MML_READER){};
+#endif
+        slot.gl_info.mml_version = layout.mml_version;
+        slot.gl_info.sys_status.RH_LEN = layout.rh_len;
+        slot.gl_info.sys_status.NUM_CH_USED = layout.num_ch_used;
+#if PSGINO_USE_MML_HEADER_DEFS
+        slot.header = layout.header;
+#endif
+#if PSGINO_MML_INSTRUMENTS
+        slot.instrument_mask = 0;
+#endif
 
-    void reset(SLOT &slot) {
+        for ( uint8_t i = 0; i < layout.num_ch_used; i++ ) {
 
-        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+            uint8_t ch;
+            CHANNEL_INFO *p_ch_info;
 
-            if ( slot.ch_info_list[i] != nullptr ) {
+            ch = clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
 
-                reset_ch_info(slot.ch_info_list[i]);
-            }
-        }
+            p_ch_info = slot.ch_info_list[ch];
 
-        slot.gl_info.sys_status.SET_MML = 0;
-        slot.gl_info.sys_status.NUM_CH_USED = 0;
-        slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_STOP;
-        slot.gl_info.sys_status.CTRL_STAT_PRE = CTRL_STAT_STOP;
-        slot.gl_info.sys_request.CTRL_REQ = CTRL_REQ_STOP;
-        slot.gl_info.sys_request.CTRL_REQ_FLAG = 0;
-        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ = FIN_PRI_LOOP_REQ_NORMAL;
-        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG = 0;
+            p_ch_info->mml.p_mml_head = layout.p_mml_head[ch];
+            p_ch_info->mml.ofs_mml_pos = 0;
+            p_ch_info->mml.mml_len = layout.mml_len[ch];
+            p_ch_info->ch_status.DECODE_END = 0;
+        }
 
-        slot.gl_info.noise_info = (NOISE_INFO){};
-        slot.gl_info.noise_info.SWEEP_STAT = NOISE_SWEEP_STAT_STOP;
-
-        reset_psg(slot.psg_reg);
+        slot.gl_info.sys_status.SET_MML = 1;
     }
 
-    void set_speed_factor(SLOT &slot, uint16_t speed_factor) {
+    void rewind_mml(SLOT &slot) {
 
-        uint16_t pre_speed_factor;
-        uint32_t q12_alpha;
+#if PSGINO_USE_LIVE_NOTE
+        /* Play gives the live channels back to the MML. */
+        slot.gl_info.live_mask = 0;
+#endif
+        slot.psg_reg.data[0x7]   = 0x3F;
+        slot.psg_reg.flags_addr  = 1<<0x7;
+        slot.psg_reg.flags_mixer = 0;
 
-        pre_speed_factor = slot.gl_info.speed_factor;
+        restart_channels(slot);
+    }
 
-        speed_factor = SAT(speed_factor, MIN_SPEED_FACTOR, MAX_SPEED_FACTOR);
+    void restart_channels(SLOT &slot) {
 
-        q12_alpha = (static_cast<uint32_t>(pre_speed_factor) << 12) / speed_factor;
+#if PSGINO_USE_SEEK
+        slot.gl_info.song_tick = 0;
+#endif
+#if PSGINO_USE_SONG_CLOCK
+        slot.gl_info.speed_phase = 0;
+#endif
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG = 0;
+        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ = FIN_PRI_LOOP_REQ_NORMAL;
+#endif
 
-        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            const char *p_mml_head;
+            uint8_t ch;
+            MML_OFS mml_len;
+#if PSGINO_USE_MML_STREAM
+            MML_OFS ofs_src_head;
+#endif
 
             CHANNEL_INFO *p_ch_info;
-            p_ch_info = slot.ch_info_list[i];
 
-            if ( p_ch_info != nullptr ) {
+            ch = clamp_channel(
+                    slot.gl_info.sys_status.REVERSE == 1 ?
+                    (NUM_CHANNEL-(i+1)) : i
+            );
+            if ( is_live_channel(slot, ch) ) {
 
-                uint32_t q12_note_on_time;
+                /* A live channel keeps sounding; its MML starts again at the next Play. */
+                continue;
+            }
+            slot.psg_reg.flags_mixer |= (1<<ch);
 
-                q12_note_on_time = (static_cast<uint64_t>(p_ch_info->time.note_on)<<12);
-                q12_note_on_time += p_ch_info->time.NOTE_ON_FRAC;
+            p_ch_info = slot.ch_info_list[ch];
 
-                q12_note_on_time = (static_cast<uint64_t>(q12_note_on_time) * q12_alpha + (1<<11))>>12;
+            p_mml_head = p_ch_info->mml.p_mml_head;
+            mml_len = p_ch_info->mml.mml_len;
+#if PSGINO_USE_MML_STREAM
+            ofs_src_head = p_ch_info->window.ofs_src_head;
+#endif
 
-                p_ch_info->time.NOTE_ON_FRAC = q12_note_on_time&0xFFF;
-                p_ch_info->time.note_on = (q12_note_on_time>>12)&0xFFFF;
+            reset_ch_info(p_ch_info);
 
-                p_ch_info->time.gate = (static_cast<uint32_t>(p_ch_info->time.gate) * q12_alpha + (1<<11))>>12;
-                p_ch_info->time.sw_env = (static_cast<uint32_t>(p_ch_info->time.sw_env) * q12_alpha + (1<<11))>>12;
-                p_ch_info->time.lfo_delay = (static_cast<uint32_t>(p_ch_info->time.lfo_delay) * q12_alpha + (1<<11))>>12;
-                p_ch_info->time.pitchbend = (static_cast<uint32_t>(p_ch_info->time.pitchbend) * q12_alpha + (1<<11))>>12;
-            }
+            p_ch_info->mml.p_mml_head = p_mml_head;
+            p_ch_info->mml.mml_len = mml_len;
+#if PSGINO_USE_MML_STREAM
+            p_ch_info->window.ofs_src_head = ofs_src_head;
+#endif
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+            p_ch_info->ch_status.END_PRI_LOOP = 0;
+#endif
         }
+    }
 
-        slot.gl_info.speed_factor = speed_factor;
+#if PSGINO_USE_MML_QUEUE
+    bool is_next_mml_pending(const SLOT &slot, bool at_loop) {
+
+        if ( __atomic_load_n(&slot.next_mml.req_seq, __ATOMIC_ACQUIRE) ==
+             __atomic_load_n(&slot.next_mml.ack_seq, __ATOMIC_RELAXED)
+        ) {
+
+            return false;
+        }
+
+        return ( !at_loop || ( slot.next_mml.at_loop != 0 ) );
     }
 
-    void shift_frequency(SLOT &slot, int16_t shift_degrees) {
+    void switch_to_next_mml(SLOT &slot) {
 
-        slot.gl_info.shift_degrees = SAT(shift_degrees, MIN_FREQ_SHIFT_DEGREES, MAX_FREQ_SHIFT_DEGREES);
-   }
+        uint8_t req_seq;
+        uint8_t unused_mask = 0;
 
-    void control_psg(SLOT &slot) {
+        req_seq = __atomic_load_n(&slot.next_mml.req_seq, __ATOMIC_ACQUIRE);
 
-        uint8_t ch;
-        uint8_t decode_end_cnt = 0;
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
 
-        slot.gl_info.sys_status.CTRL_STAT_PRE = slot.gl_info.sys_status.CTRL_STAT;
+            unused_mask |= 1<<clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+        }
 
-        if ( slot.gl_info.sys_status.SET_MML == 0 ) {
+        apply_mml_layout(slot, slot.next_mml.layout);
+
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            unused_mask &= ~(1<<clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            ));
+        }
+
+        /* Mute the channels that only the previous MML used. The others keep sounding until their first note. */
+        for ( uint8_t ch = 0; ch < NUM_CHANNEL; ch++ ) {
+
+            if ( ( ( unused_mask & (1<<ch) ) != 0 ) && !is_live_channel(slot, ch) ) {
+
+                slot.psg_reg.data[0x7]   |= 0x9<<ch;
+                slot.psg_reg.flags_addr  |= 1<<0x7;
+                slot.psg_reg.flags_mixer |= 1<<ch;
+            }
+        }
+
+        restart_channels(slot);
+
+        __atomic_store_n(&slot.next_mml.ack_seq, req_seq, __ATOMIC_RELEASE);
+    }
+#endif
+
+    void take_posted_mml(SLOT &slot) {
+
+        POSTED_MML_INFO &posted = slot.posted_mml;
+        uint8_t req_seq = __atomic_load_n(&posted.req_seq, __ATOMIC_ACQUIRE);
+
+        if ( req_seq == posted.ack_seq ) {
 
             return;
         }
 
-        if ( slot.gl_info.sys_request.CTRL_REQ_FLAG != 0 ) {
+        while ( true ) {
 
-            slot.gl_info.sys_request.CTRL_REQ_FLAG = 0;
+            apply_mml_layout(slot, posted.layout[req_seq & 1]);
 
-            if ( slot.gl_info.sys_request.CTRL_REQ == CTRL_REQ_PLAY ) {
+            /* Only the post two after req_seq refills its buffer: apply again if it has started. */
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if ( static_cast<uint8_t>(__atomic_load_n(&posted.fill_seq, __ATOMIC_RELAXED) - req_seq) < 2 ) {
 
-                rewind_mml(slot);
-                slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+                break;
+            }
+            req_seq = __atomic_load_n(&posted.req_seq, __ATOMIC_ACQUIRE);
+        }
 
-            } else {
+        __atomic_store_n(&posted.ack_seq, req_seq, __ATOMIC_RELEASE);
+    }
 
-                slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_STOP;
-                for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+    void drain_commands(SLOT &slot) {
 
-                    ch = clamp_channel(
-                            ( slot.gl_info.sys_status.REVERSE == 1 ) ?
-                            NUM_CHANNEL-(i+1) : i
-                    );
-                    slot.psg_reg.data[0x7]   |= 0x9<<ch;
-                    slot.psg_reg.flags_mixer |= 0x1<<ch;
+        CMD_QUEUE &q = slot.cmd_queue;
+        uint8_t head = q.head;
+        uint8_t tail = __atomic_load_n(&q.tail, __ATOMIC_ACQUIRE);
+        uint8_t epoch = __atomic_load_n(&q.epoch, __ATOMIC_ACQUIRE);
+
+        if ( epoch != q.ack_epoch ) {
+
+            /* reset was called: the MML posted before it is never applied. */
+            uint8_t reset_seq = slot.posted_mml.reset_seq;
+
+            if ( static_cast<int8_t>(reset_seq - slot.posted_mml.ack_seq) > 0 ) {
+
+                __atomic_store_n(&slot.posted_mml.ack_seq, reset_seq, __ATOMIC_RELEASE);
+            }
+            q.ack_epoch = epoch;
+        }
+
+        while ( head != tail ) {
+
+            const CMD_INFO &cmd = q.cmds[head];
+
+            if ( cmd.epoch != epoch ) {
+
+                /* Posted before the last reset. */
+                head = (head + 1) & (CMD_QUEUE_SIZE - 1);
+                continue;
+            }
+
+            switch ( cmd.type ) {
+
+            case CMD_PLAY:
+                slot.gl_info.sys_request.CTRL_REQ = CTRL_REQ_PLAY;
+                slot.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+                break;
+
+            case CMD_STOP:
+                slot.gl_info.sys_request.CTRL_REQ = CTRL_REQ_STOP;
+                slot.gl_info.sys_request.CTRL_REQ_FLAG = 1;
+                break;
+
+            case CMD_SET_MML:
+                /* A newer post has its own entry, or is taken after the queue if it had none. */
+                if ( static_cast<uint8_t>(cmd.param) == __atomic_load_n(&slot.posted_mml.req_seq, __ATOMIC_ACQUIRE) ) {
+
+                    take_posted_mml(slot);
+                }
+                break;
+
+            case CMD_SET_SPEED_FACTOR:
+                set_speed_factor(slot, (uint16_t)cmd.param);
+                break;
+
+            case CMD_SHIFT_FREQUENCY:
+                shift_frequency(slot, cmd.param);
+                break;
+
+#if PSGINO_USE_LIVE_NOTE
+            case CMD_NOTE_ON:
+                live_note_on(slot, cmd.ch, cmd.param & 0x7F, (cmd.param >> 8) & 0xF);
+                break;
+
+            case CMD_NOTE_OFF:
+                live_note_off(slot, cmd.ch);
+                break;
+
+            case CMD_SET_PITCHBEND:
+                set_live_pitchbend(slot, cmd.ch, cmd.param);
+                break;
+
+            case CMD_SET_EFFECT:
+                if ( cmd.p_mml != nullptr ) {
+
+                    set_live_effect(slot, cmd.ch, *cmd.p_mml, cmd.param);
+                }
+                break;
+
+#if PSGINO_MML_INSTRUMENTS
+            case CMD_SET_INSTRUMENT:
+                if ( ( cmd.param >= 0 ) && ( cmd.param < NUM_MML_INSTRUMENTS ) && ( take_live_channel(slot, cmd.ch) != nullptr ) ) {
+
+                    select_instrument(slot, cmd.ch, static_cast<uint8_t>(cmd.param));
                 }
-                slot.psg_reg.flags_addr  = 1<<0x7;
+                break;
+#endif
+#endif
+
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+            case CMD_FIN_PRI_LOOP:
+                slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG = 1;
+                slot.gl_info.sys_request.FIN_PRI_LOOP_REQ =
+                    ( cmd.param != 0 ) ? FIN_PRI_LOOP_REQ_FORCE : FIN_PRI_LOOP_REQ_NORMAL;
+                break;
+#endif
+
+            default:
+                break;
             }
+
+            head = (head + 1) & (CMD_QUEUE_SIZE - 1);
         }
 
-        if ( ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_STOP ) ||
-             ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_END  )
-        ) {
+        /* Release the entries to the producer. */
+        __atomic_store_n(&q.head, head, __ATOMIC_RELEASE);
+
+        /* An MML posted while the queue was full. */
+        take_posted_mml(slot);
+    }
+
+#if PSGINO_USE_LIVE_NOTE
+    CHANNEL_INFO *take_live_channel(SLOT &slot, uint8_t ch) {
+
+        CHANNEL_INFO *p_ch_info;
+
+        if ( ( ch >= NUM_CHANNEL ) || ( slot.ch_info_list[ch] == nullptr ) ) {
+
+            return nullptr;
+        }
+
+        p_ch_info = slot.ch_info_list[ch];
+        if ( !is_live_channel(slot, ch) ) {
+
+            /* The channel keeps the settings of its MML, but not its timers. */
+            slot.gl_info.live_mask |= 1<<ch;
+            slot.gl_info.live_note[ch] = DEFAULT_NOTE_NUMBER;
+            p_ch_info->time.note_on = 0;
+            p_ch_info->time.gate = 0;
+            p_ch_info->ch_status.LEGATO = 0;
+#if PSGINO_USE_PITCHBEND
+            p_ch_info->time.pitchbend = 0;
+            p_ch_info->ch_status.PBEND_STAT = PBEND_STAT_STOP;
+#endif
+        }
+
+        return p_ch_info;
+    }
+
+    void live_note_on(SLOT &slot, uint8_t ch, int16_t note_num, int16_t volume) {
+
+        CHANNEL_INFO *p_ch_info = take_live_channel(slot, ch);
+        uint16_t tp;
+
+        if ( p_ch_info == nullptr ) {
+
+            return;
+        }
+
+        note_num = SAT(note_num, MIN_NOTE_NUMBER, MAX_NOTE_NUMBER);
+        slot.gl_info.live_note[ch] = static_cast<uint8_t>(note_num);
+        p_ch_info->tone.VOLUME = SAT(volume, MIN_VOLUME_LEVEL, MAX_VOLUME_LEVEL);
+        p_ch_info->ch_status.LEGATO = 0;
+
+        /* The same steps as a tone of generate_tone, which never ends by itself. */
+        tp = calc_note_tp(slot, p_ch_info, note_num);
+        start_tone(slot, ch, tp, tp);
+        write_tone_volume(slot, ch);
+
+#if PSGINO_USE_SW_ENV
+        if ( p_ch_info->ch_status.SW_ENV_MODE != SW_ENV_MODE_OFF ) {
+
+            p_ch_info->time.sw_env = 0;
+            p_ch_info->ch_status.SW_ENV_STAT = SW_ENV_STAT_INIT_NOTE_ON;
+            trans_sw_env_state(slot, ch);
+        }
+#endif
+
+        slot.psg_reg.data[0x7] &= ~(0x9<<ch);
+        slot.psg_reg.data[0x7] |= 0x08<<ch;
+        slot.psg_reg.flags_addr  |= 1<<0x7;
+        slot.psg_reg.flags_mixer |= 1<<ch;
+    }
+
+    void live_note_off(SLOT &slot, uint8_t ch) {
+
+        CHANNEL_INFO *p_ch_info = take_live_channel(slot, ch);
+        bool is_mute = true;
+
+        if ( p_ch_info == nullptr ) {
+
+            return;
+        }
+
+#if PSGINO_USE_SW_ENV
+        /* As a rest: the envelope releases, and the channel is muted at once only without a release. */
+        if ( p_ch_info->ch_status.SW_ENV_MODE != SW_ENV_MODE_OFF ) {
+
+            if ( p_ch_info->ch_status.SW_ENV_STAT < SW_ENV_STAT_INIT_NOTE_OFF ) {
+
+                p_ch_info->time.sw_env = 0;
+                p_ch_info->ch_status.SW_ENV_STAT = SW_ENV_STAT_INIT_NOTE_OFF;
+                trans_sw_env_state(slot, ch);
+            }
+            is_mute = ( p_ch_info->ch_status.SW_ENV_STAT != SW_ENV_STAT_RELEASE );
+        }
+#endif
+
+        if ( is_mute ) {
+
+            slot.psg_reg.data[0x7]   |= 0x9<<ch;
+            slot.psg_reg.flags_addr  |= 1<<0x7;
+            slot.psg_reg.flags_mixer |= 1<<ch;
+        }
+    }
+
+    void set_live_pitchbend(SLOT &slot, uint8_t ch, int16_t degrees) {
+
+        CHANNEL_INFO *p_ch_info = take_live_channel(slot, ch);
+        uint16_t tp;
+
+        if ( p_ch_info == nullptr ) {
+
+            return;
+        }
+
+        /* The bend is the bias of the channel ($B), applied to the sounding note at once. */
+        p_ch_info->tone.BIAS = SAT(degrees, MIN_BIAS_LEVEL, MAX_BIAS_LEVEL) + BIAS_LEVEL_OFS;
+
+        tp = calc_note_tp(slot, p_ch_info, slot.gl_info.live_note[ch]);
+        slot.psg_reg.data[2*ch]     = U16_LO(tp);
+        slot.psg_reg.data[2*ch+1]   = U16_HI(tp);
+        slot.psg_reg.flags_addr    |= 0x3<<(2*ch);
+#if PSGINO_USE_PITCHBEND
+        p_ch_info->pitchbend.TP_INT = tp;
+        p_ch_info->pitchbend.TP_FRAC = 0;
+        p_ch_info->pitchbend.TP_END_L = tp&0xF;
+        p_ch_info->pitchbend.TP_END_H = (tp>>4)&0xFF;
+#endif
+#if PSGINO_USE_LFO
+        /* The LFO keeps its phase and swings around the new period. */
+        p_ch_info->lfo.BASE_TP_H = (tp>>8)&0xF;
+        p_ch_info->lfo.BASE_TP_L = tp&0xFF;
+#endif
+    }
+
+    void set_live_effect(SLOT &slot, uint8_t ch, char code, int16_t value) {
+
+        CHANNEL_INFO *p_ch_info = take_live_channel(slot, ch);
+        char text[10];
+        char digits[6];
+        uint8_t len = 0;
+        uint8_t num_digits = 0;
+        uint16_t mag;
+        const char *p_pos = text;
+
+        if ( p_ch_info == nullptr ) {
 
             return;
         }
 
+        /* Written out as the $ command, so that times and speeds are converted as in the MML. */
+        text[len++] = '$';
+        text[len++] = code;
+        if ( value < 0 ) {
+
+            text[len++] = '-';
+        }
+        mag = ( value < 0 ) ? static_cast<uint16_t>(-value) : static_cast<uint16_t>(value);
+        do {
+
+            digits[num_digits++] = '0' + (mag % 10);
+            mag /= 10;
+        } while ( mag != 0 );
+        while ( num_digits > 0 ) {
+
+            text[len++] = digits[--num_digits];
+        }
+        text[len] = '\0';
+
+        decode_dollar(p_ch_info, &p_pos, &text[len], get_proc_freq(slot));
+
+#if PSGINO_USE_LFO
+        /* The LFO swings by steps relative to the last period, so a new depth, speed or mode
+         * restarts it from the period of the note rather than from where it was. */
+        if ( ( code == 'J' ) || ( code == 'L' ) || ( code == 'M' ) ) {
+
+            slot.psg_reg.data[2*ch]     = p_ch_info->lfo.BASE_TP_L;
+            slot.psg_reg.data[2*ch+1]   = p_ch_info->lfo.BASE_TP_H;
+            slot.psg_reg.flags_addr    |= 0x3<<(2*ch);
+            p_ch_info->lfo.theta = 0;
+            p_ch_info->lfo.TP_FRAC = 0;
+            p_ch_info->lfo.DELTA_FRAC = 0;
+        }
+#endif
+    }
+
+    void run_live_tick(SLOT &slot, TIMING_PROBE &probe) {
+
+        for ( uint8_t ch = 0; ch < NUM_CHANNEL; ch++ ) {
+
+            if ( !is_live_channel(slot, ch) ) {
+
+                continue;
+            }
+
+#if PSGINO_USE_PITCHBEND
+            proc_pitchbend(slot, ch);
+            timing_mark(slot, probe, TIMING_PHASE_PITCHBEND);
+#endif
+#if PSGINO_USE_SW_ENV
+            if ( slot.ch_info_list[ch]->ch_status.SW_ENV_MODE == 1 ) {
+
+                proc_sw_env_gen(slot, ch);
+            }
+            timing_mark(slot, probe, TIMING_PHASE_SW_ENV);
+#endif
+#if PSGINO_USE_LFO
+            if ( slot.ch_info_list[ch]->ch_status.LFO_MODE == 1 ) {
+
+                proc_lfo(slot, ch);
+            }
+            timing_mark(slot, probe, TIMING_PHASE_LFO);
+#endif
+        }
+#if !PSGINO_USE_PITCHBEND && !PSGINO_USE_SW_ENV && !PSGINO_USE_LFO
+        (void)probe;
+#endif
+    }
+#endif
+
+    void run_song_tick(SLOT &slot, TIMING_PROBE &probe) {
+
+        uint8_t ch;
+        uint8_t decode_end_cnt = 0;
+
+#if PSGINO_USE_MML_QUEUE
+        if ( is_next_mml_pending(slot, false) ) {
+
+            bool is_last_tick = true;
+
+            /* Switch in the tick in which the last notes would run out, so that no silent tick is played. */
+            for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+                const CHANNEL_INFO *p_ch_info;
+
+                ch = clamp_channel(
+                        ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                        NUM_CHANNEL-(i+1) : i
+                );
+                p_ch_info = slot.ch_info_list[ch];
+                if ( ( ( p_ch_info->ch_status.DECODE_END == 0 ) ||
+                       ( p_ch_info->time.note_on > 1 ) ) &&
+                     !is_live_channel(slot, ch)
+                ) {
+
+                    is_last_tick = false;
+                    break;
+                }
+            }
+
+            if ( is_last_tick ) {
+
+                switch_to_next_mml(slot);
+            }
+        }
+#endif
+
+#if PSGINO_USE_SEEK
+        slot.gl_info.song_tick++;
+#endif
+#if PSGINO_USE_CMD_COUNT
+        slot.gl_info.tick_cmds = 0;
+#endif
+
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
         if ( slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG != 0 ) {
 
             slot.gl_info.sys_status.FIN_PRI_LOOP_TRY = MAX_FIN_PRI_LOOP_TRY;
@@ -2582,6 +3815,7 @@ namespace {
                 slot.gl_info.sys_status.FIN_PRI_LOOP_TRY = 0;
             }
         }
+#endif
 
         for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
 
@@ -2593,7 +3827,14 @@ namespace {
             );
             p_ch_info = slot.ch_info_list[ch];
 
-            if ( p_ch_info->time.note_on > 0 ) {
+            if ( is_live_channel(slot, ch) ) {
+
+                /* Played by run_live_tick; the MML of the channel waits until the next Play. */
+                decode_end_cnt++;
+                continue;
+            }
+
+            if ( p_ch_info->time.note_on > 0 ) {
 
                 p_ch_info->time.note_on--;
             }
@@ -2605,7 +3846,19 @@ namespace {
 
                 if ( p_ch_info->ch_status.DECODE_END == 0 ) {
 
+#if PSGINO_USE_MML_QUEUE
+                    if ( decode_mml(slot, ch) == 2 ) {
+
+                        /* The remaining channels start in this tick as well, as their note_on is now 0. */
+                        switch_to_next_mml(slot);
+#if PSGINO_USE_SEEK
+                        slot.gl_info.song_tick++;
+#endif
+                        decode_mml(slot, ch);
+                    }
+#else
                     decode_mml(slot, ch);
+#endif
                 } else {
 
                     decode_end_cnt++;
@@ -2626,28 +3879,1406 @@ namespace {
                     }
                 }
             }
+            timing_mark(slot, probe, TIMING_PHASE_DECODE);
 
+#if PSGINO_USE_PITCHBEND
             /* PITCHBEND BLOCK */
             proc_pitchbend(slot, ch);
+            timing_mark(slot, probe, TIMING_PHASE_PITCHBEND);
+#endif
 
+#if PSGINO_USE_SW_ENV
             /* SOFTWARE ENVELOPE GENERATOR BLOCK */
             if ( p_ch_info->ch_status.SW_ENV_MODE == 1 ) {
 
                 proc_sw_env_gen(slot, ch);
             }
+            timing_mark(slot, probe, TIMING_PHASE_SW_ENV);
+#endif
+#if PSGINO_USE_LFO
             /* LFO BLOCK */
             if ( p_ch_info->ch_status.LFO_MODE == 1 ) {
 
                 proc_lfo(slot, ch);
             }
+            timing_mark(slot, probe, TIMING_PHASE_LFO);
+#endif
         }
 
+#if PSGINO_USE_NOISE_SWEEP
         /* NOISE SWEEP BLOCK */
         proc_noise_sweep(slot);
+        timing_mark(slot, probe, TIMING_PHASE_NOISE_SWEEP);
+#endif
+
+#if PSGINO_USE_DECODE_AHEAD
+        /* DECODE AHEAD BLOCK (one channel per tick, so that notes starting together are staged in different ticks) */
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            CHANNEL_INFO *p_ch_info;
+
+            ch = clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+            p_ch_info = slot.ch_info_list[ch];
+
+            if ( ( p_ch_info->time.note_on > 0 ) &&
+                 ( p_ch_info->ch_status.DECODE_END == 0 ) &&
+                 ( p_ch_info->staged.STAGED == 0 )
+            ) {
+
+                stage_next_tone(slot, ch);
+                break;
+            }
+        }
+        timing_mark(slot, probe, TIMING_PHASE_DECODE);
+#endif
 
         if ( decode_end_cnt >= slot.gl_info.sys_status.NUM_CH_USED ) {
 
             slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_END;
         }
     }
+
+    const char *get_mml_head(const SLOT &slot) {
+
+        uint8_t ch = clamp_channel(
+                ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                NUM_CHANNEL-1 : 0
+        );
+
+        return slot.ch_info_list[ch]->mml.p_mml_head;
+    }
+
+#if PSGINO_USE_SEEK
+    void run_silently(SLOT &slot, uint32_t song_tick) {
+
+        TIMING_PROBE probe;
+#if PSGINO_USE_USER_CALLBACK
+        void (*user_callback)(uint8_t ch, int32_t param) = slot.cb_info.user_callback;
+        slot.cb_info.user_callback = nullptr;
+#endif
+
+        while ( ( slot.gl_info.song_tick < song_tick ) &&
+                ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_PLAY )
+        ) {
+
+            run_song_tick(slot, probe);
+        }
+
+#if PSGINO_USE_USER_CALLBACK
+        slot.cb_info.user_callback = user_callback;
+#endif
+    }
+
+    void save_seek_point(const SLOT &slot, SEEK_POINT &point) {
+
+        point.song_tick = slot.gl_info.song_tick;
+        point.noise_info = slot.gl_info.noise_info;
+        for ( uint8_t i = 0; i < 16; i++ ) {
+
+            point.psg_data[i] = slot.psg_reg.data[i];
+        }
+        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+
+            if ( slot.ch_info_list[i] != nullptr ) {
+
+                point.ch_info[i] = *slot.ch_info_list[i];
+            }
+        }
+    }
+
+    void load_seek_point(SLOT &slot, const SEEK_POINT &point) {
+
+        slot.gl_info.song_tick = point.song_tick;
+        slot.gl_info.noise_info = point.noise_info;
+        for ( uint8_t i = 0; i < 16; i++ ) {
+
+            slot.psg_reg.data[i] = point.psg_data[i];
+        }
+        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+
+            if ( slot.ch_info_list[i] != nullptr ) {
+
+                /* Keep the MML of the SLOT, so that the points need not hold valid pointers. */
+                const char *p_mml_head = slot.ch_info_list[i]->mml.p_mml_head;
+
+                *slot.ch_info_list[i] = point.ch_info[i];
+                slot.ch_info_list[i]->mml.p_mml_head = p_mml_head;
+            }
+        }
+    }
+#endif
+
+    void split_song(const SLOT &slot, const SONG_HEADER *p_header, MML_LAYOUT &layout) {
+
+        const char *p_image = reinterpret_cast<const char *>(p_header);
+
+        layout = (MML_LAYOUT){};
+
+#if PSGINO_USE_MML_HEADER_DEFS
+        /* Only the patterns and instruments are taken from the header of the MML; the rest is in the image header. */
+        const char *p_text = &p_image[p_header->ofs_mml];
+
+        skip_white_space(&p_text);
+        (void)parse_mml_header(layout, &p_text);
+#endif
+        layout.mml_version = p_header->mml_version;
+        layout.rh_len = p_header->rh_len;
+
+        for ( uint8_t i = 0; ( i < p_header->num_channels ) && ( i < slot.gl_info.sys_status.NUM_CH_IMPL ); i++ ) {
+
+            uint8_t ch;
+
+            ch = clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+            layout.p_mml_head[ch] = &p_image[p_header->ofs_channel[i]];
+            layout.mml_len[ch] = static_cast<MML_OFS>(p_header->len_channel[i]);
+            layout.num_ch_used++;
+        }
+    }
+
+    /* Publishes a layout as the newest posted MML and asks control_psg to set it. */
+    void post_layout(SLOT &slot, const MML_LAYOUT &layout) {
+
+        POSTED_MML_INFO &posted = slot.posted_mml;
+        uint8_t seq = static_cast<uint8_t>(posted.req_seq+1);
+
+        /* layout[seq & 1] may still be read by control_psg for seq-2: announce the fill first. */
+        __atomic_store_n(&posted.fill_seq, seq, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        posted.layout[seq & 1] = layout;
+        __atomic_store_n(&posted.req_seq, seq, __ATOMIC_RELEASE);
+
+        /* On a full queue, control_psg takes the layout after the queued commands. */
+        (void)post_command(slot, CMD_SET_MML, seq);
+    }
+}
+
+    void init_slot(
+            SLOT &slot,
+            uint32_t s_clock,
+            uint16_t proc_freq,
+            bool reverse,
+            CHANNEL_INFO *p_ch0,
+            CHANNEL_INFO *p_ch1,
+            CHANNEL_INFO  *p_ch2
+    ) {
+
+        CHANNEL_INFO *p_list[NUM_CHANNEL] = { p_ch0, p_ch1, p_ch2 };
+
+        slot = (SLOT){};
+
+        slot.gl_info.s_clock = s_clock;
+        slot.gl_info.sys_status.REVERSE = reverse ? 1 : 0;
+        slot.gl_info.sys_status.NUM_CH_IMPL = 0;
+#if PSGINO_PROC_FREQ
+        (void)proc_freq;
+        slot.gl_info.proc_freq = PSGINO_PROC_FREQ;
+#else
+        slot.gl_info.proc_freq = (proc_freq != 0) ? proc_freq : PsgCtrl::DEFAULT_PROC_FREQ;
+#endif
+        slot.gl_info.speed_factor = DEFAULT_SPEED_FACTOR;
+        slot.gl_info.decode_budget = DEFAULT_DECODE_BUDGET;
+
+#if PSGINO_USE_USER_CALLBACK
+        slot.cb_info.user_callback = nullptr;
+#endif
+
+        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+
+            slot.ch_info_list[
+                clamp_channel( reverse ? (NUM_CHANNEL-(i+1)) : i )
+            ] = p_list[i];
+
+            if ( p_list[i] != nullptr ) {
+
+                reset_ch_info(p_list[i]);
+                slot.gl_info.sys_status.NUM_CH_IMPL++;
+
+            } else {
+
+                break;
+            }
+        }
+
+        reset_psg(slot.psg_reg);
+    }
+
+    int set_mml(SLOT &slot, const char *p_mml, uint16_t mode) {
+
+        MML_LAYOUT layout;
+        int ret;
+
+        ret = split_mml(slot, p_mml, mode, layout);
+        if ( ret < 0 ) {
+
+            return ret;
+        }
+
+        apply_mml_layout(slot, layout);
+
+        return 0;
+    }
+
+#if PSGINO_USE_MML_STREAM
+    int set_mml_reader(SLOT &slot, MML_READ_FUNC read, void *p_user, uint16_t mode) {
+
+        MML_LAYOUT layout;
+        MML_OFS ofs_src_head[NUM_CHANNEL] = {};
+        char buf[MML_STREAM_WINDOW+1];
+        const char *p_pos;
+        uint32_t ofs;
+        uint32_t ofs_ch;
+        uint16_t len;
+        uint8_t i;
+
+        if ( read == nullptr ) {
+
+            return -1;
+        }
+
+        layout = (MML_LAYOUT){};
+        layout.mml_version = DEFAULT_MML_VERSION;
+        layout.rh_len = (( mode & 0x1 ) != 0) ? 1 : 0;
+
+        /* The header must be in the first window. */
+        len = read(p_user, 0, buf, MML_STREAM_WINDOW);
+        buf[len] = '\0';
+        p_pos = buf;
+        skip_white_space(&p_pos);
+        if ( !parse_mml_header(layout, &p_pos) ) {
+
+            return -2;
+        }
+
+        /* Find the channels, one window at a time. */
+        ofs = static_cast<uint32_t>(p_pos - buf);
+        ofs_ch = ofs;
+        i = 0;
+        while ( i < slot.gl_info.sys_status.NUM_CH_IMPL ) {
+
+            uint16_t k;
+            uint8_t ch;
+
+            if ( ofs > static_cast<uint32_t>(MAX_MML_TEXT_LEN)+1 ) {
+
+                return -3;
+            }
+
+            len = read(p_user, static_cast<MML_OFS>(ofs), buf, MML_STREAM_WINDOW);
+            for ( k = 0; ( k < len ) && ( buf[k] != ',' ) && ( buf[k] != '\0' ); k++ ) {
+            }
+
+            if ( ( k == len ) && ( len == MML_STREAM_WINDOW ) ) {
+
+                ofs += len;
+                continue;
+            }
+
+            if ( ofs + k > static_cast<uint32_t>(MAX_MML_TEXT_LEN)+1 ) {
+
+                return -3;
+            }
+
+            ch = clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+            ofs_src_head[ch] = static_cast<MML_OFS>(ofs_ch);
+            layout.mml_len[ch] = static_cast<MML_OFS>(ofs + k - ofs_ch);
+            layout.num_ch_used++;
+            i++;
+
+            if ( ( k == len ) || ( buf[k] == '\0' ) ) {
+
+                break;
+            }
+
+            ofs += k + 1;
+            ofs_ch = ofs;
+        }
+
+#if PSGINO_USE_MML_PATTERN
+        /* The header was parsed in buf: patterns are not played from a reader. */
+        for ( i = 0; i < MAX_MML_PATTERNS; i++ ) {
+
+            layout.header.ofs_pattern[i] = 0;
+        }
+#endif
+#if PSGINO_MML_INSTRUMENTS
+        /* Read the header again: the instruments are compiled from buf now. */
+        len = read(p_user, 0, buf, MML_STREAM_WINDOW);
+        buf[len] = '\0';
+#endif
+        apply_mml_layout(slot, layout);
+#if PSGINO_MML_INSTRUMENTS
+        compile_instruments(slot);
+#endif
+#if PSGINO_USE_MML_HEADER_DEFS
+        /* The instruments were compiled from buf, which is not kept. */
+        slot.header.p_mml_top = nullptr;
+#endif
+
+        slot.mml_reader.read = read;
+        slot.mml_reader.p_user = p_user;
+        for ( i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            MML_WINDOW *p_win;
+            uint8_t ch;
+
+            ch = clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+            p_win = &slot.ch_info_list[ch]->window;
+            p_win->ofs_src_head = ofs_src_head[ch];
+            p_win->ofs_win = 0;
+            p_win->win_len = 0;
+        }
+
+        return 0;
+    }
+#endif
+
+#if PSGINO_USE_MML_QUEUE
+    int queue_mml(SLOT &slot, const char *p_mml, uint16_t mode, bool at_loop) {
+
+        int ret;
+        uint8_t req_seq;
+
+        req_seq = __atomic_load_n(&slot.next_mml.req_seq, __ATOMIC_RELAXED);
+        if ( __atomic_load_n(&slot.next_mml.ack_seq, __ATOMIC_ACQUIRE) != req_seq ) {
+
+            return -4;
+        }
+
+        ret = split_mml(slot, p_mml, mode, slot.next_mml.layout);
+        if ( ret < 0 ) {
+
+            return ret;
+        }
+        slot.next_mml.at_loop = at_loop ? 1 : 0;
+
+        /* Publish the layout. */
+        __atomic_store_n(&slot.next_mml.req_seq, static_cast<uint8_t>(req_seq+1), __ATOMIC_RELEASE);
+
+        return 0;
+    }
+
+    bool is_mml_queued(const SLOT &slot) {
+
+        return is_next_mml_pending(slot, false);
+    }
+#endif
+
+    void set_user_callback(
+            SLOT &slot,
+            void (*callback)(uint8_t ch, int32_t param)
+    ) {
+
+#if PSGINO_USE_USER_CALLBACK
+        slot.cb_info.user_callback = callback;
+#else
+        (void)slot;
+        (void)callback;
+#endif
+    }
+
+    void reset(SLOT &slot) {
+
+        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+
+            if ( slot.ch_info_list[i] != nullptr ) {
+
+                reset_ch_info(slot.ch_info_list[i]);
+            }
+        }
+
+        slot.gl_info.sys_status.SET_MML = 0;
+        slot.gl_info.sys_status.NUM_CH_USED = 0;
+#if PSGINO_USE_LIVE_NOTE
+        slot.gl_info.live_mask = 0;
+#endif
+        slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_STOP;
+        slot.gl_info.sys_status.CTRL_STAT_PRE = CTRL_STAT_STOP;
+        slot.gl_info.sys_request.CTRL_REQ = CTRL_REQ_STOP;
+        slot.gl_info.sys_request.CTRL_REQ_FLAG = 0;
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ = FIN_PRI_LOOP_REQ_NORMAL;
+        slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG = 0;
+#endif
+
+        slot.gl_info.noise_info = (NOISE_INFO){};
+#if PSGINO_USE_NOISE_SWEEP
+        slot.gl_info.noise_info.SWEEP_STAT = NOISE_SWEEP_STAT_STOP;
+#endif
+
+        reset_psg(slot.psg_reg);
+
+        /* The queue head belongs to control_psg, so the pending work is dropped there. */
+        slot.posted_mml.reset_seq = slot.posted_mml.req_seq;
+        __atomic_store_n(&slot.cmd_queue.epoch, static_cast<uint8_t>(slot.cmd_queue.epoch+1), __ATOMIC_RELEASE);
+    }
+
+    void set_speed_factor(SLOT &slot, uint16_t speed_factor) {
+
+        speed_factor = SAT(speed_factor, MIN_SPEED_FACTOR, MAX_SPEED_FACTOR);
+
+#if PSGINO_USE_SONG_CLOCK
+        /* The timers count in song ticks, so nothing needs to be rescaled. */
+        slot.gl_info.speed_factor = speed_factor;
+#else
+        uint16_t pre_speed_factor;
+        uint32_t q12_alpha;
+
+        pre_speed_factor = slot.gl_info.speed_factor;
+
+        q12_alpha = (static_cast<uint32_t>(pre_speed_factor) << 12) / speed_factor;
+
+        for ( uint8_t i = 0; i < NUM_CHANNEL; i++ ) {
+
+            CHANNEL_INFO *p_ch_info;
+            p_ch_info = slot.ch_info_list[i];
+
+            if ( p_ch_info != nullptr ) {
+
+                uint32_t q12_note_on_time;
+
+                q12_note_on_time = (static_cast<uint64_t>(p_ch_info->time.note_on)<<12);
+                q12_note_on_time += p_ch_info->time.NOTE_ON_FRAC;
+
+                q12_note_on_time = (static_cast<uint64_t>(q12_note_on_time) * q12_alpha + (1<<11))>>12;
+
+                p_ch_info->time.NOTE_ON_FRAC = q12_note_on_time&0xFFF;
+                p_ch_info->time.note_on = (q12_note_on_time>>12)&0xFFFF;
+
+                p_ch_info->time.gate = (static_cast<uint32_t>(p_ch_info->time.gate) * q12_alpha + (1<<11))>>12;
+#if PSGINO_USE_SW_ENV
+                p_ch_info->time.sw_env = (static_cast<uint32_t>(p_ch_info->time.sw_env) * q12_alpha + (1<<11))>>12;
+#endif
+#if PSGINO_USE_LFO
+                p_ch_info->time.lfo_delay = (static_cast<uint32_t>(p_ch_info->time.lfo_delay) * q12_alpha + (1<<11))>>12;
+#endif
+#if PSGINO_USE_PITCHBEND
+                p_ch_info->time.pitchbend = (static_cast<uint32_t>(p_ch_info->time.pitchbend) * q12_alpha + (1<<11))>>12;
+#endif
+            }
+        }
+
+        slot.gl_info.speed_factor = speed_factor;
+#endif
+    }
+
+    bool post_command(SLOT &slot, uint8_t type, int16_t param, const char *p_mml, uint8_t ch) {
+
+        CMD_QUEUE &q = slot.cmd_queue;
+        uint8_t tail = q.tail;
+        uint8_t next = (tail + 1) & (CMD_QUEUE_SIZE - 1);
+
+        if ( next == __atomic_load_n(&q.head, __ATOMIC_ACQUIRE) ) {
+
+            /* FULL */
+            return false;
+        }
+
+        q.cmds[tail].p_mml = p_mml;
+        q.cmds[tail].param = param;
+        q.cmds[tail].type = type;
+        q.cmds[tail].ch = ch;
+        q.cmds[tail].epoch = q.epoch;
+
+        /* Publish the entry. */
+        __atomic_store_n(&q.tail, next, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    int post_mml(SLOT &slot, const char *p_mml, uint16_t mode) {
+
+        int ret;
+        MML_LAYOUT layout;
+
+        ret = split_mml(slot, p_mml, mode, layout);
+        if ( ret < 0 ) {
+
+            return ret;
+        }
+
+        post_layout(slot, layout);
+
+        return 0;
+    }
+
+    void set_decode_budget(SLOT &slot, uint8_t budget) {
+
+        slot.gl_info.decode_budget = budget;
+    }
+
+    void shift_frequency(SLOT &slot, int16_t shift_degrees) {
+
+        slot.gl_info.shift_degrees = SAT(shift_degrees, MIN_FREQ_SHIFT_DEGREES, MAX_FREQ_SHIFT_DEGREES);
+   }
+
+#if PSGINO_USE_TIMING_STATS
+    void set_timing_counter(SLOT &slot, uint32_t (*counter)()) {
+
+        slot.timing.p_counter = counter;
+        reset_timing_stats(slot);
+    }
+
+    void reset_timing_stats(SLOT &slot) {
+
+        for ( uint8_t i = 0; i < NUM_TIMING_PHASE; i++ ) {
+
+            slot.timing.phase[i] = (TIMING_PHASE_STATS){};
+            slot.timing.phase[i].min = 0xFFFFFFFF;
+        }
+    }
+
+    uint32_t read_timing_counter(const SLOT &slot) {
+
+        return ( slot.timing.p_counter != nullptr ) ? slot.timing.p_counter() : 0;
+    }
+
+    void add_timing_sample(SLOT &slot, uint8_t phase, uint32_t cycles) {
+
+        TIMING_PHASE_STATS *p_stats;
+        uint8_t bin;
+
+        if ( phase >= NUM_TIMING_PHASE ) {
+
+            return;
+        }
+
+        p_stats = &slot.timing.phase[phase];
+
+        p_stats->min = ( cycles < p_stats->min ) ? cycles : p_stats->min;
+        p_stats->max = ( cycles > p_stats->max ) ? cycles : p_stats->max;
+        if ( p_stats->count < 0xFFFFFFFF ) {
+
+            p_stats->count++;
+        }
+
+        /* bin = number of significant bits */
+        bin = 0;
+        while ( ( cycles != 0 ) && ( bin < NUM_TIMING_HIST_BINS-1 ) ) {
+
+            cycles >>= 1;
+            bin++;
+        }
+        if ( p_stats->hist[bin] < 0xFFFF ) {
+
+            p_stats->hist[bin]++;
+        }
+    }
+#endif
+
+    uint16_t get_idle_ticks(const SLOT &slot) {
+
+        uint16_t idle = 0xFFFF;
+
+        /* PENDING COMMANDS (executed by the next control_psg call) */
+        if ( ( slot.cmd_queue.head != __atomic_load_n(&slot.cmd_queue.tail, __ATOMIC_ACQUIRE) ) ||
+             ( __atomic_load_n(&slot.posted_mml.req_seq, __ATOMIC_ACQUIRE) != slot.posted_mml.ack_seq )
+        ) {
+
+            return 0;
+        }
+
+#if PSGINO_USE_LIVE_NOTE
+        /* LIVE CHANNELS (run in every call, with or without an MML) */
+        if ( slot.gl_info.live_mask != 0 ) {
+
+            return 0;
+        }
+#endif
+
+#if PSGINO_USE_MML_QUEUE
+        /* QUEUED MML (starts at once if no MML is set or the current one has ended) */
+        if ( ( ( slot.gl_info.sys_status.SET_MML == 0 ) ||
+               ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_END ) ) &&
+             is_next_mml_pending(slot, false)
+        ) {
+
+            return 0;
+        }
+#endif
+
+        if ( slot.gl_info.sys_status.SET_MML == 0 ) {
+
+            return idle;
+        }
+
+        if ( slot.gl_info.sys_request.CTRL_REQ_FLAG != 0 ) {
+
+            return 0;
+        }
+
+        if ( ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_STOP ) ||
+             ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_END  )
+        ) {
+
+            return idle;
+        }
+
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        if ( ( slot.gl_info.sys_request.FIN_PRI_LOOP_REQ_FLAG != 0 ) ||
+             ( slot.gl_info.sys_status.FIN_PRI_LOOP_TRY > 0 )
+        ) {
+
+            return 0;
+        }
+#endif
+
+        bool is_all_ended = true;
+
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            uint8_t ch;
+            const CHANNEL_INFO *p_ch_info;
+
+            ch = clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+            p_ch_info = slot.ch_info_list[ch];
+
+            /* NOTE BOUNDARY (also of the last note: the song ends, or a queued MML starts,
+             * in the tick in which it runs out, even if it has been gated off before) */
+            if ( p_ch_info->time.note_on > 0 ) {
+
+                is_all_ended = false;
+                idle = ( idle < p_ch_info->time.note_on-1 ) ? idle : p_ch_info->time.note_on-1;
+
+            } else if ( p_ch_info->ch_status.DECODE_END == 0 ) {
+
+                return 0;
+
+            } else {
+            }
+
+            /* GATE TIME (a gate that is already 0 has been applied in the previous tick) */
+            if ( p_ch_info->time.gate > 0 ) {
+
+                idle = ( idle < p_ch_info->time.gate-1 ) ? idle : p_ch_info->time.gate-1;
+            }
+
+#if PSGINO_USE_PITCHBEND
+            /* PITCHBEND BLOCK */
+            if ( ( p_ch_info->ch_status.PBEND_STAT == PBEND_STAT_TP_UP   ) ||
+                 ( p_ch_info->ch_status.PBEND_STAT == PBEND_STAT_TP_DOWN )
+            ) {
+
+                return 0;
+            }
+#endif
+
+#if PSGINO_USE_SW_ENV
+            /* SOFTWARE ENVELOPE GENERATOR BLOCK */
+            if ( p_ch_info->ch_status.SW_ENV_MODE == 1 ) {
+
+                bool is_steady;
+
+                is_steady  = ( p_ch_info->ch_status.SW_ENV_STAT == SW_ENV_STAT_END );
+                is_steady |= ( ( p_ch_info->ch_status.SW_ENV_STAT == SW_ENV_STAT_FADE ) &&
+                               ( p_ch_info->sw_env.fade_tk == 0 ) &&
+                               ( p_ch_info->sw_env.VOL_INT == get_sus_volume(slot, ch) ) &&
+                               ( p_ch_info->sw_env.VOL_FRAC == 0 )
+                             );
+                is_steady &= ( (slot.psg_reg.data[0x8+ch]&0xF) == p_ch_info->sw_env.VOL_INT );
+
+                if ( !is_steady ) {
+
+                    return 0;
+                }
+            }
+#endif
+
+#if PSGINO_USE_LFO
+            /* LFO BLOCK */
+            if ( ( p_ch_info->ch_status.LFO_MODE == 1 ) &&
+                 ( p_ch_info->ch_status.LFO_STAT == LFO_STAT_RUN )
+            ) {
+
+                if ( get_lfo_omega(slot, p_ch_info) != 0 ) {
+
+                    idle = ( idle < p_ch_info->time.lfo_delay ) ? idle : p_ch_info->time.lfo_delay;
+                }
+            }
+#endif
+        }
+
+        /* Every channel has ended: the next tick finds the end of the song. */
+        if ( is_all_ended ) {
+
+            return 0;
+        }
+
+#if PSGINO_USE_NOISE_SWEEP
+        /* NOISE SWEEP BLOCK */
+        if ( ( slot.gl_info.noise_info.SWEEP_STAT == NOISE_SWEEP_STAT_NP_UP   ) ||
+             ( slot.gl_info.noise_info.SWEEP_STAT == NOISE_SWEEP_STAT_NP_DOWN )
+        ) {
+
+            return 0;
+        }
+#endif
+
+#if PSGINO_USE_SONG_CLOCK
+        /* Convert song ticks to calls: the largest count that does not complete `idle+1` song ticks. */
+        {
+            uint32_t ticks;
+            ticks = (static_cast<uint32_t>(idle) + 1) * DEFAULT_SPEED_FACTOR - slot.gl_info.speed_phase - 1;
+            ticks /= slot.gl_info.speed_factor;
+            idle = ( ticks < 0xFFFF ) ? static_cast<uint16_t>(ticks) : 0xFFFF;
+        }
+#endif
+
+        return idle;
+    }
+
+    void skip_ticks(SLOT &slot, uint16_t ticks) {
+
+        slot.gl_info.sys_status.CTRL_STAT_PRE = slot.gl_info.sys_status.CTRL_STAT;
+
+        if ( ( ticks == 0 ) ||
+             ( slot.gl_info.sys_status.SET_MML == 0 ) ||
+             ( slot.gl_info.sys_status.CTRL_STAT != CTRL_STAT_PLAY )
+        ) {
+
+            return;
+        }
+
+#if PSGINO_USE_SONG_CLOCK
+        {
+            uint32_t phase;
+            phase = static_cast<uint32_t>(ticks) * slot.gl_info.speed_factor + slot.gl_info.speed_phase;
+            slot.gl_info.speed_phase = phase % DEFAULT_SPEED_FACTOR;
+            phase /= DEFAULT_SPEED_FACTOR;
+            ticks = ( phase < 0xFFFF ) ? static_cast<uint16_t>(phase) : 0xFFFF;
+        }
+#endif
+
+#if PSGINO_USE_SEEK
+        slot.gl_info.song_tick += ticks;
+#endif
+
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            CHANNEL_INFO *p_ch_info;
+
+            p_ch_info = slot.ch_info_list[clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            )];
+
+            p_ch_info->time.note_on   = ( p_ch_info->time.note_on   > ticks ) ? (p_ch_info->time.note_on   - ticks) : 0;
+            p_ch_info->time.gate      = ( p_ch_info->time.gate      > ticks ) ? (p_ch_info->time.gate      - ticks) : 0;
+#if PSGINO_USE_PITCHBEND
+            p_ch_info->time.pitchbend = ( p_ch_info->time.pitchbend > ticks ) ? (p_ch_info->time.pitchbend - ticks) : 0;
+#endif
+
+#if PSGINO_USE_SW_ENV
+            if ( p_ch_info->ch_status.SW_ENV_MODE == 1 ) {
+
+                p_ch_info->time.sw_env = ( p_ch_info->time.sw_env > ticks ) ? (p_ch_info->time.sw_env - ticks) : 0;
+            }
+#endif
+
+#if PSGINO_USE_LFO
+            if ( ( p_ch_info->ch_status.LFO_MODE == 1 ) &&
+                 ( p_ch_info->ch_status.LFO_STAT == LFO_STAT_RUN )
+            ) {
+
+                p_ch_info->time.lfo_delay = ( p_ch_info->time.lfo_delay > ticks ) ? (p_ch_info->time.lfo_delay - ticks) : 0;
+            }
+#endif
+        }
+
+#if PSGINO_USE_NOISE_SWEEP
+        slot.gl_info.noise_info.sweep_time = ( slot.gl_info.noise_info.sweep_time > ticks )
+                                           ? (slot.gl_info.noise_info.sweep_time - ticks)
+                                           : 0;
+#endif
+    }
+
+#if PSGINO_USE_SEEK
+    void build_seek_index(
+            SLOT &slot,
+            SEEK_INDEX &index,
+            SEEK_POINT *p_points,
+            uint16_t max_points,
+            uint16_t interval,
+            uint32_t max_ticks
+    ) {
+
+        uint16_t speed_factor;
+
+        index.p_points = p_points;
+        index.p_mml = nullptr;
+        index.max_points = max_points;
+        index.num_points = 0;
+        index.interval = ( interval != 0 ) ? interval : 1;
+
+        /* Apply a pending SetMML. */
+        drain_commands(slot);
+
+        if ( ( slot.gl_info.sys_status.SET_MML == 0 ) || ( p_points == nullptr ) ) {
+
+            return;
+        }
+
+        /* The points are taken at 100% speed; seek rescales the timers to the current speed. */
+        speed_factor = slot.gl_info.speed_factor;
+        slot.gl_info.speed_factor = DEFAULT_SPEED_FACTOR;
+
+        reset_psg(slot.psg_reg);
+        rewind_mml(slot);
+        slot.gl_info.sys_request.CTRL_REQ_FLAG = 0;
+        slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+        index.p_mml = get_mml_head(slot);
+
+        while ( index.num_points < index.max_points ) {
+
+            save_seek_point(slot, p_points[index.num_points]);
+            index.num_points++;
+
+            if ( slot.gl_info.song_tick + index.interval > max_ticks ) {
+
+                break;
+            }
+
+            run_silently(slot, slot.gl_info.song_tick + index.interval);
+
+            if ( slot.gl_info.sys_status.CTRL_STAT != CTRL_STAT_PLAY ) {
+
+                break;
+            }
+        }
+
+        slot.gl_info.speed_factor = speed_factor;
+
+        /* Leave the SLOT stopped and muted, as after Stop(). */
+        rewind_mml(slot);
+        reset_psg(slot.psg_reg);
+        slot.psg_reg.flags_addr = 1<<0x7;
+        slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_STOP;
+    }
+
+    void seek(SLOT &slot, const SEEK_INDEX *p_index, uint32_t song_tick) {
+
+        uint16_t speed_factor;
+
+        /* Apply a pending SetMML. */
+        drain_commands(slot);
+
+        if ( slot.gl_info.sys_status.SET_MML == 0 ) {
+
+            return;
+        }
+
+        speed_factor = slot.gl_info.speed_factor;
+        slot.gl_info.speed_factor = DEFAULT_SPEED_FACTOR;
+
+        rewind_mml(slot);
+        slot.gl_info.sys_request.CTRL_REQ_FLAG = 0;
+        slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+
+        if ( ( p_index != nullptr ) &&
+             ( p_index->num_points > 0 ) &&
+             ( p_index->p_mml == get_mml_head(slot) )
+        ) {
+
+            uint32_t i = song_tick / p_index->interval;
+            if ( i >= p_index->num_points ) {
+
+                i = p_index->num_points - 1;
+            }
+            load_seek_point(slot, p_index->p_points[i]);
+        }
+
+        run_silently(slot, song_tick);
+
+        /* Rescale the timers from 100% to the current speed. */
+        set_speed_factor(slot, speed_factor);
+
+        /* Output every register of the channels in the next tick. */
+        slot.psg_reg.flags_addr = 0x3FFF;
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            slot.psg_reg.flags_mixer |= 1<<clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+        }
+    }
+#endif
+
+    int check_song(const void *p_image, uint32_t size) {
+
+        const SONG_HEADER *p_header = static_cast<const SONG_HEADER *>(p_image);
+
+        if ( ( p_image == nullptr ) ||
+             ( ( reinterpret_cast<uintptr_t>(p_image) % alignof(SONG_HEADER) ) != 0 ) ||
+             ( size < sizeof(SONG_HEADER) ) ||
+             ( p_header->magic != SONG_MAGIC ) ||
+             ( p_header->version != SONG_VERSION )
+        ) {
+
+            return -1;
+        }
+
+        if ( ( p_header->image_size > size ) ||
+             ( p_header->num_channels == 0 ) ||
+             ( p_header->num_channels > NUM_CHANNEL ) ||
+             ( p_header->ofs_mml >= p_header->image_size )
+        ) {
+
+            return -2;
+        }
+
+        for ( uint8_t i = 0; i < p_header->num_channels; i++ ) {
+
+            if ( ( p_header->ofs_channel[i] > p_header->image_size ) ||
+                 ( p_header->len_channel[i] > p_header->image_size - p_header->ofs_channel[i] )
+            ) {
+
+                return -2;
+            }
+            if ( p_header->len_channel[i] > MAX_MML_TEXT_LEN ) {
+
+                return -3;
+            }
+        }
+
+        if ( ( p_header->ofs_seek != 0 ) &&
+             ( ( p_header->ofs_seek > p_header->image_size ) ||
+               ( static_cast<uint64_t>(p_header->num_seek_points) * p_header->seek_point_size >
+                 p_header->image_size - p_header->ofs_seek ) )
+        ) {
+
+            return -2;
+        }
+
+        return 0;
+    }
+
+    int set_song(SLOT &slot, const void *p_image, uint32_t size) {
+
+        int ret;
+
+        ret = check_song(p_image, size);
+        if ( ret < 0 ) {
+
+            return ret;
+        }
+
+        MML_LAYOUT layout;
+
+        split_song(slot, static_cast<const SONG_HEADER *>(p_image), layout);
+        apply_mml_layout(slot, layout);
+
+        return 0;
+    }
+
+    int post_song(SLOT &slot, const void *p_image, uint32_t size) {
+
+        int ret;
+        MML_LAYOUT layout;
+
+        ret = check_song(p_image, size);
+        if ( ret < 0 ) {
+
+            return ret;
+        }
+
+        split_song(slot, static_cast<const SONG_HEADER *>(p_image), layout);
+        post_layout(slot, layout);
+
+        return 0;
+    }
+
+#if PSGINO_USE_SEEK
+    void get_song_seek_index(const SLOT &slot, const void *p_image, SEEK_INDEX &index) {
+
+        const SONG_HEADER *p_header = static_cast<const SONG_HEADER *>(p_image);
+        const char *p_bytes = static_cast<const char *>(p_image);
+
+        index = (SEEK_INDEX){};
+
+        if ( ( p_header->ofs_seek == 0 ) ||
+             ( p_header->num_seek_points == 0 ) ||
+             ( p_header->seek_config != STATE_CONFIG ) ||
+             ( p_header->seek_point_size != sizeof(SEEK_POINT) ) ||
+             ( p_header->s_clock != slot.gl_info.s_clock ) ||
+             ( p_header->proc_freq != get_proc_freq(slot) ) ||
+             ( ( reinterpret_cast<uintptr_t>(&p_bytes[p_header->ofs_seek]) % alignof(SEEK_POINT) ) != 0 )
+        ) {
+
+            return;
+        }
+
+        index.p_points = reinterpret_cast<const SEEK_POINT *>(&p_bytes[p_header->ofs_seek]);
+        /* seek compares this with the head of the first channel, as set by apply_song. */
+        index.p_mml = &p_bytes[p_header->ofs_channel[0]];
+        index.max_points = p_header->num_seek_points;
+        index.num_points = p_header->num_seek_points;
+        index.interval = ( p_header->seek_interval != 0 ) ? p_header->seek_interval : 1;
+    }
+#endif
+
+    int analyze_mml(
+            const char *p_mml,
+            uint16_t mode,
+            uint32_t s_clock,
+            uint16_t proc_freq,
+            SONG_INFO &info,
+            uint32_t max_ticks
+    ) {
+
+        /* Position of a channel right after the first note of its infinite loop. */
+        struct LOOP_MARK {
+            MML_OFS     ofs_mml_pos;
+            uint8_t     loop_depth;
+            uint8_t     loop_times[MAX_LOOP_NESTING_DEPTH];
+        };
+
+        SLOT slot;
+        CHANNEL_INFO ch_info[NUM_CHANNEL];
+        LOOP_MARK marks[NUM_CHANNEL];
+        TIMING_PROBE probe;
+        uint32_t song_tick = 0;
+        int ret;
+
+        info = (SONG_INFO){};
+        for ( uint8_t ch = 0; ch < NUM_CHANNEL; ch++ ) {
+
+            info.loop_start_tick[ch] = NO_LOOP;
+        }
+
+        init_slot(slot, s_clock, proc_freq, false, &ch_info[0], &ch_info[1], &ch_info[2]);
+        ret = set_mml(slot, p_mml, mode);
+        if ( ret < 0 ) {
+
+            return ret;
+        }
+        info.num_channels = slot.gl_info.sys_status.NUM_CH_USED;
+
+        rewind_mml(slot);
+        slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+
+        while ( song_tick < max_ticks ) {
+
+            bool will_decode[NUM_CHANNEL];
+            uint32_t tick = song_tick++;
+            uint8_t num_writes = 0;
+            bool settled = true;
+
+            for ( uint8_t ch = 0; ch < info.num_channels; ch++ ) {
+
+                will_decode[ch] = ( ch_info[ch].time.note_on <= 1 ) && ( ch_info[ch].ch_status.DECODE_END == 0 );
+            }
+
+            run_song_tick(slot, probe);
+
+            for ( uint8_t addr = 0; addr < 16; addr++ ) {
+
+                num_writes += (slot.psg_reg.flags_addr >> addr) & 0x1;
+            }
+            slot.psg_reg.flags_addr = 0;
+            slot.psg_reg.flags_mixer = 0;
+
+#if PSGINO_USE_CMD_COUNT
+            if ( slot.gl_info.tick_cmds > info.max_cmds_per_tick ) {
+
+                info.max_cmds_per_tick = slot.gl_info.tick_cmds;
+                info.peak_cmds_tick = tick;
+            }
+#endif
+            if ( num_writes > info.max_writes_per_tick ) {
+
+                info.max_writes_per_tick = num_writes;
+                info.peak_writes_tick = tick;
+            }
+
+            for ( uint8_t ch = 0; ch < info.num_channels; ch++ ) {
+
+                const CHANNEL_INFO &c = ch_info[ch];
+                LOOP_MARK mark;
+
+                if ( ( will_decode[ch] ) &&
+                     ( c.ch_status.DECODE_END == 0 ) &&
+                     ( c.ch_status.LOOP_DEPTH >= 1 ) &&
+                     ( c.mml.loop_times[0] == 0 )
+                ) {
+
+                    mark.ofs_mml_pos = c.mml.ofs_mml_pos;
+                    mark.loop_depth = c.ch_status.LOOP_DEPTH;
+                    for ( uint8_t d = 0; d < mark.loop_depth; d++ ) {
+
+                        mark.loop_times[d] = c.mml.loop_times[d];
+                    }
+
+                    if ( info.loop_start_tick[ch] == NO_LOOP ) {
+
+                        marks[ch] = mark;
+                        info.loop_start_tick[ch] = tick;
+                        info.loop_ofs[ch] = c.mml.ofs_mml_loop_head[0];
+                        info.loops_forever = true;
+
+                    } else if ( info.loop_ticks[ch] == 0 ) {
+
+                        bool same = ( marks[ch].ofs_mml_pos == mark.ofs_mml_pos ) &&
+                                    ( marks[ch].loop_depth == mark.loop_depth );
+                        for ( uint8_t d = 0; same && ( d < mark.loop_depth ); d++ ) {
+
+                            same = ( marks[ch].loop_times[d] == mark.loop_times[d] );
+                        }
+                        if ( same ) {
+
+                            info.loop_ticks[ch] = tick - info.loop_start_tick[ch];
+                        }
+
+                    } else {
+                    }
+                }
+
+                /* A channel is settled when its last note has ended or one pass of its loop is measured. */
+                if ( ( ( c.ch_status.DECODE_END == 0 ) || ( c.time.note_on != 0 ) ) &&
+                     ( info.loop_ticks[ch] == 0 )
+                ) {
+
+                    settled = false;
+                }
+            }
+
+            if ( ( slot.gl_info.sys_status.CTRL_STAT != CTRL_STAT_PLAY ) ||
+                 ( ( info.loops_forever ) && ( settled ) )
+            ) {
+
+                info.complete = true;
+                break;
+            }
+        }
+
+        info.total_ticks = song_tick;
+        info.total_ms = (info.total_ticks / get_proc_freq(slot)) * 1000
+                      + ((info.total_ticks % get_proc_freq(slot)) * 1000) / get_proc_freq(slot);
+
+        return ret;
+    }
+
+    void save_state(SLOT &slot, SLOT_STATE &state) {
+
+        const char *p_first;
+
+        /* Apply pending requests first, so that they are part of the state. */
+        drain_commands(slot);
+
+        state.version = STATE_VERSION;
+        state.config = STATE_CONFIG;
+        state.size = sizeof(SLOT_STATE);
+        state.gl_info = slot.gl_info;
+        for ( uint8_t i = 0; i < 16; i++ ) {
+
+            state.psg_data[i] = slot.psg_reg.data[i];
+        }
+
+        p_first = ( slot.gl_info.sys_status.SET_MML != 0 ) ? get_mml_head(slot) : nullptr;
+
+        for ( uint8_t ch = 0; ch < NUM_CHANNEL; ch++ ) {
+
+            state.ofs_mml_head[ch] = 0;
+
+            if ( slot.ch_info_list[ch] != nullptr ) {
+
+                state.ch_info[ch] = *slot.ch_info_list[ch];
+                if ( ( p_first != nullptr ) && ( state.ch_info[ch].mml.p_mml_head >= p_first ) ) {
+
+                    state.ofs_mml_head[ch] = static_cast<uint32_t>(state.ch_info[ch].mml.p_mml_head - p_first);
+                }
+
+            } else {
+
+                state.ch_info[ch] = (CHANNEL_INFO){};
+            }
+            state.ch_info[ch].mml.p_mml_head = nullptr;
+        }
+    }
+
+    bool restore_state(SLOT &slot, const SLOT_STATE &state, const char *p_mml) {
+
+        const char *p_first;
+
+        if ( ( state.version != STATE_VERSION ) ||
+             ( state.config != STATE_CONFIG ) ||
+             ( state.size != sizeof(SLOT_STATE) ) ||
+             ( state.gl_info.sys_status.REVERSE != slot.gl_info.sys_status.REVERSE ) ||
+             ( state.gl_info.sys_status.NUM_CH_IMPL != slot.gl_info.sys_status.NUM_CH_IMPL )
+        ) {
+
+            return false;
+        }
+
+        drain_commands(slot);
+
+        if ( state.gl_info.sys_status.SET_MML != 0 ) {
+
+            if ( p_mml == nullptr ) {
+
+                return false;
+            }
+
+            MML_LAYOUT layout;
+
+            /* Locate the first channel the same way as set_mml. */
+            if ( split_mml(slot, p_mml, 0, layout) < 0 ) {
+
+                return false;
+            }
+            p_first = layout.p_mml_head[clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-1 : 0
+            )];
+#if PSGINO_USE_MML_HEADER_DEFS
+            slot.header = layout.header;
+#endif
+
+        } else {
+
+            p_first = nullptr;
+        }
+
+        slot.gl_info = state.gl_info;
+        for ( uint8_t i = 0; i < 16; i++ ) {
+
+            slot.psg_reg.data[i] = state.psg_data[i];
+        }
+
+        for ( uint8_t ch = 0; ch < NUM_CHANNEL; ch++ ) {
+
+            if ( slot.ch_info_list[ch] != nullptr ) {
+
+                *slot.ch_info_list[ch] = state.ch_info[ch];
+                slot.ch_info_list[ch]->mml.p_mml_head = ( p_first != nullptr ) ? (p_first + state.ofs_mml_head[ch]) : nullptr;
+            }
+        }
+
+#if PSGINO_MML_INSTRUMENTS
+        compile_instruments(slot);
+#endif
+
+        /* Output every register of the channels in the next tick. */
+        slot.psg_reg.flags_addr = 0x3FFF;
+        slot.psg_reg.flags_mixer = 0;
+        for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+            slot.psg_reg.flags_mixer |= 1<<clamp_channel(
+                    ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                    NUM_CHANNEL-(i+1) : i
+            );
+        }
+
+        return true;
+    }
+
+    void control_psg(SLOT &slot) {
+
+        uint8_t ch;
+        TIMING_PROBE probe;
+
+        timing_begin(slot, probe);
+
+        slot.gl_info.sys_status.CTRL_STAT_PRE = slot.gl_info.sys_status.CTRL_STAT;
+
+        drain_commands(slot);
+
+#if PSGINO_USE_LIVE_NOTE
+        /* Live channels run in every call, with or without an MML. */
+        run_live_tick(slot, probe);
+#endif
+
+#if PSGINO_USE_MML_QUEUE
+        /* No MML is set: the queued MML starts at once. */
+        if ( ( slot.gl_info.sys_status.SET_MML == 0 ) &&
+             is_next_mml_pending(slot, false)
+        ) {
+
+            switch_to_next_mml(slot);
+            slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+        }
+#endif
+
+        if ( slot.gl_info.sys_status.SET_MML == 0 ) {
+
+            return;
+        }
+
+        if ( slot.gl_info.sys_request.CTRL_REQ_FLAG != 0 ) {
+
+            slot.gl_info.sys_request.CTRL_REQ_FLAG = 0;
+
+            if ( slot.gl_info.sys_request.CTRL_REQ == CTRL_REQ_PLAY ) {
+
+                rewind_mml(slot);
+                slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+
+            } else {
+
+                slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_STOP;
+                for ( uint8_t i = 0; i < slot.gl_info.sys_status.NUM_CH_USED; i++ ) {
+
+                    ch = clamp_channel(
+                            ( slot.gl_info.sys_status.REVERSE == 1 ) ?
+                            NUM_CHANNEL-(i+1) : i
+                    );
+                    if ( !is_live_channel(slot, ch) ) {
+
+                        slot.psg_reg.data[0x7]   |= 0x9<<ch;
+                        slot.psg_reg.flags_mixer |= 0x1<<ch;
+                    }
+                }
+                slot.psg_reg.flags_addr  |= 1<<0x7;
+            }
+        }
+
+#if PSGINO_USE_MML_QUEUE
+        /* The current MML has ended: the queued MML starts at once. */
+        if ( ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_END ) &&
+             is_next_mml_pending(slot, false)
+        ) {
+
+            switch_to_next_mml(slot);
+            slot.gl_info.sys_status.CTRL_STAT = CTRL_STAT_PLAY;
+        }
+#endif
+
+        if ( ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_STOP ) ||
+             ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_END  )
+        ) {
+
+            return;
+        }
+
+#if PSGINO_USE_SONG_CLOCK
+        /* Run one song tick for every 100% of accumulated speed factor. */
+        slot.gl_info.speed_phase += slot.gl_info.speed_factor;
+        while ( ( slot.gl_info.speed_phase >= DEFAULT_SPEED_FACTOR ) &&
+                ( slot.gl_info.sys_status.CTRL_STAT == CTRL_STAT_PLAY )
+        ) {
+
+            slot.gl_info.speed_phase -= DEFAULT_SPEED_FACTOR;
+            run_song_tick(slot, probe);
+        }
+#else
+        run_song_tick(slot, probe);
+#endif
+
+        timing_mark(slot, probe, TIMING_PHASE_DECODE);
+        timing_end(slot, probe);
+    }
 }
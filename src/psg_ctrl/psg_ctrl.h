@@ -8,8 +8,11 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "psg_ctrl_config.h"
 
+#if !PSGINO_LAYOUT_SPEED
 #pragma pack(1)
+#endif
 
 namespace PsgCtrl {
 
@@ -26,6 +29,47 @@ namespace PsgCtrl {
     constexpr int16_t FIN_PRI_LOOP_REQ_NORMAL       = (0);
     constexpr int16_t FIN_PRI_LOOP_REQ_FORCE        = (1);
 
+    constexpr uint8_t CMD_PLAY                      = (0);
+    constexpr uint8_t CMD_STOP                      = (1);
+    constexpr uint8_t CMD_SET_MML                   = (2);        /* p_mml: MML_LAYOUT of post_mml or post_song */
+    constexpr uint8_t CMD_SET_SPEED_FACTOR          = (3);        /* param: speed factor */
+    constexpr uint8_t CMD_SHIFT_FREQUENCY           = (4);        /* param: shift degrees */
+    constexpr uint8_t CMD_FIN_PRI_LOOP              = (5);        /* param: 1 to force */
+    constexpr uint8_t CMD_NOTE_ON                   = (6);        /* ch, param: volume<<8 | note number */
+    constexpr uint8_t CMD_NOTE_OFF                  = (7);        /* ch */
+    constexpr uint8_t CMD_SET_PITCHBEND             = (8);        /* ch, param: bend in degrees */
+    constexpr uint8_t CMD_SET_INSTRUMENT            = (9);        /* ch, param: instrument number */
+    constexpr uint8_t CMD_SET_EFFECT                = (10);       /* ch, p_mml: letter of the $ command, param: value */
+
+    constexpr uint32_t NO_LOOP                      = (0xFFFFFFFFUL);
+
+    constexpr uint8_t STATE_VERSION                 = (2);
+    /* Build settings that change the layout of SLOT_STATE. */
+    constexpr uint8_t STATE_CONFIG                  = (
+            ((PSGINO_LAYOUT_SPEED            ? 1 : 0) << 0) |
+            ((PSGINO_USE_SW_ENV              ? 1 : 0) << 1) |
+            ((PSGINO_USE_LFO                 ? 1 : 0) << 2) |
+            ((PSGINO_USE_PITCHBEND           ? 1 : 0) << 3) |
+            ((PSGINO_USE_NOISE_SWEEP         ? 1 : 0) << 4) |
+            ((PSGINO_USE_FINISH_PRIMARY_LOOP ? 1 : 0) << 5) |
+            ((PSGINO_USE_DECODE_AHEAD        ? 1 : 0) << 6) |
+            ((PSGINO_USE_SONG_CLOCK          ? 1 : 0) << 7)
+    );
+
+    constexpr uint8_t CMD_QUEUE_SIZE                = (PSGINO_CMD_QUEUE_SIZE);
+    static_assert(
+        ( CMD_QUEUE_SIZE >= 2 ) && ( CMD_QUEUE_SIZE <= 128 ) && ( (CMD_QUEUE_SIZE & (CMD_QUEUE_SIZE-1)) == 0 ),
+        "PSGINO_CMD_QUEUE_SIZE must be a power of two between 2 and 128"
+    );
+
+#if PSGINO_USE_MML_STREAM
+    constexpr uint8_t MML_STREAM_WINDOW             = (PSGINO_MML_STREAM_WINDOW);
+    static_assert(
+        ( MML_STREAM_WINDOW >= 16 ) && ( MML_STREAM_WINDOW <= 254 ),
+        "PSGINO_MML_STREAM_WINDOW must be between 16 and 254"
+    );
+#endif
+
     constexpr int16_t PBEND_STAT_STOP               = (0);
     constexpr int16_t PBEND_STAT_TP_UP              = (1);
     constexpr int16_t PBEND_STAT_TP_DOWN            = (2);
@@ -60,7 +104,7 @@ namespace PsgCtrl {
     constexpr int16_t LFO_STAT_RUN                  = (1);
 
     constexpr int16_t MAX_LFO_PERIOD                = (10);       /* unit: sec. */
-    constexpr uint16_t DEFAULT_PROC_FREQ            = (100);      /* Hz */
+    constexpr uint16_t DEFAULT_PROC_FREQ            = PSGINO_PROC_FREQ ? PSGINO_PROC_FREQ : (100); /* Hz */
 
     constexpr int16_t MIN_NOTE_NUMBER               = (0);
     constexpr int16_t MAX_NOTE_NUMBER               = (95);
@@ -82,8 +126,16 @@ namespace PsgCtrl {
 
     constexpr int16_t MAX_LOOP_NESTING_DEPTH        = (7);
 
+    constexpr uint8_t MAX_MML_PATTERNS              = (16);       /* P0-P15 */
+    constexpr uint8_t NUM_MML_INSTRUMENTS           = (PSGINO_MML_INSTRUMENTS);
+    static_assert(NUM_MML_INSTRUMENTS <= 32, "PSGINO_MML_INSTRUMENTS must be between 0 and 32");
+    constexpr uint8_t MAX_MML_CALL_DEPTH            = (4);
+
     constexpr int16_t MAX_FIN_PRI_LOOP_TRY          = (15);
 
+    constexpr uint8_t DEFAULT_DECODE_BUDGET         = (0);        /* 0: unlimited */
+    constexpr uint8_t MAX_DECODE_DEBT               = (7);        /* unit: ticks */
+
     constexpr int16_t MIN_LOOP_TIMES                = (0);
     constexpr int16_t MAX_LOOP_TIMES                = (255);
     constexpr int16_t DEFAULT_LOOP_TIMES            = (1);
@@ -116,7 +168,13 @@ namespace PsgCtrl {
     constexpr int16_t MAX_NOTE_LENGTH               = (128);
     constexpr int16_t DEFAULT_NOTE_LENGTH           = (4);
 
-    constexpr uint16_t MAX_MML_TEXT_LEN             = (0xFFFE);
+#if PSGINO_USE_MML_OFS32
+    typedef uint32_t MML_OFS;   /* Position in an MML */
+    constexpr MML_OFS MAX_MML_TEXT_LEN              = (0xFFFFFFFEUL);
+#else
+    typedef uint16_t MML_OFS;   /* Position in an MML */
+    constexpr MML_OFS MAX_MML_TEXT_LEN              = (0xFFFE);
+#endif
 
     constexpr int16_t SW_ENV_MODE_OFF               = (0);
     constexpr int16_t SW_ENV_MODE_ON                = (1);
@@ -190,59 +248,93 @@ namespace PsgCtrl {
     constexpr int32_t Q_CALCTP_FACTOR_N             = (15835583);   /* POW(2,-1/12)  << 24 */
 
     struct SYS_STATUS {
-        uint16_t    SET_MML        : 1;
-        uint16_t    REVERSE        : 1;
-        uint16_t    NUM_CH_IMPL    : 2;
-        uint16_t    NUM_CH_USED    : 2;
-        uint16_t    RH_LEN         : 1;
-        uint16_t    CTRL_STAT      : 2;
-        uint16_t    CTRL_STAT_PRE  : 2;
-        uint16_t    FIN_PRI_LOOP_TRY : 4;
-        uint16_t                   : 1;
+        uint16_t    SET_MML        PSG_CTRL_BITS(1);
+        uint16_t    REVERSE        PSG_CTRL_BITS(1);
+        uint16_t    NUM_CH_IMPL    PSG_CTRL_BITS(2);
+        uint16_t    NUM_CH_USED    PSG_CTRL_BITS(2);
+        uint16_t    RH_LEN         PSG_CTRL_BITS(1);
+        uint16_t    CTRL_STAT      PSG_CTRL_BITS(2);
+        uint16_t    CTRL_STAT_PRE  PSG_CTRL_BITS(2);
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        uint16_t    FIN_PRI_LOOP_TRY PSG_CTRL_BITS(4);
+        PSG_CTRL_PAD(uint16_t, 1)
+#endif
     };
 
     struct SYS_REQUEST {
-        uint8_t    CTRL_REQ                 : 2;
-        uint8_t    FIN_PRI_LOOP_REQ         : 1;
-        uint8_t                             : 5;
-        uint8_t    CTRL_REQ_FLAG            : 1;
-        uint8_t    FIN_PRI_LOOP_REQ_FLAG    : 1;
-        uint8_t                             : 6;
+        uint8_t    CTRL_REQ                 PSG_CTRL_BITS(2);
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        uint8_t    FIN_PRI_LOOP_REQ         PSG_CTRL_BITS(1);
+        PSG_CTRL_PAD(uint8_t, 5)
+#else
+        PSG_CTRL_PAD(uint8_t, 6)
+#endif
+        uint8_t    CTRL_REQ_FLAG            PSG_CTRL_BITS(1);
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        uint8_t    FIN_PRI_LOOP_REQ_FLAG    PSG_CTRL_BITS(1);
+        PSG_CTRL_PAD(uint8_t, 6)
+#else
+        PSG_CTRL_PAD(uint8_t, 7)
+#endif
     };
 
     struct CH_STATUS {
-        uint16_t    DECODE_END     : 1;
-        uint16_t    LEGATO         : 1;
-        uint16_t    LFO_MODE       : 3;
-        uint16_t    LFO_STAT       : 1;
-        uint16_t    SW_ENV_MODE    : 1;
-        uint16_t    SW_ENV_STAT    : 3;
-        uint16_t    PBEND_STAT     : 2;
-        uint16_t    LOOP_DEPTH     : 3;
-        uint16_t    END_PRI_LOOP   : 1;
+        uint16_t    DECODE_END     PSG_CTRL_BITS(1);
+        uint16_t    LEGATO         PSG_CTRL_BITS(1);
+#if PSGINO_USE_LFO
+        uint16_t    LFO_MODE       PSG_CTRL_BITS(3);
+        uint16_t    LFO_STAT       PSG_CTRL_BITS(1);
+#endif
+#if PSGINO_USE_SW_ENV
+        uint16_t    SW_ENV_MODE    PSG_CTRL_BITS(1);
+        uint16_t    SW_ENV_STAT    PSG_CTRL_BITS(3);
+#endif
+#if PSGINO_USE_PITCHBEND
+        uint16_t    PBEND_STAT     PSG_CTRL_BITS(2);
+#endif
+        uint16_t    LOOP_DEPTH     PSG_CTRL_BITS(3);
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
+        uint16_t    END_PRI_LOOP   PSG_CTRL_BITS(1);
+#endif
     };
 
     struct NOISE_INFO {
+#if PSGINO_USE_NOISE_SWEEP
         uint16_t    sweep_time;
-        uint16_t    NP_INT         : 5;
-        uint16_t    NP_FRAC        : 6;
-        uint16_t    NP_END         : 5;
-        uint16_t    NP_D_INT       : 5;
-        uint16_t    NP_D_FRAC      : 6;
-        uint16_t    SWEEP_STAT     : 2;
-        uint16_t                   : 3;
-        uint8_t     NP_I           : 5;
-        uint8_t                    : 3;
+        uint16_t    NP_INT         PSG_CTRL_BITS(5);
+        uint16_t    NP_FRAC        PSG_CTRL_BITS(6);
+        uint16_t    NP_END         PSG_CTRL_BITS(5);
+        uint16_t    NP_D_INT       PSG_CTRL_BITS(5);
+        uint16_t    NP_D_FRAC      PSG_CTRL_BITS(6);
+        uint16_t    SWEEP_STAT     PSG_CTRL_BITS(2);
+        PSG_CTRL_PAD(uint16_t, 3)
+#endif
+        uint8_t     NP_I           PSG_CTRL_BITS(5);
+        PSG_CTRL_PAD(uint8_t, 3)
     };
 
     struct GLOBAL_INFO {
         SYS_STATUS  sys_status;
         SYS_REQUEST sys_request;
         uint32_t    s_clock;
+#if PSGINO_USE_SEEK
+        uint32_t    song_tick;          /* Song ticks run since playback started. */
+#endif
         uint16_t    proc_freq;
         uint16_t    speed_factor;
+#if PSGINO_USE_SONG_CLOCK
+        uint16_t    speed_phase;        /* Accumulated speed factor not yet run as a song tick (0-99). */
+#endif
         int16_t     shift_degrees;
         uint8_t     mml_version;
+        uint8_t     decode_budget;
+#if PSGINO_USE_CMD_COUNT
+        uint8_t     tick_cmds;          /* MML commands decoded in the last song tick (saturates at 255). */
+#endif
+#if PSGINO_USE_LIVE_NOTE
+        uint8_t     live_mask;          /* Channels played by the live commands instead of the MML. */
+        uint8_t     live_note[NUM_CHANNEL];     /* Note number of the last CMD_NOTE_ON of each channel. */
+#endif
         NOISE_INFO  noise_info;
     };
 
@@ -250,47 +342,96 @@ namespace PsgCtrl {
         void (*user_callback)(uint8_t ch, int32_t param);
     };
 
+#if PSGINO_USE_MML_PATTERN
+    /* Return point of a pattern call (@P). */
+    struct MML_CALL {
+        MML_OFS     ofs_ret;
+        uint8_t     PATTERN        PSG_CTRL_BITS(5);    /* Text of the caller, as MML_INFO::PATTERN */
+        uint8_t     LOOP_DEPTH     PSG_CTRL_BITS(3);    /* Loop depth of the caller */
+    };
+#endif
+
     struct MML_INFO {
         const char *p_mml_head;
-        uint16_t    mml_len;
-        uint16_t    ofs_mml_pos;
-        uint16_t    ofs_mml_loop_head[MAX_LOOP_NESTING_DEPTH];
+        MML_OFS     mml_len;
+        MML_OFS     ofs_mml_pos;
+        MML_OFS     ofs_mml_loop_head[MAX_LOOP_NESTING_DEPTH];
         uint8_t     loop_times[MAX_LOOP_NESTING_DEPTH];
+#if PSGINO_USE_FINISH_PRIMARY_LOOP
         uint8_t     prim_loop_counter;
+#endif
+#if PSGINO_USE_MML_PATTERN
+        MML_CALL    call_stack[MAX_MML_CALL_DEPTH];
+        uint8_t     PATTERN        PSG_CTRL_BITS(5);    /* 0: the channel, n: pattern P<n-1>. Positions are relative to it. */
+        uint8_t     CALL_DEPTH     PSG_CTRL_BITS(3);
+#endif
+    };
+
+#if PSGINO_USE_MML_STREAM
+    /* Bytes [ofs_win, ofs_win+win_len) of the MML of a channel read by set_mml_reader. */
+    struct MML_WINDOW {
+        MML_OFS     ofs_src_head;                   /* Offset of the channel in the source */
+        MML_OFS     ofs_win;                        /* Offset of buf[0] in the channel */
+        uint8_t     win_len;
+        char        buf[MML_STREAM_WINDOW+1];       /* NUL-terminated */
     };
 
+    /**
+     * @brief Reads MML text for set_mml_reader.
+     *
+     * @param p_user The user pointer given to set_mml_reader.
+     * @param ofs Offset in the MML source.
+     * @param p_buf Destination.
+     * @param len Number of bytes requested.
+     * @return Number of bytes read. Less than len only at the end of the source.
+     */
+    typedef uint16_t (*MML_READ_FUNC)(void *p_user, MML_OFS ofs, char *p_buf, uint16_t len);
+
+    struct MML_READER {
+        MML_READ_FUNC   read;                       /* nullptr: the MML is a string. */
+        void           *p_user;
+    };
+#endif
+
     struct TONE_INFO {
         uint16_t    tempo;
         uint8_t     note_len;
         int8_t      tp_ofs;
-        uint8_t     OCTAVE     : 3;
-        uint8_t     GATE_TIME  : 3;
-        uint8_t     LEN_DOTS   : 2;
-        uint16_t    HW_ENV     : 1;
-        uint16_t    VOLUME     : 4;
-        uint16_t    BIAS       :10;
-        uint16_t               : 1;
+        uint8_t     OCTAVE     PSG_CTRL_BITS(3);
+        uint8_t     GATE_TIME  PSG_CTRL_BITS(3);
+        uint8_t     LEN_DOTS   PSG_CTRL_BITS(2);
+        uint16_t    HW_ENV     PSG_CTRL_BITS(1);
+        uint16_t    VOLUME     PSG_CTRL_BITS(4);
+        uint16_t    BIAS       PSG_CTRL_BITS(10);
+        PSG_CTRL_PAD(uint16_t, 1)
     };
 
     struct TIME_INFO {
         uint16_t    note_on;
         uint16_t    gate;
+#if PSGINO_USE_SW_ENV
         uint16_t    sw_env;
+#endif
+#if PSGINO_USE_LFO
         uint16_t    lfo_delay;
+#endif
+#if PSGINO_USE_PITCHBEND
         uint16_t    pitchbend;
-        uint16_t    NOTE_ON_FRAC   :12;
-        uint16_t                   : 4;
+#endif
+        uint16_t    NOTE_ON_FRAC   PSG_CTRL_BITS(12);
+        uint16_t    DECODE_DEBT    PSG_CTRL_BITS(3);
+        uint16_t    DECODE_LOOP    PSG_CTRL_BITS(1);
     };
 
     struct LFO_INFO {
         int16_t     speed;
         uint8_t     depth;
-        uint8_t     BASE_TP_L  : 8;
+        uint8_t     BASE_TP_L  PSG_CTRL_BITS(8);
         uint16_t    delay_tk;
         uint16_t    theta;
-        uint16_t    DELTA_FRAC : 6;
-        uint16_t    TP_FRAC    : 6;
-        uint16_t    BASE_TP_H  : 4;
+        uint16_t    DELTA_FRAC PSG_CTRL_BITS(6);
+        uint16_t    TP_FRAC    PSG_CTRL_BITS(6);
+        uint16_t    BASE_TP_H  PSG_CTRL_BITS(4);
         uint16_t    speed_unit;
     };
 
@@ -300,32 +441,57 @@ namespace PsgCtrl {
         uint16_t    decay_tk;
         uint16_t    fade_tk;
         uint16_t    release_tk;
-        uint16_t    VOL_INT   : 4;
-        uint16_t    VOL_FRAC  :12;
-        uint16_t    REL_VOL_INT   : 4;
-        uint16_t    REL_VOL_FRAC  :12;
+        uint16_t    VOL_INT   PSG_CTRL_BITS(4);
+        uint16_t    VOL_FRAC  PSG_CTRL_BITS(12);
+        uint16_t    REL_VOL_INT   PSG_CTRL_BITS(4);
+        uint16_t    REL_VOL_FRAC  PSG_CTRL_BITS(12);
         uint16_t    sustain;
         uint16_t    time_unit;
     };
 
     struct PITCHBEND_INFO {
         int16_t  level;
-        uint16_t TP_FRAC    : 6;
-        uint16_t TP_D_FRAC  : 6;
-        uint16_t TP_END_L   : 4;
-        uint32_t TP_INT     :12;
-        uint32_t TP_D_INT   :12;
-        uint32_t TP_END_H   : 8;
+        uint16_t TP_FRAC    PSG_CTRL_BITS(6);
+        uint16_t TP_D_FRAC  PSG_CTRL_BITS(6);
+        uint16_t TP_END_L   PSG_CTRL_BITS(4);
+        uint32_t TP_INT     PSG_CTRL_BITS(12);
+        uint32_t TP_D_INT   PSG_CTRL_BITS(12);
+        uint32_t TP_END_H   PSG_CTRL_BITS(8);
+    };
+
+#if PSGINO_USE_DECODE_AHEAD
+    struct STAGED_TONE_INFO {
+        uint16_t    tp;
+        int16_t     shift_degrees;
+        int8_t      tp_ofs;
+        uint8_t     note_num;
+        uint16_t    BIAS           PSG_CTRL_BITS(10);
+        uint16_t    STAGED         PSG_CTRL_BITS(1);    /* The lookahead has run for the current note. */
+        uint16_t    VALID          PSG_CTRL_BITS(1);    /* tp holds the value for the key fields. */
+        PSG_CTRL_PAD(uint16_t, 4)
     };
+#endif
 
     struct CHANNEL_INFO {
         CH_STATUS       ch_status;
         MML_INFO        mml;
         TONE_INFO       tone;
         TIME_INFO       time;
+#if PSGINO_USE_LFO
         LFO_INFO        lfo;
+#endif
+#if PSGINO_USE_SW_ENV
         SW_ENV_INFO     sw_env;
+#endif
+#if PSGINO_USE_PITCHBEND
         PITCHBEND_INFO  pitchbend;
+#endif
+#if PSGINO_USE_DECODE_AHEAD
+        STAGED_TONE_INFO staged;
+#endif
+#if PSGINO_USE_MML_STREAM
+        MML_WINDOW      window;
+#endif
     };
 
     struct PSG_REG {
@@ -334,11 +500,241 @@ namespace PsgCtrl {
         uint8_t    data[16];
     };
 
+    constexpr uint8_t TIMING_PHASE_DECODE           = (0);  /* Timers, MML decoding and gate */
+    constexpr uint8_t TIMING_PHASE_PITCHBEND        = (1);
+    constexpr uint8_t TIMING_PHASE_SW_ENV           = (2);
+    constexpr uint8_t TIMING_PHASE_LFO              = (3);
+    constexpr uint8_t TIMING_PHASE_NOISE_SWEEP      = (4);
+    constexpr uint8_t TIMING_PHASE_CONTROL          = (5);  /* Whole control_psg() call */
+    constexpr uint8_t TIMING_PHASE_OUTPUT           = (6);  /* Register writes in Proc() */
+    constexpr uint8_t TIMING_PHASE_PROC             = (7);  /* Whole Proc() call */
+    constexpr uint8_t NUM_TIMING_PHASE              = (8);
+    constexpr uint8_t NUM_TIMING_HIST_BINS          = (16);
+
+#if PSGINO_USE_TIMING_STATS
+    struct TIMING_PHASE_STATS {
+        uint32_t    min;
+        uint32_t    max;
+        uint32_t    count;
+        /* hist[0] counts samples of 0, hist[k] samples in [2^(k-1), 2^k) counter units.
+         * The last bin also counts every larger sample. Each bin saturates at 0xFFFF. */
+        uint16_t    hist[NUM_TIMING_HIST_BINS];
+    };
+
+    struct TIMING_STATS {
+        uint32_t    (*p_counter)();
+        TIMING_PHASE_STATS phase[NUM_TIMING_PHASE];
+        bool        is_recorded;        /* The last control_psg call recorded its phases. */
+    };
+#endif
+
+    struct CMD_INFO {
+        const char *p_mml;
+        int16_t     param;
+        uint8_t     type;
+        uint8_t     ch;
+        uint8_t     epoch;          /* CMD_QUEUE::epoch when the entry was posted. */
+    };
+
+    /* Single-producer (application) / single-consumer (control_psg) ring buffer.
+     * `tail` is written only by the producer and `head` only by the consumer. */
+    struct CMD_QUEUE {
+        uint8_t     head;
+        uint8_t     tail;
+        uint8_t     epoch;          /* Bumped by `reset`; older entries are dropped. Producer side. */
+        uint8_t     ack_epoch;      /* Last epoch seen by control_psg. */
+        CMD_INFO    cmds[CMD_QUEUE_SIZE];
+    };
+
+    /* State of a SLOT at one song tick, restored by `seek`. */
+    struct SEEK_POINT {
+        uint32_t        song_tick;
+        NOISE_INFO      noise_info;
+        uint8_t         psg_data[16];
+        CHANNEL_INFO    ch_info[NUM_CHANNEL];
+    };
+
+    struct SEEK_INDEX {
+        const SEEK_POINT *p_points;
+        const char     *p_mml;          /* MML the points were built from. */
+        uint16_t        max_points;
+        uint16_t        num_points;
+        uint16_t        interval;       /* Song ticks between two points. */
+    };
+
+    /* Result of `analyze_mml`. Ticks are song ticks (ticks at 100% speed). */
+    struct SONG_INFO {
+        uint32_t        total_ticks;                    /* To the end, or to the end of the first pass of the last infinite loop. */
+        uint32_t        total_ms;                       /* `total_ticks` in milliseconds. */
+        uint32_t        loop_start_tick[NUM_CHANNEL];   /* First tick in the infinite primary loop `[0 ...]`, or NO_LOOP. */
+        uint32_t        loop_ticks[NUM_CHANNEL];        /* Length of one pass of the loop. */
+        MML_OFS         loop_ofs[NUM_CHANNEL];          /* Offset of the loop body from the start of the channel's MML. */
+        uint32_t        peak_cmds_tick;                 /* First tick with `max_cmds_per_tick`. */
+        uint32_t        peak_writes_tick;               /* First tick with `max_writes_per_tick`. */
+        uint8_t         max_cmds_per_tick;              /* All channels together, 0 without PSGINO_USE_CMD_COUNT. */
+        uint8_t         max_writes_per_tick;
+        uint8_t         num_channels;
+        bool            loops_forever;
+        bool            complete;                       /* false when `max_ticks` was reached first. */
+    };
+
+    constexpr uint32_t SONG_MAGIC                   = (0x53475350UL); /* "PSGS" in a little-endian image */
+    constexpr uint8_t SONG_VERSION                  = (1);
+
+    /*
+     * Header at the start of a song image, written by extras/song_pack. All offsets are from the
+     * start of the image. The image is used in place (mmap, XIP flash); it must be aligned to
+     * alignof(SONG_HEADER) and is in the byte order of the target (little-endian).
+     * Channels are indexed in MML order.
+     *
+     * The seek table is not serialized: it is the memory image of the SEEK_POINT array of the
+     * packer, with that compiler's padding, bitfield order and byte order, and a pointer-sized
+     * CHANNEL_INFO::mml.p_mml_head. set_song drops a table whose seek_config or
+     * seek_point_size differs, but an ABI that only orders the bitfields differently passes
+     * that check. The table is only valid when the packer is built for the target's ABI and
+     * settings; otherwise write the image without one.
+     */
+    struct SONG_HEADER {
+        uint32_t        magic;                          /* SONG_MAGIC */
+        uint8_t         version;                        /* SONG_VERSION */
+        uint8_t         num_channels;
+        uint8_t         mml_version;
+        uint8_t         rh_len;
+        uint32_t        s_clock;                        /* PSG clock the seek table was built for. */
+        uint16_t        proc_freq;                      /* Tick rate of the tick fields and the seek table. */
+        uint16_t        seek_interval;                  /* Song ticks between two seek points. */
+        uint32_t        total_ticks;                    /* As SONG_INFO::total_ticks. */
+        uint32_t        loop_start_tick[NUM_CHANNEL];   /* As SONG_INFO, NO_LOOP without an infinite loop. */
+        uint32_t        loop_ticks[NUM_CHANNEL];
+        uint32_t        ofs_loop[NUM_CHANNEL];          /* Offset of the loop body in the image. */
+        uint32_t        ofs_mml;                        /* The MML as text, NUL-terminated. */
+        uint32_t        ofs_channel[NUM_CHANNEL];       /* First byte of the MML of each channel. */
+        uint32_t        len_channel[NUM_CHANNEL];
+        uint32_t        ofs_seek;                       /* SEEK_POINT table (mml.p_mml_head nullptr), 0 if none. */
+        uint16_t        num_seek_points;
+        uint8_t         seek_config;                    /* STATE_CONFIG of the build that wrote the table. */
+        uint8_t         reserved;
+        uint32_t        seek_point_size;                /* sizeof(SEEK_POINT) of that build. */
+        uint32_t        image_size;
+    };
+
+    /*
+     * Playback state of a SLOT saved by `save_state`. The MML position of each channel is
+     * stored as an offset from the first channel, so the blob holds no pointers. The offsets
+     * are 32-bit whatever MML_OFS is, since each channel, not the whole MML, is limited to
+     * MAX_MML_TEXT_LEN.
+     * A blob can only be restored by a build with the same STATE_VERSION, STATE_CONFIG and size.
+     */
+    struct SLOT_STATE {
+        uint8_t         version;
+        uint8_t         config;
+        uint16_t        size;
+        uint32_t        ofs_mml_head[NUM_CHANNEL];
+        GLOBAL_INFO     gl_info;
+        uint8_t         psg_data[16];
+        CHANNEL_INFO    ch_info[NUM_CHANNEL];   /* mml.p_mml_head is nullptr. */
+    };
+
+#if PSGINO_USE_MML_HEADER_DEFS
+    /* Patterns and instruments defined in the header of an MML. */
+    struct MML_HEADER {
+        const char     *p_mml_top;                      /* Start of the header; nullptr without a header. */
+        MML_OFS         ofs_header_end;                 /* Offset of the ';' that ends the header. */
+#if PSGINO_USE_MML_PATTERN
+        MML_OFS         ofs_pattern[MAX_MML_PATTERNS];  /* Offset of the body of each pattern, 0 if undefined. */
+#endif
+#if PSGINO_MML_INSTRUMENTS
+        MML_OFS         ofs_instrument[NUM_MML_INSTRUMENTS];    /* As ofs_pattern. */
+#endif
+    };
+#endif
+
+#if PSGINO_MML_INSTRUMENTS
+    /* Envelope and LFO settings of an instrument I<n>, ready to be copied to a channel by @I<n>. */
+    struct MML_INSTRUMENT {
+#if PSGINO_USE_SW_ENV
+        uint16_t        attack_tk;
+        uint16_t        hold_tk;
+        uint16_t        decay_tk;
+        uint16_t        fade_tk;
+        uint16_t        release_tk;
+        uint16_t        sustain;
+        uint16_t        time_unit;
+#endif
+#if PSGINO_USE_LFO
+        int16_t         speed;
+        uint16_t        speed_unit;
+        uint16_t        delay_tk;
+        uint8_t         depth;
+#endif
+        uint16_t        tempo;          /* Tempo the ticks were computed for, 0 if they do not depend on it. */
+        uint8_t         DEFINED        PSG_CTRL_BITS(1);
+#if PSGINO_USE_SW_ENV
+        uint8_t         SW_ENV_MODE    PSG_CTRL_BITS(1);
+#endif
+#if PSGINO_USE_LFO
+        uint8_t         LFO_MODE       PSG_CTRL_BITS(3);
+#endif
+    };
+#endif
+
+    /* An MML split into channels, as set_mml does. Indexed by channel. */
+    struct MML_LAYOUT {
+        const char     *p_mml_head[NUM_CHANNEL];
+        MML_OFS         mml_len[NUM_CHANNEL];
+        uint8_t         num_ch_used;
+        uint8_t         mml_version;
+        uint8_t         rh_len;
+#if PSGINO_USE_MML_HEADER_DEFS
+        MML_HEADER      header;
+#endif
+    };
+
+    /* MML posted with CMD_SET_MML. The post of sequence number n fills layout[n & 1], so a
+     * newer post replaces one that control_psg has not taken yet. */
+    struct POSTED_MML_INFO {
+        MML_LAYOUT      layout[2];
+        uint8_t         fill_seq;       /* Post being filled. Written only by post_mml and post_song. */
+        uint8_t         req_seq;        /* Newest filled post. Written only by post_mml and post_song. */
+        uint8_t         ack_seq;        /* Written only by control_psg. */
+        uint8_t         reset_seq;      /* req_seq at the last `reset`. Written only by reset. */
+    };
+
+#if PSGINO_USE_MML_QUEUE
+    /* MML waiting to follow the current one. Owned by the producer while req_seq == ack_seq. */
+    struct NEXT_MML_INFO {
+        MML_LAYOUT      layout;
+        uint8_t         at_loop;
+        uint8_t         req_seq;        /* Written only by queue_mml. */
+        uint8_t         ack_seq;        /* Written only by control_psg. */
+    };
+#endif
+
     struct SLOT {
         GLOBAL_INFO     gl_info;
+#if PSGINO_USE_USER_CALLBACK
         CALLBACK_INFO   cb_info;
+#endif
         CHANNEL_INFO   *ch_info_list[NUM_CHANNEL];
         PSG_REG         psg_reg;
+        CMD_QUEUE       cmd_queue;
+        POSTED_MML_INFO posted_mml;
+#if PSGINO_USE_MML_STREAM
+        MML_READER      mml_reader;
+#endif
+#if PSGINO_USE_MML_QUEUE
+        NEXT_MML_INFO   next_mml;
+#endif
+#if PSGINO_USE_MML_HEADER_DEFS
+        MML_HEADER      header;
+#endif
+#if PSGINO_MML_INSTRUMENTS
+        MML_INSTRUMENT  instruments[NUM_MML_INSTRUMENTS];
+        uint32_t        instrument_mask;    /* Bit n: instruments[n] is compiled for the current MML. */
+#endif
+#if PSGINO_USE_TIMING_STATS
+        TIMING_STATS    timing;
+#endif
     };
 
     /**
@@ -347,6 +743,7 @@ namespace PsgCtrl {
      * @param slot Reference to the SLOT structure to be initialized.
      * @param s_clock System clock frequency.The unit of this parameter is 0.01 Hz.
      * @param proc_freq Processing frequency.The unit of this parameter is 1 Hz.
+     *                  Ignored when the frequency is fixed at build time with `PSGINO_PROC_FREQ`.
      * @param reverse Set to true if the slot should process in reverse channel mode.
      * @param p_ch0 Pointer to the first CHANNEL_INFO structure.
      * @param p_ch1 Pointer to the second CHANNEL_INFO structure (optional).
@@ -370,10 +767,28 @@ namespace PsgCtrl {
      * @param mode Mode setting for the MML.
      * @return Returns an integer status code.
      * @retval 0 Success.
-     * @retval Negative value Error.
+     * @retval Negative value Error (-3: a channel is longer than MAX_MML_TEXT_LEN).
      */
     int set_mml(SLOT &slot, const char *p_mml, uint16_t mode);
 
+#if PSGINO_USE_MML_STREAM
+    /**
+     * @brief Sets an MML for a SLOT that is read on demand through a callback.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param read Function that reads the MML source.
+     * @param p_user Pointer passed to read.
+     * @param mode Mode setting for the MML, as in set_mml.
+     * @return 0 on success, -1 if read is nullptr, -2 if the header is invalid or does not
+     *         fit in MML_STREAM_WINDOW bytes, -3 if the source is longer than MAX_MML_TEXT_LEN+1 bytes.
+     *
+     * The source is scanned once here to find the channels. During playback, each channel reads
+     * the part it decodes into its window, from control_psg. A loop that does not fit in the
+     * window is read again on every pass. Must not be called while control_psg runs.
+     */
+    int set_mml_reader(SLOT &slot, MML_READ_FUNC read, void *p_user, uint16_t mode);
+#endif
+
     /**
      * @brief Sets a user-defined callback function for a SLOT.
      *
@@ -381,18 +796,70 @@ namespace PsgCtrl {
      * @param callback Pointer to the callback function that takes a channel and a parameter.
      *
      * This callback is invoked when the @C command is decoded.
+     * Does nothing when `PSGINO_USE_USER_CALLBACK` is 0.
      */
     void set_user_callback(
             SLOT &slot,
             void (*callback)(uint8_t ch, int32_t param)
     );
 
+    /**
+     * @brief Posts a command to be executed at the start of the next control_psg call.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param type One of the CMD_* values.
+     * @param param Parameter of the command (see CMD_*).
+     * @param p_mml Letter for CMD_SET_EFFECT, otherwise nullptr. Use post_mml or post_song for
+     *              CMD_SET_MML.
+     * @param ch Channel of the live commands (CMD_NOTE_ON to CMD_SET_EFFECT).
+     * @return true if the command was queued, false if the queue is full.
+     *
+     * Wait-free. May be called from one thread (or the main loop) while control_psg runs in
+     * another thread or in an interrupt handler, without masking interrupts.
+     *
+     * The live commands make the channel live: it is no longer played by the MML, and sounds
+     * the notes of CMD_NOTE_ON with its envelope, LFO and bias settings from the next
+     * control_psg call, whether the MML is playing or not. The MML of a live channel waits
+     * (and counts as ended) until the next CMD_PLAY, which gives every channel back to the MML.
+     * CMD_SET_EFFECT sets an effect of the channel as the `$` command of that letter with the
+     * value would; the letter must stay valid until the command is executed.
+     */
+    bool post_command(SLOT &slot, uint8_t type, int16_t param = 0, const char *p_mml = nullptr, uint8_t ch = 0);
+
+    /**
+     * @brief Posts an MML to be set, as set_mml does, at the start of the next control_psg call.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param p_mml MML string.
+     * @param mode Mode for MML processing, as in set_mml.
+     * @return 0 on success, -1 to -3 for an invalid MML as in set_mml.
+     *
+     * The MML is split into channels and its header parsed here, so control_psg only copies
+     * the heads in. May be called while control_psg runs, as post_command. An MML posted
+     * before and not set yet is replaced, and the MML is set even if the command queue is
+     * full, after the commands in it.
+     */
+    int post_mml(SLOT &slot, const char *p_mml, uint16_t mode);
+
+    /**
+     * @brief Posts a song image to be set, as set_song does, at the start of the next control_psg call.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param p_image Start of the image. Must remain valid while it is played.
+     * @param size Size of the image in bytes.
+     * @return 0 on success, or the error of check_song.
+     *
+     * Replaces a pending MML or image as post_mml does.
+     */
+    int post_song(SLOT &slot, const void *p_image, uint32_t size);
+
     /**
      * @brief Controls the PSG (Programmable Sound Generator) for a SLOT.
      *
      * @param slot Reference to the SLOT structure.
      *
      * This function must be executed at the frequency specified by the `proc_freq` argument in `init_slot`.
+     * Commands posted with post_command are executed first.
      */
     void control_psg(SLOT &slot);
 
@@ -400,6 +867,9 @@ namespace PsgCtrl {
      * @brief Resets a SLOT to its initial state.
      *
      * @param slot Reference to the SLOT structure.
+     *
+     * Called on the producer side: the commands and the MML posted before the call are
+     * dropped by the next `control_psg` instead of being executed.
      */
     void reset(SLOT &slot);
 
@@ -408,9 +878,28 @@ namespace PsgCtrl {
      *
      * @param slot Reference to the SLOT structure.
      * @param speed_factor Speed factor to be set.
+     *
+     * Rescales the running timers of every channel, or only stores the factor when
+     * `PSGINO_USE_SONG_CLOCK` is 1.
      */
     void set_speed_factor(SLOT &slot, uint16_t speed_factor);
 
+    /**
+     * @brief Sets the maximum number of MML commands decoded per channel in one tick.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param budget Number of non-note commands per channel per tick. 0 means unlimited.
+     *
+     * When a channel runs out of budget before reaching its next note, decoding continues
+     * from the same position in the following tick, and the next note is shortened by the
+     * ticks spent waiting so that later notes stay on time; the ticks that a short note cannot
+     * give are taken from the notes after it. A channel that owes `MAX_DECODE_DEBT` ticks
+     * decodes without budget until it has paid them, so a channel is never more than
+     * `MAX_DECODE_DEBT` ticks behind the others. An `X` command is always decoded together with
+     * its note.
+     */
+    void set_decode_budget(SLOT &slot, uint8_t budget);
+
     /**
      * @brief Shifts the frequency of a SLOT by a certain number of degrees.
      *
@@ -419,8 +908,223 @@ namespace PsgCtrl {
      */
     void shift_frequency(SLOT &slot, int16_t shift_degrees);
 
+#if PSGINO_USE_TIMING_STATS
+    /**
+     * @brief Sets the cycle counter used to time the phases of control_psg.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param counter Function returning a free-running counter (for example DWT->CYCCNT,
+     *                rdtsc or micros()). Wrap-around is handled. nullptr disables recording.
+     *
+     * The statistics are cleared.
+     */
+    void set_timing_counter(SLOT &slot, uint32_t (*counter)());
+
+    /**
+     * @brief Clears the timing statistics of a SLOT.
+     *
+     * @param slot Reference to the SLOT structure.
+     */
+    void reset_timing_stats(SLOT &slot);
+
+    /**
+     * @brief Reads the cycle counter of a SLOT.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @return Current counter value, or 0 when no counter is set.
+     */
+    uint32_t read_timing_counter(const SLOT &slot);
+
+    /**
+     * @brief Adds one sample to the statistics of a phase.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param phase One of the TIMING_PHASE_* values.
+     * @param cycles Duration in counter units.
+     */
+    void add_timing_sample(SLOT &slot, uint8_t phase, uint32_t cycles);
+#endif
+
+    /**
+     * @brief Gets the number of upcoming ticks in which a SLOT only counts down its timers.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @return Number of consecutive `control_psg` calls, starting with the next one,
+     *         that would neither decode MML nor change any PSG register. 0xFFFF means unbounded.
+     *
+     * Used together with `skip_ticks` to drive many slots without calling `control_psg`
+     * on ticks where nothing happens.
+     */
+    uint16_t get_idle_ticks(const SLOT &slot);
+
+    /**
+     * @brief Advances the timers of a SLOT as if `control_psg` had been called `ticks` times.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param ticks Number of ticks to skip. Must not exceed the value returned by `get_idle_ticks`.
+     */
+    void skip_ticks(SLOT &slot, uint16_t ticks);
+
+#if PSGINO_USE_SEEK
+    /**
+     * @brief Builds a seek index by running the MML of a SLOT silently from the start.
+     *
+     * @param slot Reference to the SLOT structure. An MML must be set.
+     * @param index Reference to the SEEK_INDEX structure to be built.
+     * @param p_points Buffer for the points, kept by the index.
+     * @param max_points Number of points that fit in `p_points`.
+     * @param interval Song ticks between two points (1 or more).
+     * @param max_ticks Song ticks after which building stops, for MML that loops forever.
+     *
+     * The user callback is not called. Playback of the SLOT is stopped.
+     * Must not be called while control_psg is running.
+     */
+    void build_seek_index(
+            SLOT &slot,
+            SEEK_INDEX &index,
+            SEEK_POINT *p_points,
+            uint16_t max_points,
+            uint16_t interval,
+            uint32_t max_ticks
+    );
+
+    /**
+     * @brief Moves playback of a SLOT to a song tick and starts playing from there.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param p_index Pointer to a SEEK_INDEX built for the current MML, or nullptr.
+     * @param song_tick Target position in song ticks (ticks at 100% speed).
+     *
+     * The nearest point at or before the target is restored and only the remaining ticks are run.
+     * Without a matching index, the MML is run from the start. The user callback is not called
+     * for the skipped part, and all registers are output by the next control_psg call.
+     * Must not be called while control_psg is running.
+     */
+    void seek(SLOT &slot, const SEEK_INDEX *p_index, uint32_t song_tick);
+#endif
+
+    /**
+     * @brief Checks a song image written by extras/song_pack.
+     *
+     * @param p_image Start of the image.
+     * @param size Size of the image in bytes.
+     * @return 0 if the image is valid, -1 if it is not a song image of SONG_VERSION (or is
+     *         misaligned), -2 if an offset is out of the image, -3 if a channel is longer than
+     *         MAX_MML_TEXT_LEN.
+     */
+    int check_song(const void *p_image, uint32_t size);
+
+    /**
+     * @brief Sets a song image for a SLOT, in place of set_mml.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param p_image Start of the image. Must remain valid while it is played.
+     * @param size Size of the image in bytes.
+     * @return 0 on success, or the error of check_song.
+     *
+     * The channels are taken from the offsets in the header, so nothing is copied and only the
+     * header of the MML is parsed, for its patterns and instruments.
+     */
+    int set_song(SLOT &slot, const void *p_image, uint32_t size);
+
+#if PSGINO_USE_SEEK
+    /**
+     * @brief Points a SEEK_INDEX at the seek table of a song image.
+     *
+     * @param slot Reference to the SLOT structure the image is set for.
+     * @param p_image Start of an image accepted by check_song.
+     * @param index SEEK_INDEX to fill in, for seek.
+     *
+     * The index is left empty if the image has no table, or if the table was written by a build
+     * with other settings, for another PSG clock or for another tick rate than the SLOT's.
+     */
+    void get_song_seek_index(const SLOT &slot, const void *p_image, SEEK_INDEX &index);
+#endif
+
+    /**
+     * @brief Analyzes an MML without outputting anything.
+     *
+     * @param p_mml MML string.
+     * @param mode Mode for MML processing, as in set_mml.
+     * @param s_clock Clock of the PSG, as in init_slot.
+     * @param proc_freq Processing frequency in Hz, as in init_slot.
+     * @param info Reference to the SONG_INFO structure that receives the result.
+     * @param max_ticks Number of song ticks after which the analysis stops.
+     * @return The value returned by set_mml; negative when the MML is invalid.
+     *
+     * The MML is run on a temporary SLOT (about the size of one SLOT and three CHANNEL_INFO on the
+     * stack) at 100% speed, without the user callback and without decode budget. A channel in an infinite
+     * primary loop is followed until it comes back to the first note of the loop with the same
+     * loop counters, which gives the length of one pass.
+     */
+    int analyze_mml(
+            const char *p_mml,
+            uint16_t mode,
+            uint32_t s_clock,
+            uint16_t proc_freq,
+            SONG_INFO &info,
+            uint32_t max_ticks
+    );
+
+#if PSGINO_USE_MML_QUEUE
+    /**
+     * @brief Queues an MML to be played after the current one, without a gap.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param p_mml MML string.
+     * @param mode Mode for MML processing, as in set_mml.
+     * @param at_loop false: switch when the current MML ends. true: switch when the first channel
+     *                reaches the end of a pass of its primary loop (or when the MML ends).
+     * @return 0 on success, -1 to -3 for an invalid MML as in set_mml, -4 if an MML is
+     *         already queued.
+     *
+     * The MML is split into channels here, so control_psg only swaps the heads in. At the switch,
+     * the channels restart in the same tick without the mixer mute of a restart. If no MML is set
+     * or the current one has ended, the queued MML starts at the next control_psg call. While
+     * stopped, it stays queued. set_mml does not cancel it; it follows the MML set by set_mml.
+     * May be called while control_psg runs in another thread or interrupt handler.
+     */
+    int queue_mml(SLOT &slot, const char *p_mml, uint16_t mode, bool at_loop);
+
+    /**
+     * @brief Checks whether an MML queued by queue_mml is still waiting.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @return true while the queued MML has not started.
+     */
+    bool is_mml_queued(const SLOT &slot);
+#endif
+
+    /**
+     * @brief Saves the playback state of a SLOT.
+     *
+     * @param slot Reference to the SLOT structure.
+     * @param state Reference to the SLOT_STATE structure that receives the state.
+     *
+     * The user callback, pending commands and timing statistics are not saved.
+     * Must not be called while control_psg is running.
+     */
+    void save_state(SLOT &slot, SLOT_STATE &state);
+
+    /**
+     * @brief Restores the playback state saved by save_state.
+     *
+     * @param slot Reference to the SLOT structure. Must have the same channel layout as when saved.
+     * @param state Reference to the saved state.
+     * @param p_mml The MML string that was playing when the state was saved. It may be a copy
+     *              at another address.
+     * @return true on success, false if the state was saved by an incompatible build or
+     *         the MML header cannot be parsed. The SLOT is unchanged on failure.
+     *
+     * All registers of the channels are output by the next control_psg call.
+     * Must not be called while control_psg is running.
+     */
+    bool restore_state(SLOT &slot, const SLOT_STATE &state, const char *p_mml);
+
 }
+#if !PSGINO_LAYOUT_SPEED
 #pragma pack()
+#endif
 
 
 #endif/*PSG_CTRL_H*/
@@ -0,0 +1,263 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef PSG_CTRL_CONFIG_H
+#define PSG_CTRL_CONFIG_H
+
+/*
+ * Build-time configuration of psg_ctrl.
+ *
+ * Each setting can be overridden by defining the macro before this header is
+ * included, typically through the compiler options (e.g. -DPSGINO_LAYOUT_SPEED=1).
+ * All translation units of the library must be built with the same settings.
+ */
+
+/*
+ * Memory layout of the state structures (SLOT, CHANNEL_INFO, ...).
+ *
+ * 0: Packed layout. Fields are bitfields under #pragma pack(1), which keeps the
+ *    state as small as possible (default).
+ * 1: Speed layout. Fields are plain, naturally aligned integers, which avoids
+ *    unaligned loads and shift/mask sequences on 32-bit MCUs and hosts at the
+ *    cost of more RAM.
+ */
+#if !defined(PSGINO_LAYOUT_SPEED)
+#define PSGINO_LAYOUT_SPEED     (0)
+#endif
+
+#if PSGINO_LAYOUT_SPEED
+#define PSG_CTRL_BITS(n)
+#define PSG_CTRL_PAD(type, n)
+#else
+#define PSG_CTRL_BITS(n)        : n
+#define PSG_CTRL_PAD(type, n)   type : n;
+#endif
+
+/*
+ * Processing frequency in Hz, i.e. the rate at which control_psg() (Proc()) is called.
+ *
+ * 0: The frequency is given at run time by the proc_freq argument of init_slot()
+ *    (Psgino::Initialize()) (default).
+ * Other: The frequency is fixed to this value. The proc_freq argument is ignored,
+ *    and the per-tick divisions by the frequency become divisions by a constant.
+ */
+#if !defined(PSGINO_PROC_FREQ)
+#define PSGINO_PROC_FREQ        (0)
+#endif
+
+/*
+ * Optional subsystems. Setting one of these to 0 removes both its code and its
+ * per-channel state. The MML commands of a removed subsystem are still parsed,
+ * but they have no effect.
+ *
+ * PSGINO_USE_SW_ENV:               Software envelope ($E, $U, $A, $H, $D, $S, $F, $R).
+ * PSGINO_USE_LFO:                  Software LFO ($M, $J, $V, $L, $T).
+ * PSGINO_USE_PITCHBEND:            Pitchbend ($P) and the pitch glide of legato (&).
+ *                                  Notes joined by & are still tied.
+ * PSGINO_USE_NOISE_SWEEP:          Noise period sweep (J<start>~<end>).
+ * PSGINO_USE_USER_CALLBACK:        User callback (@C).
+ * PSGINO_USE_FINISH_PRIMARY_LOOP:  Psgino::FinishPrimaryLoop().
+ */
+#if !defined(PSGINO_USE_SW_ENV)
+#define PSGINO_USE_SW_ENV               (1)
+#endif
+
+#if !defined(PSGINO_USE_LFO)
+#define PSGINO_USE_LFO                  (1)
+#endif
+
+#if !defined(PSGINO_USE_PITCHBEND)
+#define PSGINO_USE_PITCHBEND            (1)
+#endif
+
+#if !defined(PSGINO_USE_NOISE_SWEEP)
+#define PSGINO_USE_NOISE_SWEEP          (1)
+#endif
+
+#if !defined(PSGINO_USE_USER_CALLBACK)
+#define PSGINO_USE_USER_CALLBACK        (1)
+#endif
+
+#if !defined(PSGINO_USE_FINISH_PRIMARY_LOOP)
+#define PSGINO_USE_FINISH_PRIMARY_LOOP  (1)
+#endif
+
+/*
+ * PSGINO_USE_SONG_CLOCK
+ *
+ * 0: the speed factor is applied to every timer when a note, an envelope phase or an LFO
+ *    delay starts, and set_speed_factor rescales the running timers of all channels.
+ * 1: the timers count in song ticks (100% speed). A per-slot phase accumulator adds the speed
+ *    factor every tick and runs one song tick per 100 accumulated, so set_speed_factor is O(1)
+ *    and exact, and can be called every tick for tempo ramps. Above 100%, a tick may run
+ *    several song ticks (up to 5 at 500%), below 100%, some ticks run none.
+ *    At 100% the output is the same as with 0.
+ */
+#if !defined(PSGINO_USE_SONG_CLOCK)
+#define PSGINO_USE_SONG_CLOCK           (0)
+#endif
+
+/*
+ * PSGINO_USE_MML_QUEUE
+ *
+ * 1: queue_mml (QueueMML) switches to a pre-split MML at the end of the current MML
+ *    or at the end of a pass of its primary loop without a silent tick. SLOT keeps
+ *    the layout of the queued MML.
+ * 0: No MML queue (default).
+ */
+#if !defined(PSGINO_USE_MML_QUEUE)
+#define PSGINO_USE_MML_QUEUE            (0)
+#endif
+
+/*
+ * PSGINO_USE_MML_PATTERN
+ *
+ * 1: The MML header can define the patterns P0-P15, which @P calls. CHANNEL_INFO
+ *    holds a call stack and SLOT the offsets of the patterns.
+ * 0: No patterns (default).
+ */
+#if !defined(PSGINO_USE_MML_PATTERN)
+#define PSGINO_USE_MML_PATTERN          (0)
+#endif
+
+/*
+ * PSGINO_MML_INSTRUMENTS
+ *
+ * Number of instruments I0-I<n-1> that the MML header can define and @I selects
+ * (0 to 32). Each one keeps its envelope and LFO settings, converted to ticks, in
+ * SLOT (24 bytes with all features).
+ * 0: No instruments (default).
+ */
+#if !defined(PSGINO_MML_INSTRUMENTS)
+#define PSGINO_MML_INSTRUMENTS          (0)
+#endif
+
+/* Set when the MML header can define patterns or instruments. */
+#define PSGINO_USE_MML_HEADER_DEFS      (PSGINO_USE_MML_PATTERN || (PSGINO_MML_INSTRUMENTS > 0))
+
+/*
+ * PSGINO_USE_LIVE_NOTE
+ *
+ * 1: The live commands (NoteOn, NoteOff, SetPitchBend, SetEffect, SetInstrument)
+ *    play a channel directly instead of the MML. PsginoMidi and PsginoVoices are
+ *    built on them.
+ * 0: No live commands, PsginoMidi or PsginoVoices (default).
+ */
+#if !defined(PSGINO_USE_LIVE_NOTE)
+#define PSGINO_USE_LIVE_NOTE            (0)
+#endif
+
+/*
+ * PSGINO_USE_SEEK
+ *
+ * 1: The playback position is counted in SLOT, for Seek, BuildSeekIndex, GetPosition
+ *    and the seek table of song images.
+ * 0: No seeking or position (default).
+ */
+#if !defined(PSGINO_USE_SEEK)
+#define PSGINO_USE_SEEK                 (0)
+#endif
+
+/*
+ * PSGINO_MIDI_MAX_CHIPS
+ *
+ * Number of Psgino instances (PSG chips) that one PsginoMidi can play, with three
+ * voices each (1 to 8). Each voice takes 5 bytes of the PsginoMidi object.
+ */
+#if !defined(PSGINO_MIDI_MAX_CHIPS)
+#define PSGINO_MIDI_MAX_CHIPS           (2)
+#endif
+
+/*
+ * PSGINO_VIRTUAL_VOICES
+ *
+ * Number of logical voices of PsginoVoices, which plays them on the three channels
+ * of a Psgino (1 to 64). Each voice takes 6 bytes of the PsginoVoices object.
+ */
+#if !defined(PSGINO_VIRTUAL_VOICES)
+#define PSGINO_VIRTUAL_VOICES           (8)
+#endif
+
+/*
+ * PSGINO_USE_MML_OFS32
+ *
+ * 1: MML positions are 32-bit (MML_OFS is uint32_t), so a channel may be longer
+ *    than 64 KiB. Adds 2 bytes per position to CHANNEL_INFO.
+ * 0: MML positions are 16-bit (default).
+ */
+#if !defined(PSGINO_USE_MML_OFS32)
+#define PSGINO_USE_MML_OFS32            (0)
+#endif
+
+/*
+ * PSGINO_USE_MML_STREAM
+ *
+ * 1: set_mml_reader (SetMMLReader) plays an MML that is read on demand through a
+ *    user-supplied callback, for example from an SD card or SPI flash. Each channel
+ *    keeps a window of PSGINO_MML_STREAM_WINDOW bytes of it in CHANNEL_INFO.
+ * 0: The MML must be a string in memory (default).
+ */
+#if !defined(PSGINO_USE_MML_STREAM)
+#define PSGINO_USE_MML_STREAM           (0)
+#endif
+
+/*
+ * PSGINO_MML_STREAM_WINDOW
+ *
+ * Size in bytes of the window of each channel (16 to 254). A command, including
+ * its parameters, must fit in half of it.
+ */
+#if !defined(PSGINO_MML_STREAM_WINDOW)
+#define PSGINO_MML_STREAM_WINDOW        (32)
+#endif
+
+/*
+ * PSGINO_CMD_QUEUE_SIZE
+ *
+ * Number of entries of the command queue between the API (Play, Stop, SetMML, ...)
+ * and Proc(). One entry is kept free, so SIZE-1 commands can be pending at a time.
+ * Must be a power of two between 2 and 128.
+ */
+#if !defined(PSGINO_CMD_QUEUE_SIZE)
+#define PSGINO_CMD_QUEUE_SIZE           (8)
+#endif
+
+/*
+ * PSGINO_USE_DECODE_AHEAD
+ *
+ * 1: While a note is sounding, the engine looks ahead to the next tone of one
+ *    channel per tick and computes its TP in advance. The note boundary then only
+ *    commits the staged value, which spreads the cost of notes that start in the
+ *    same tick. Adds 8 bytes to CHANNEL_INFO.
+ * 0: TP is computed at the note boundary (default).
+ */
+#if !defined(PSGINO_USE_DECODE_AHEAD)
+#define PSGINO_USE_DECODE_AHEAD         (0)
+#endif
+
+/*
+ * PSGINO_USE_CMD_COUNT
+ *
+ * 1: The MML commands decoded in each song tick are counted in SLOT, for the
+ *    max_cmds_per_tick of analyze_mml(). psgino_analyze is built with it.
+ * 0: analyze_mml() reports 0 commands per tick (default).
+ */
+#if !defined(PSGINO_USE_CMD_COUNT)
+#define PSGINO_USE_CMD_COUNT            (0)
+#endif
+
+/*
+ * PSGINO_USE_TIMING_STATS
+ *
+ * 1: control_psg() and Psgino::Proc() record the time spent in each phase
+ *    (decode, pitchbend, software envelope, LFO, noise sweep, register output)
+ *    with a user-supplied cycle counter, see Psgino::SetTimingCounter().
+ * 0: No instrumentation (default).
+ */
+#if !defined(PSGINO_USE_TIMING_STATS)
+#define PSGINO_USE_TIMING_STATS         (0)
+#endif
+
+#endif/*PSG_CTRL_CONFIG_H*/
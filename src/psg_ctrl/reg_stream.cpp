@@ -0,0 +1,238 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#include "reg_stream.h"
+
+namespace PsgCtrl {
+
+    namespace {
+
+        uint16_t get_le16(const uint8_t *p) {
+
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        uint32_t get_le32(const uint8_t *p) {
+
+            return static_cast<uint32_t>(p[0])
+                 | (static_cast<uint32_t>(p[1]) << 8)
+                 | (static_cast<uint32_t>(p[2]) << 16)
+                 | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        /* Size of the token at p, or 0 if it is not a frame token or does not fit in `left` bytes. */
+        uint32_t get_frame_token_size(const uint8_t *p, uint32_t left) {
+
+            uint8_t t = p[0];
+            uint32_t size;
+
+            if ( t < REG_STREAM_ONE ) {
+
+                size = 1;
+
+            } else if ( t < (REG_STREAM_ONE + REG_STREAM_NUM_REGS) ) {
+
+                size = 2;
+
+            } else if ( ( t >= REG_STREAM_MASK ) && ( t < REG_STREAM_COPY ) ) {
+
+                if ( left < 2 ) {
+
+                    return 0;
+                }
+                size = 2;
+                for ( uint16_t mask = static_cast<uint16_t>(((t & 0x3F) << 8) | p[1]); mask != 0; mask >>= 1 ) {
+
+                    size += (mask & 1);
+                }
+
+            } else {
+
+                return 0;
+            }
+
+            return ( size <= left ) ? size : 0;
+        }
+    }
+
+    int open_reg_stream(REG_STREAM &rs, const void *p_image, uint32_t size) {
+
+        const uint8_t *p_bytes = static_cast<const uint8_t *>(p_image);
+        const uint8_t *p_data;
+        uint32_t data_size;
+        uint32_t loop_ofs;
+        uint32_t ofs;
+        bool loop_found = false;
+
+        if ( ( p_bytes == nullptr ) ||
+             ( size < REG_STREAM_HEADER_SIZE ) ||
+             ( p_bytes[0] != 'P' ) || ( p_bytes[1] != 'S' ) || ( p_bytes[2] != 'G' ) || ( p_bytes[3] != 'R' ) ||
+             ( p_bytes[4] != REG_STREAM_VERSION )
+        ) {
+
+            return -1;
+        }
+
+        p_data = p_bytes + REG_STREAM_HEADER_SIZE;
+        loop_ofs = get_le32(&p_bytes[16]);
+        data_size = get_le32(&p_bytes[20]);
+        if ( ( data_size == 0 ) || ( data_size > size - REG_STREAM_HEADER_SIZE ) ) {
+
+            return -2;
+        }
+
+        /* Every token must be complete, and the data must end with the only END. */
+        ofs = 0;
+        while ( ofs < data_size - 1 ) {
+
+            const uint8_t *p = &p_data[ofs];
+            uint32_t tsize;
+
+            if ( ofs == loop_ofs ) {
+
+                loop_found = true;
+            }
+
+            if ( ( p[0] >= REG_STREAM_COPY ) && ( p[0] != REG_STREAM_END ) ) {
+
+                uint32_t dist;
+                uint32_t src;
+                uint8_t n = (p[0] & 0x3F) + 1;
+
+                if ( data_size - 1 - ofs < 3 ) {
+
+                    return -2;
+                }
+                dist = get_le16(&p[1]);
+                if ( ( dist == 0 ) || ( dist > ofs ) ) {
+
+                    return -2;
+                }
+                /* The replayed tokens must be frame tokens that end before the COPY. */
+                src = ofs - dist;
+                while ( n-- != 0 ) {
+
+                    tsize = get_frame_token_size(&p_data[src], ofs - src);
+                    if ( tsize == 0 ) {
+
+                        return -2;
+                    }
+                    src += tsize;
+                }
+                tsize = 3;
+
+            } else {
+
+                tsize = get_frame_token_size(p, data_size - 1 - ofs);
+                if ( tsize == 0 ) {
+
+                    return -2;
+                }
+            }
+            ofs += tsize;
+        }
+        if ( ( ofs != data_size - 1 ) || ( p_data[ofs] != REG_STREAM_END ) ) {
+
+            return -2;
+        }
+        if ( ( loop_ofs != REG_STREAM_NO_LOOP ) && !loop_found ) {
+
+            return -2;
+        }
+
+        rs.p_data = p_data;
+        rs.p_loop = ( loop_ofs != REG_STREAM_NO_LOOP ) ? &p_data[loop_ofs] : nullptr;
+        rs.proc_freq = get_le16(&p_bytes[6]);
+        rs.num_frames = get_le32(&p_bytes[8]);
+        rs.loop_frame = get_le32(&p_bytes[12]);
+        rewind_reg_stream(rs);
+
+        return 0;
+    }
+
+    void rewind_reg_stream(REG_STREAM &rs) {
+
+        rs.p_pos = rs.p_data;
+        rs.p_ret = nullptr;
+        rs.frame = 0;
+        rs.copy_left = 0;
+        rs.wait_left = 0;
+        rs.playing = true;
+    }
+
+    bool proc_reg_stream(REG_STREAM &rs, void (*write)(uint8_t addr, uint8_t data)) {
+
+        const uint8_t *p;
+        uint8_t t;
+
+        if ( !rs.playing ) {
+
+            return false;
+        }
+
+        if ( rs.wait_left != 0 ) {
+
+            rs.wait_left--;
+            rs.frame++;
+            return true;
+        }
+
+        if ( ( rs.copy_left == 0 ) && ( rs.p_ret != nullptr ) ) {
+
+            rs.p_pos = rs.p_ret;
+            rs.p_ret = nullptr;
+        }
+
+        p = rs.p_pos;
+        if ( p[0] == REG_STREAM_END ) {
+
+            if ( rs.p_loop == nullptr ) {
+
+                rs.playing = false;
+                return false;
+            }
+            p = rs.p_loop;
+            rs.frame = rs.loop_frame;
+        }
+
+        if ( p[0] >= REG_STREAM_COPY ) {
+
+            rs.p_ret = p + 3;
+            rs.copy_left = (p[0] & 0x3F) + 1;
+            p -= get_le16(&p[1]);
+        }
+        if ( rs.copy_left != 0 ) {
+
+            rs.copy_left--;
+        }
+
+        t = *p++;
+        if ( t < REG_STREAM_ONE ) {
+
+            rs.wait_left = t;
+
+        } else if ( t < REG_STREAM_MASK ) {
+
+            write(t & 0x0F, *p++);
+
+        } else {
+
+            uint16_t mask = static_cast<uint16_t>(((t & 0x3F) << 8) | *p++);
+
+            for ( uint8_t addr = 0; mask != 0; addr++, mask >>= 1 ) {
+
+                if ( (mask & 1) != 0 ) {
+
+                    write(addr, *p++);
+                }
+            }
+        }
+
+        rs.p_pos = p;
+        rs.frame++;
+
+        return true;
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * MIT License, see the LICENSE file for details.
+ *
+ * Copyright (c) 2023 nyannkov
+ */
+#ifndef REG_STREAM_H
+#define REG_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace PsgCtrl {
+
+    /*
+     * Compressed register stream, written by extras/reg_pack.
+     *
+     * Header (24 bytes, little-endian):
+     *   0  "PSGR"
+     *   4  version (REG_STREAM_VERSION)
+     *   5  reserved
+     *   6  proc_freq   Tick rate the stream was rendered at.
+     *   8  num_frames  Number of ticks to the end of the stream.
+     *  12  loop_frame  Tick the stream continues at after the end.
+     *  16  loop_ofs    Offset of the loop frame in the data, REG_STREAM_NO_LOOP if none.
+     *  20  data_size   Size of the data that follows the header.
+     *
+     * The data is a sequence of tokens, one or more frames (ticks) each. Only the registers that
+     * changed since the previous frame are stored; registers are written in register order.
+     *   0x00-0x3F  WAIT: 1-64 frames without writes.
+     *   0x40-0x4D  One register (low 4 bits), followed by its value.
+     *   0x80-0xBF  Mask of R8-R13 (low 6 bits), mask of R0-R7, then the value of each set bit.
+     *   0xC0-0xFE  COPY: the next 1-63 tokens (low 6 bits + 1) are replayed from a previous part
+     *              of the data, 2 bytes of distance back from this token follow. The replayed
+     *              tokens contain neither COPY nor END.
+     *   0xFF       END: the stream continues at loop_ofs, or stops.
+     * The loop frame is a full frame, so no register state is carried over the jump.
+     */
+    constexpr uint8_t REG_STREAM_VERSION            = (1);
+    constexpr uint32_t REG_STREAM_HEADER_SIZE       = (24);
+    constexpr uint32_t REG_STREAM_NO_LOOP           = (0xFFFFFFFFUL);
+    constexpr uint8_t REG_STREAM_NUM_REGS           = (14);
+
+    constexpr uint8_t REG_STREAM_WAIT               = (0x00);
+    constexpr uint8_t REG_STREAM_ONE                = (0x40);
+    constexpr uint8_t REG_STREAM_MASK               = (0x80);
+    constexpr uint8_t REG_STREAM_COPY               = (0xC0);
+    constexpr uint8_t REG_STREAM_END                = (0xFF);
+    constexpr uint8_t REG_STREAM_MAX_RUN            = (64);     /* Frames of a WAIT token */
+    constexpr uint8_t REG_STREAM_MAX_COPY           = (63);     /* Tokens of a COPY token */
+    constexpr uint32_t REG_STREAM_MAX_DIST          = (0xFFFF);
+
+    /* Playback state of a register stream; the data is read in place. */
+    struct REG_STREAM {
+        const uint8_t  *p_data;
+        const uint8_t  *p_pos;          /* Next token. */
+        const uint8_t  *p_ret;          /* Token after the COPY being replayed, nullptr if none. */
+        const uint8_t  *p_loop;         /* nullptr without a loop. */
+        uint32_t        num_frames;
+        uint32_t        loop_frame;
+        uint32_t        frame;          /* Frame played by the next call. */
+        uint16_t        proc_freq;
+        uint8_t         copy_left;      /* Tokens left in the COPY. */
+        uint8_t         wait_left;      /* Frames left in the WAIT. */
+        bool            playing;
+    };
+
+    /**
+     * @brief Checks a register stream and prepares it for playback from the start.
+     *
+     * @param rs Reference to the REG_STREAM structure.
+     * @param p_image Start of the stream (header included). Must remain valid while it is played.
+     * @param size Size of the stream in bytes.
+     * @return 0 on success, -1 if it is not a stream of REG_STREAM_VERSION, -2 if the data is
+     *         truncated or contains an invalid token, COPY or loop offset.
+     *
+     * Every token is checked here, in time proportional to the size, so that proc_reg_stream
+     * needs no checks.
+     */
+    int open_reg_stream(REG_STREAM &rs, const void *p_image, uint32_t size);
+
+    /**
+     * @brief Moves playback of a register stream back to the start.
+     *
+     * @param rs Reference to a REG_STREAM opened by open_reg_stream.
+     */
+    void rewind_reg_stream(REG_STREAM &rs);
+
+    /**
+     * @brief Plays one frame of a register stream.
+     *
+     * @param rs Reference to a REG_STREAM opened by open_reg_stream.
+     * @param write Function that writes a PSG register.
+     * @return true while playing, false once the stream has ended.
+     *
+     * Call at the proc_freq of the stream. One call reads at most one COPY and one frame token, so
+     * it makes at most REG_STREAM_NUM_REGS writes and uses no memory besides REG_STREAM.
+     */
+    bool proc_reg_stream(REG_STREAM &rs, void (*write)(uint8_t addr, uint8_t data));
+}
+
+#endif/*REG_STREAM_H*/